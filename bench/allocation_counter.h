@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+namespace bench {
+
+/**
+ * @brief Returns the number of heap allocations made by the calling thread.
+ *
+ * The count is maintained by replacements of the global `operator new`
+ * defined in allocation_counter.cpp, so it covers every allocation made
+ * through the standard library, Boost.Asio and the ethernet_client libraries.
+ * Allocations made by other threads, such as the stand-in server, are not
+ * included.
+ *
+ * @return The number of allocations made by the calling thread so far.
+ */
+std::size_t threadAllocationCount() noexcept;
+
+}  // namespace bench
@@ -0,0 +1,254 @@
+// Measures the raw cost of the message codec and of the parameter value
+// conversions, and fails if any of them misses its release target.
+//
+// Pass --no-timing to check only the allocation targets, for example on
+// machines slower than the reference machine the timing targets were set on.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "ethernet_client.h"
+#include "ethernet_frame.h"
+
+namespace {
+
+constexpr int kWarmupIterations = 1000;
+constexpr int kIterations = 200000;
+
+/** The payload sizes the codec is measured at. */
+constexpr std::array<size_t, 8> kPayloadSizes{
+    0, 1, 8, 64, 256, 512, 1024, EthernetMessage::kBufferSize};
+
+/**
+ * @brief The release target of a benchmark.
+ *
+ * The time target applies to a Release build on the reference machine; the
+ * allocation target applies everywhere.
+ */
+struct Target {
+  double nsPerOp;           ///< Maximum time per operation.
+  double allocationsPerOp;  ///< Maximum heap allocations per operation.
+};
+
+/**
+ * @brief Returns the target of a codec operation on a payload size.
+ *
+ * The owning codec allocates the payload vector (or the frame) once;
+ * copying it costs about a nanosecond per 16 bytes, which the slope allows
+ * for with headroom.
+ */
+Target codecTarget(size_t payloadSize, double allocations) {
+  return {80.0 + 0.25 * static_cast<double>(payloadSize), allocations};
+}
+
+/** A data type and the bit length of its values. */
+struct DataType {
+  const char* name;              ///< Name of the data type.
+  common::ObjectDataType type;   ///< The data type.
+  uint16_t bitLength;            ///< Bit length of a value.
+};
+
+constexpr DataType kDataTypes[] = {
+    {"BOOLEAN", common::ObjectDataType::BOOLEAN, 1},
+    {"BYTE", common::ObjectDataType::BYTE, 8},
+    {"WORD", common::ObjectDataType::WORD, 16},
+    {"DWORD", common::ObjectDataType::DWORD, 32},
+    {"BIT1", common::ObjectDataType::BIT1, 1},
+    {"BIT2", common::ObjectDataType::BIT2, 2},
+    {"BIT3", common::ObjectDataType::BIT3, 3},
+    {"BIT4", common::ObjectDataType::BIT4, 4},
+    {"BIT5", common::ObjectDataType::BIT5, 5},
+    {"BIT6", common::ObjectDataType::BIT6, 6},
+    {"BIT7", common::ObjectDataType::BIT7, 7},
+    {"BIT8", common::ObjectDataType::BIT8, 8},
+    {"BIT9", common::ObjectDataType::BIT9, 9},
+    {"BIT10", common::ObjectDataType::BIT10, 10},
+    {"BIT11", common::ObjectDataType::BIT11, 11},
+    {"BIT12", common::ObjectDataType::BIT12, 12},
+    {"BIT13", common::ObjectDataType::BIT13, 13},
+    {"BIT14", common::ObjectDataType::BIT14, 14},
+    {"BIT15", common::ObjectDataType::BIT15, 15},
+    {"BIT16", common::ObjectDataType::BIT16, 16},
+    {"BITARR8", common::ObjectDataType::BITARR8, 8},
+    {"BITARR16", common::ObjectDataType::BITARR16, 16},
+    {"BITARR32", common::ObjectDataType::BITARR32, 32},
+    {"INTEGER8", common::ObjectDataType::INTEGER8, 8},
+    {"INTEGER16", common::ObjectDataType::INTEGER16, 16},
+    {"INTEGER24", common::ObjectDataType::INTEGER24, 24},
+    {"INTEGER32", common::ObjectDataType::INTEGER32, 32},
+    {"INTEGER40", common::ObjectDataType::INTEGER40, 40},
+    {"INTEGER48", common::ObjectDataType::INTEGER48, 48},
+    {"INTEGER56", common::ObjectDataType::INTEGER56, 56},
+    {"INTEGER64", common::ObjectDataType::INTEGER64, 64},
+    {"UNSIGNED8", common::ObjectDataType::UNSIGNED8, 8},
+    {"UNSIGNED16", common::ObjectDataType::UNSIGNED16, 16},
+    {"UNSIGNED24", common::ObjectDataType::UNSIGNED24, 24},
+    {"UNSIGNED32", common::ObjectDataType::UNSIGNED32, 32},
+    {"UNSIGNED40", common::ObjectDataType::UNSIGNED40, 40},
+    {"UNSIGNED48", common::ObjectDataType::UNSIGNED48, 48},
+    {"UNSIGNED56", common::ObjectDataType::UNSIGNED56, 56},
+    {"UNSIGNED64", common::ObjectDataType::UNSIGNED64, 64},
+    {"REAL32", common::ObjectDataType::REAL32, 32},
+    {"REAL64", common::ObjectDataType::REAL64, 64},
+    {"GUID", common::ObjectDataType::GUID, 128},
+    {"VISIBLE_STRING", common::ObjectDataType::VISIBLE_STRING, 128},
+    {"OCTET_STRING", common::ObjectDataType::OCTET_STRING, 128},
+    {"UNICODE_STRING", common::ObjectDataType::UNICODE_STRING, 128},
+    {"ARRAY_OF_INT", common::ObjectDataType::ARRAY_OF_INT, 128},
+    {"ARRAY_OF_SINT", common::ObjectDataType::ARRAY_OF_SINT, 128},
+    {"ARRAY_OF_DINT", common::ObjectDataType::ARRAY_OF_DINT, 128},
+    {"ARRAY_OF_UDINT", common::ObjectDataType::ARRAY_OF_UDINT, 128},
+    {"TIME_OF_DAY", common::ObjectDataType::TIME_OF_DAY, 48},
+    {"TIME_DIFFERENCE", common::ObjectDataType::TIME_DIFFERENCE, 48},
+};
+
+/**
+ * @brief Keeps the compiler from optimizing a result away.
+ */
+volatile size_t sink = 0;
+
+bool checkTiming = true;
+int failures = 0;
+
+/**
+ * @brief Runs an operation repeatedly, reports its cost and checks it
+ * against its target.
+ */
+template <typename Operation>
+void measure(const char* name, const Target& target, Operation operation) {
+  for (int i = 0; i < kWarmupIterations; ++i) {
+    operation();
+  }
+
+  const size_t allocationsBefore = bench::threadAllocationCount();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    operation();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const size_t allocations =
+      bench::threadAllocationCount() - allocationsBefore;
+
+  const double nsPerOp =
+      std::chrono::duration<double, std::nano>(elapsed).count() / kIterations;
+  const double allocationsPerOp =
+      static_cast<double>(allocations) / kIterations;
+  const bool missed =
+      allocationsPerOp > target.allocationsPerOp ||
+      (checkTiming && nsPerOp > target.nsPerOp);
+  std::printf("%-40s %10.1f ns/op %8.3f allocs/op  (target %7.1f / %.0f)%s\n",
+              name, nsPerOp, allocationsPerOp, target.nsPerOp,
+              target.allocationsPerOp, missed ? "  MISSED" : "");
+  failures += missed ? 1 : 0;
+}
+
+/**
+ * @brief Measures the owning and the in-place codec on one payload size.
+ */
+void measureCodec(size_t payloadSize) {
+  EthernetMessage message{};
+  message.type = EthernetMessageType::SDO_READ;
+  message.id = 0x1234;
+  message.status = EthernetMessageStatus::OK;
+  message.size = static_cast<uint16_t>(payloadSize);
+  message.data.assign(payloadSize, 0x5A);
+  const std::vector<uint8_t> frame = serializeEthernetMessage(message);
+
+  // An empty payload needs no vector, a non-empty one exactly one
+  const double payloadAllocations = payloadSize > 0 ? 1.0 : 0.0;
+  char name[64];
+
+  std::snprintf(name, sizeof(name), "parseEthernetMessage %zu B",
+                payloadSize);
+  measure(name, codecTarget(payloadSize, payloadAllocations), [&] {
+    sink = sink + parseEthernetMessage(frame).data.size();
+  });
+
+  std::snprintf(name, sizeof(name), "serializeEthernetMessage %zu B",
+                payloadSize);
+  measure(name, codecTarget(payloadSize, 1.0), [&] {
+    sink = sink + serializeEthernetMessage(message).size();
+  });
+
+  EthernetMessageView view{};
+  std::snprintf(name, sizeof(name), "parseEthernetMessageView %zu B",
+                payloadSize);
+  measure(name, {20.0, 0.0}, [&] {
+    sink = sink + parseEthernetMessageView(frame, view);
+  });
+
+  std::array<uint8_t, EthernetMessage::kHeaderSize> header{};
+  std::snprintf(name, sizeof(name), "serializeEthernetMessageHeader %zu B",
+                payloadSize);
+  measure(name, {20.0, 0.0}, [&] {
+    serializeEthernetMessageHeader(message.type, message.id, message.status,
+                                   message.size, header);
+    sink = sink + header[5];
+  });
+}
+
+/**
+ * @brief Measures the value conversions of one data type.
+ */
+void measureParameter(const DataType& dataType) {
+  common::Parameter parameter{};
+  parameter.index = 0x2000;
+  parameter.dataType = dataType.type;
+  parameter.bitLength = dataType.bitLength;
+  parameter.data.assign((dataType.bitLength + 7) / 8, 0x31);
+
+  common::ParameterValue value;
+  try {
+    value = parameter.getValue();
+    parameter.setValue(value);
+  } catch (const std::exception& e) {
+    std::printf("%-40s unsupported: %s\n", dataType.name, e.what());
+    return;
+  }
+
+  // Strings and byte arrays are returned in a new container
+  const bool owning = std::holds_alternative<std::string>(value) ||
+                      std::holds_alternative<std::vector<uint8_t>>(value);
+  char name[64];
+
+  std::snprintf(name, sizeof(name), "getValue %s", dataType.name);
+  measure(name, {owning ? 80.0 : 40.0, owning ? 1.0 : 0.0}, [&] {
+    sink = sink + parameter.getValue().index();
+  });
+
+  std::snprintf(name, sizeof(name), "setValue %s", dataType.name);
+  measure(name, {owning ? 80.0 : 40.0, 0.0}, [&] {
+    parameter.setValue(value);
+    sink = sink + parameter.data.size();
+  });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--no-timing") == 0) {
+      checkTiming = false;
+    }
+  }
+
+  for (size_t payloadSize : kPayloadSizes) {
+    measureCodec(payloadSize);
+  }
+  for (const auto& dataType : kDataTypes) {
+    measureParameter(dataType);
+  }
+
+  if (failures > 0) {
+    std::printf("FAILED: %d benchmarks missed their release target\n",
+                failures);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
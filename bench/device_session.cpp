@@ -0,0 +1,75 @@
+// Checks that a DeviceSession recovers when the device side drops the
+// connection, and that an error on a connection that still works is not
+// retried. Reports how long the recovery took.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "device_session.h"
+#include "stand_in_server.h"
+
+namespace {
+
+int failures = 0;
+
+/**
+ * @brief Reports a check and counts it if it failed.
+ */
+void check(const char* name, bool passed) {
+  std::printf("%-52s %s\n", name, passed ? "ok" : "FAILED");
+  failures += passed ? 0 : 1;
+}
+
+}  // namespace
+
+int main() {
+  bench::StandInServer server;
+  EthernetDevice device("127.0.0.1", server.port());
+  if (!device.connect()) {
+    std::printf("FAILED: cannot connect to the stand-in server\n");
+    return EXIT_FAILURE;
+  }
+
+  DeviceSession session(device);
+  check("target state set",
+        session.setState(DeviceSession::kPreOperationalState));
+
+  // The device still answers, so the error is the operation's own
+  bool rethrown = false;
+  try {
+    session.call([](EthernetDevice&) -> int {
+      throw std::runtime_error("Refused by the device");
+    });
+  } catch (const std::runtime_error&) {
+    rethrown = true;
+  }
+  check("error on a working connection is rethrown", rethrown);
+  check("no reconnection for it", session.reconnectCount() == 0);
+
+  // The socket stays open on this side, as after a device reboot
+  server.dropConnection();
+  const auto start = std::chrono::steady_clock::now();
+  uint8_t state = 0;
+  try {
+    state = session.call(
+        [](EthernetDevice& device) { return device.getState(); });
+  } catch (const std::runtime_error& e) {
+    std::printf("call failed: %s\n", e.what());
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  check("dropped connection is restored", session.reconnectCount() == 1);
+  check("operation succeeds after the reconnection",
+        state == DeviceSession::kPreOperationalState);
+  std::printf("recovery took %.1f ms\n",
+              std::chrono::duration<double, std::milli>(elapsed).count());
+
+  if (failures > 0) {
+    std::printf("FAILED: %d checks\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
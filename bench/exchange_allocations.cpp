@@ -0,0 +1,109 @@
+// Counts the heap allocations per operation on the steady-state exchange
+// paths of EthernetConnection and fails if any of them allocates.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "allocation_counter.h"
+#include "ethernet_connection.h"
+#include "stand_in_server.h"
+
+namespace {
+
+constexpr int kWarmupIterations = 100;
+constexpr int kIterations = 20000;
+
+/**
+ * @brief Runs an operation repeatedly and reports its cost.
+ *
+ * @return The number of allocations per operation after the warm-up.
+ */
+template <typename Operation>
+double measure(const char* name, Operation operation) {
+  for (int i = 0; i < kWarmupIterations; ++i) {
+    operation();
+  }
+
+  const size_t allocationsBefore = bench::threadAllocationCount();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    operation();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const size_t allocations =
+      bench::threadAllocationCount() - allocationsBefore;
+
+  const double nsPerOp =
+      std::chrono::duration<double, std::nano>(elapsed).count() / kIterations;
+  const double allocationsPerOp =
+      static_cast<double>(allocations) / kIterations;
+  std::printf("%-32s %10.1f ns/op %8.3f allocs/op\n", name, nsPerOp,
+              allocationsPerOp);
+  return allocationsPerOp;
+}
+
+}  // namespace
+
+int main() {
+  bench::StandInServer server;
+  EthernetConnection connection{"127.0.0.1", server.port()};
+  if (!connection.connect()) {
+    return EXIT_FAILURE;
+  }
+
+  std::array<uint8_t, 4> value{1, 2, 3, 4};
+  std::array<uint8_t, 16> rxPdo{};
+  std::array<uint8_t, EthernetMessage::kBufferSize> txPdo{};
+
+  std::array<std::array<uint8_t, 4>, 16> values{};
+  std::array<SdoTransfer, 16> transfers;
+  for (size_t i = 0; i < transfers.size(); ++i) {
+    transfers[i] = {static_cast<uint16_t>(0x2000 + i), 0, values[i]};
+  }
+
+  common::Parameter parameter{};
+  parameter.index = 0x607A;
+  parameter.subindex = 0;
+  parameter.data.reserve(EthernetMessage::kBufferSize);
+
+  double allocationsPerOp = 0.0;
+  allocationsPerOp += measure("readSdo", [&] {
+    connection.readSdo(0x6064, 0, value);
+  });
+  allocationsPerOp += measure("writeSdo", [&] {
+    connection.writeSdo(0x607A, 0, value);
+  });
+  allocationsPerOp += measure("upload(Parameter&)", [&] {
+    connection.upload(parameter);
+  });
+  allocationsPerOp += measure("download(Parameter&)", [&] {
+    connection.download(parameter);
+  });
+  allocationsPerOp += measure("upload<int32_t>", [&] {
+    connection.upload<int32_t>(0x6064, 0);
+  });
+  allocationsPerOp += measure("download<int32_t>", [&] {
+    connection.download<int32_t>(0x607A, 0, 1000);
+  });
+  allocationsPerOp += measure("sendAndReceiveProcessData", [&] {
+    connection.sendAndReceiveProcessData(rxPdo, txPdo);
+  });
+  allocationsPerOp += measure("getState", [&] { connection.getState(); });
+  allocationsPerOp += measure("writeSdos (16 pipelined)", [&] {
+    connection.writeSdos(transfers);
+  });
+  allocationsPerOp += measure("readSdos (16 pipelined)", [&] {
+    connection.readSdos(transfers);
+  });
+
+  connection.disconnect();
+
+  if (allocationsPerOp > 0.0) {
+    std::printf("FAILED: the steady-state exchange paths allocate\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+// Measures diffParameters on a parameter list shaped like the one
+// EthernetDevice::getParameters returns, and fails if the diff misses a
+// writable parameter or writes a read-only one.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "parameter_diff.h"
+
+namespace {
+
+constexpr int kIterations = 200;
+constexpr size_t kObjects = 250;
+constexpr uint8_t kEntries = 8;
+
+/**
+ * @brief Returns the current parameters of a stand-in device.
+ *
+ * As in the lists the device reports, the write access is in `flags` and
+ * `access` and `byteLength` are zero. Odd entries are writable in PRE-OP;
+ * subindex 0 is read-only, so no count guards are involved.
+ */
+std::vector<common::Parameter> currentParameters() {
+  std::vector<common::Parameter> parameters;
+  for (size_t object = 0; object < kObjects; ++object) {
+    for (uint8_t subindex = 0; subindex <= kEntries; ++subindex) {
+      common::Parameter parameter{};
+      parameter.index = static_cast<uint16_t>(0x2000 + object);
+      parameter.subindex = subindex;
+      parameter.dataType = common::ObjectDataType::UNSIGNED32;
+      parameter.bitLength = 32;
+      parameter.flags = subindex % 2 == 1 ? common::ObjectFlags::PO_RDWR
+                                          : common::ObjectFlags::PO_RD;
+      parameter.data = {subindex, 0, 0, 0};
+      parameters.push_back(parameter);
+    }
+  }
+  return parameters;
+}
+
+}  // namespace
+
+int main() {
+  const std::vector<common::Parameter> current = currentParameters();
+
+  // Change every third value
+  std::vector<common::Parameter> target = current;
+  size_t expectedChanges = 0;
+  size_t expectedReadOnly = 0;
+  for (size_t i = 0; i < target.size(); i += 3) {
+    target[i].data[1] = 0xA5;
+    if (target[i].flags == common::ObjectFlags::PO_RDWR) {
+      ++expectedChanges;
+    } else {
+      ++expectedReadOnly;
+    }
+  }
+
+  ParameterDiff diff;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    diff = diffParameters(target, current);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  std::printf("diffParameters %zu parameters %12.1f ns/parameter\n",
+              current.size(),
+              std::chrono::duration<double, std::nano>(elapsed).count() /
+                  kIterations / static_cast<double>(current.size()));
+  std::printf("changes %zu (expected %zu), read-only %zu (expected %zu), "
+              "unchanged %zu\n",
+              diff.changes.size(), expectedChanges, diff.readOnly,
+              expectedReadOnly, diff.unchanged);
+
+  if (diff.changes.size() != expectedChanges ||
+      diff.readOnly != expectedReadOnly || diff.unknown != 0) {
+    std::printf("FAILED: the diff does not match the write access flags\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+// Compares request/response process data cycles with the server-push
+// streaming mode of EthernetConnection, and checks that lost frames are
+// detected.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "ethernet_connection.h"
+#include "stand_in_server.h"
+
+namespace {
+
+constexpr auto kDuration = std::chrono::seconds(1);
+constexpr auto kStreamPeriod = std::chrono::microseconds(1000);
+constexpr size_t kDroppedFrames = 5;
+
+}  // namespace
+
+int main() {
+  bench::StandInServer server;
+  EthernetConnection connection{"127.0.0.1", server.port()};
+  if (!connection.connect()) {
+    return EXIT_FAILURE;
+  }
+
+  std::array<uint8_t, 16> rxPdo{};
+  std::array<uint8_t, EthernetMessage::kBufferSize> txPdo{};
+
+  size_t cycles = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < kDuration) {
+    connection.sendAndReceiveProcessData(rxPdo, txPdo);
+    ++cycles;
+  }
+  std::printf("%-32s %10zu frames/s\n", "request/response", cycles);
+
+  size_t bytes = 0;
+  if (!connection.startProcessDataStream(
+          kStreamPeriod,
+          [&bytes](const EthernetMessageView& frame) {
+            bytes += frame.data.size();
+          })) {
+    return EXIT_FAILURE;
+  }
+
+  start = std::chrono::steady_clock::now();
+  bool dropped = false;
+  while (std::chrono::steady_clock::now() - start < kDuration) {
+    connection.pumpProcessDataStream(std::chrono::milliseconds(100));
+    if (!dropped && std::chrono::steady_clock::now() - start > kDuration / 2) {
+      server.dropStreamFrames(kDroppedFrames);
+      dropped = true;
+    }
+  }
+  connection.stopProcessDataStream();
+
+  const auto stats = connection.processDataStreamStats();
+  std::printf("%-32s %10llu frames/s\n", "streamed",
+              static_cast<unsigned long long>(stats.frames));
+  std::printf("%-32s %10llu lost %6llu late %6llu stale %10zu bytes\n", "",
+              static_cast<unsigned long long>(stats.lostFrames),
+              static_cast<unsigned long long>(stats.lateFrames),
+              static_cast<unsigned long long>(stats.staleFrames), bytes);
+
+  connection.disconnect();
+
+  if (stats.lostFrames != kDroppedFrames) {
+    std::printf("FAILED: expected %zu lost frames\n", kDroppedFrames);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+#include "stand_in_server.h"
+
+namespace bench {
+
+StandInServer::StandInServer(size_t txPdoSize)
+    : acceptor_(ioContext_,
+                boost::asio::ip::tcp::endpoint(
+                    boost::asio::ip::make_address("127.0.0.1"), 0)),
+      socket_(ioContext_),
+      txPdoSize_(txPdoSize) {
+  thread_ = std::thread([this] { serve(); });
+}
+
+StandInServer::~StandInServer() {
+  boost::system::error_code ec;
+  {
+    // Ends the current client, whose serving then stops the stream
+    std::lock_guard<std::mutex> lock(socketMutex_);
+    stopping_ = true;
+    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+  }
+  // Closing the acceptor does not wake a blocked accept, a connection does
+  boost::asio::ip::tcp::socket waker(ioContext_);
+  waker.connect(acceptor_.local_endpoint(), ec);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  stopStream();
+  acceptor_.close(ec);
+}
+
+unsigned short StandInServer::port() const {
+  return acceptor_.local_endpoint().port();
+}
+
+void StandInServer::dropStreamFrames(size_t count) { dropFrames_ += count; }
+
+void StandInServer::dropConnection() {
+  // The serving thread notices on its next read and closes the socket
+  std::lock_guard<std::mutex> lock(socketMutex_);
+  boost::system::error_code ec;
+  socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+}
+
+void StandInServer::serve() {
+  while (true) {
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::socket client(ioContext_);
+    acceptor_.accept(client, ec);
+    if (ec) {
+      return;
+    }
+    client.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    {
+      std::lock_guard<std::mutex> lock(socketMutex_);
+      if (stopping_) {
+        return;
+      }
+      socket_ = std::move(client);
+    }
+
+    serveClient();
+    stopStream();
+    std::lock_guard<std::mutex> lock(socketMutex_);
+    socket_.close(ec);
+  }
+}
+
+void StandInServer::serveClient() {
+  boost::system::error_code ec;
+
+  std::array<uint8_t, EthernetMessage::kHeaderSize> header;
+  std::vector<uint8_t> request;
+  std::vector<uint8_t> response;
+  std::vector<uint8_t> frame;
+  request.reserve(EthernetMessage::kBufferSize);
+  response.reserve(EthernetMessage::kBufferSize);
+  frame.reserve(EthernetMessage::kHeaderSize + EthernetMessage::kBufferSize);
+
+  while (true) {
+    boost::asio::read(socket_, boost::asio::buffer(header), ec);
+    if (ec) {
+      return;
+    }
+
+    const auto type = static_cast<EthernetMessageType>(header[0]);
+    const uint16_t size = static_cast<uint16_t>(header[5] | (header[6] << 8));
+    request.resize(size);
+    boost::asio::read(socket_, boost::asio::buffer(request), ec);
+    if (ec) {
+      return;
+    }
+
+    response.clear();
+    handleRequest(type, request, response);
+
+    // Frames pushed before a stop request precede its acknowledgment
+    const bool control = type == EthernetMessageType::PDO_CONTROL;
+    if (control && (request.empty() || request[0] == 0)) {
+      stopStream();
+    }
+
+    // Responses carry the SQI reply status before the message status
+    frame.assign(header.begin(), header.begin() + 3);
+    frame.push_back(static_cast<uint8_t>(EthernetSqiReplyStatus::ACK));
+    frame.push_back(static_cast<uint8_t>(EthernetMessageStatus::OK));
+    frame.push_back(static_cast<uint8_t>(response.size() & 0xFF));
+    frame.push_back(static_cast<uint8_t>(response.size() >> 8));
+    frame.insert(frame.end(), response.begin(), response.end());
+    {
+      std::lock_guard<std::mutex> lock(writeMutex_);
+      boost::asio::write(socket_, boost::asio::buffer(frame), ec);
+    }
+    if (ec) {
+      stopStream();
+      return;
+    }
+
+    if (control && request.size() >= 5 && request[0] == 1) {
+      const uint32_t period = request[1] | (request[2] << 8) |
+                              (request[3] << 16) |
+                              (static_cast<uint32_t>(request[4]) << 24);
+      startStream(std::chrono::microseconds(period));
+    }
+  }
+}
+
+void StandInServer::startStream(std::chrono::microseconds period) {
+  stopStream();
+  streaming_ = true;
+  streamer_ = std::thread([this, period] {
+    std::vector<uint8_t> frame(EthernetMessage::kHeaderSize + txPdoSize_);
+    frame[0] = static_cast<uint8_t>(EthernetMessageType::PDO_RXTX_FRAME);
+    frame[3] = static_cast<uint8_t>(EthernetSqiReplyStatus::ACK);
+    frame[4] = static_cast<uint8_t>(EthernetMessageStatus::OK);
+    frame[5] = static_cast<uint8_t>(txPdoSize_ & 0xFF);
+    frame[6] = static_cast<uint8_t>(txPdoSize_ >> 8);
+
+    uint16_t id = 0;
+    auto next = std::chrono::steady_clock::now();
+    while (streaming_) {
+      next += period;
+      std::this_thread::sleep_until(next);
+
+      ++id;
+      if (dropFrames_ > 0) {
+        --dropFrames_;
+        continue;
+      }
+      frame[1] = static_cast<uint8_t>(id & 0xFF);
+      frame[2] = static_cast<uint8_t>(id >> 8);
+
+      boost::system::error_code ec;
+      std::lock_guard<std::mutex> lock(writeMutex_);
+      boost::asio::write(socket_, boost::asio::buffer(frame), ec);
+      if (ec) {
+        return;
+      }
+    }
+  });
+}
+
+void StandInServer::stopStream() {
+  streaming_ = false;
+  if (streamer_.joinable()) {
+    streamer_.join();
+  }
+}
+
+void StandInServer::handleRequest(EthernetMessageType type,
+                                  const std::vector<uint8_t>& request,
+                                  std::vector<uint8_t>& response) {
+  switch (type) {
+    case EthernetMessageType::SDO_READ: {
+      const auto key = std::make_pair(
+          static_cast<uint16_t>(request[0] | (request[1] << 8)), request[2]);
+      auto it = values_.find(key);
+      if (it != values_.end()) {
+        response = it->second;
+      } else {
+        response.assign(4, 0);
+      }
+      break;
+    }
+    case EthernetMessageType::SDO_WRITE: {
+      const auto key = std::make_pair(
+          static_cast<uint16_t>(request[0] | (request[1] << 8)), request[2]);
+      values_[key].assign(request.begin() + 6, request.end());
+      break;
+    }
+    case EthernetMessageType::STATE_READ: {
+      response.push_back(state_);
+      break;
+    }
+    case EthernetMessageType::STATE_CONTROL: {
+      state_ = request.empty() ? state_ : request[0];
+      break;
+    }
+    case EthernetMessageType::PDO_RXTX_FRAME: {
+      response.assign(txPdoSize_, 0);
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+}  // namespace bench
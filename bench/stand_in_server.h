@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ethernet_client.h"
+
+namespace bench {
+
+/**
+ * @class StandInServer
+ * @brief Minimal localhost stand-in for a SOMANET device.
+ *
+ * The server listens on an ephemeral port on 127.0.0.1, accepts one client
+ * at a time and answers its requests from its own thread:
+ * - `SDO_READ` returns the last value written to the object, or four zero
+ *   bytes.
+ * - `SDO_WRITE` stores the value and acknowledges it.
+ * - `STATE_READ` and `STATE_CONTROL` read and set the EtherCAT state.
+ * - `PDO_RXTX_FRAME` answers with a TxPDO image of the configured size.
+ * - `PDO_CONTROL` starts (payload `1` and the period in microseconds) or
+ *   stops (payload `0`) pushing TxPDO images at a fixed rate, with sequence
+ *   IDs counting up by one per frame.
+ *
+ * It is meant for benchmarks that need a real socket peer, not for
+ * emulating device behavior.
+ */
+class StandInServer {
+ public:
+  /**
+   * @brief Starts listening and serving on a background thread.
+   *
+   * @param txPdoSize The size of the TxPDO image returned for process data
+   * requests.
+   */
+  explicit StandInServer(size_t txPdoSize = 32);
+
+  /**
+   * @brief Stops the server and joins its thread.
+   */
+  ~StandInServer();
+
+  /**
+   * @brief Returns the port the server listens on.
+   */
+  unsigned short port() const;
+
+  /**
+   * @brief Leaves out the next `count` pushed frames, as if they were lost.
+   *
+   * Their sequence IDs are skipped, so the client sees a gap.
+   */
+  void dropStreamFrames(size_t count);
+
+  /**
+   * @brief Drops the connection to the current client, as a device reboot or
+   * a cable pulled out would, and waits for the next client.
+   */
+  void dropConnection();
+
+ private:
+  /**
+   * @brief Accepts clients one after the other until the server stops.
+   */
+  void serve();
+
+  /**
+   * @brief Answers the requests of the accepted client until it disconnects.
+   */
+  void serveClient();
+
+  /**
+   * @brief Builds the response payload for a request.
+   */
+  void handleRequest(EthernetMessageType type,
+                     const std::vector<uint8_t>& request,
+                     std::vector<uint8_t>& response);
+
+  /**
+   * @brief Starts pushing TxPDO frames from a second thread.
+   */
+  void startStream(std::chrono::microseconds period);
+
+  /**
+   * @brief Stops pushing TxPDO frames and joins the pushing thread.
+   */
+  void stopStream();
+
+  boost::asio::io_context ioContext_;        ///< The server I/O context.
+  boost::asio::ip::tcp::acceptor acceptor_;  ///< Listens for the client.
+  boost::asio::ip::tcp::socket socket_;      ///< The current client.
+  std::thread thread_;                       ///< Runs `serve`.
+  std::mutex socketMutex_;  ///< Guards replacing, closing and shutting down
+                            ///< `socket_`, and `stopping_`.
+  bool stopping_ = false;   ///< Whether the server is being destroyed.
+  std::mutex writeMutex_;  ///< Serializes writes of responses and frames.
+
+  size_t txPdoSize_;  ///< Size of the TxPDO image.
+  uint8_t state_{1};  ///< The current EtherCAT state.
+  std::map<std::pair<uint16_t, uint8_t>, std::vector<uint8_t>>
+      values_;  ///< The SDO values written so far.
+
+  std::thread streamer_;               ///< Pushes the TxPDO frames.
+  std::atomic<bool> streaming_{false};  ///< Whether frames are pushed.
+  std::atomic<size_t> dropFrames_{0};  ///< Pushed frames left to drop.
+};
+
+}  // namespace bench
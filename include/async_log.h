@@ -0,0 +1,459 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+#include "loguru.h"
+
+/**
+ * @class AsyncLogRateLimit
+ * @brief Limits how often one call site logs.
+ *
+ * Lets `burst` messages through per window and counts the rest, so that the
+ * next message let through can report how many similar ones were dropped.
+ * The state is a few relaxed atomics and the constructor is `constexpr`, so
+ * a function-local static needs no initialization guard.
+ */
+class AsyncLogRateLimit {
+ public:
+  /**
+   * @brief Constructs a rate limit.
+   *
+   * @param burst Messages let through per window.
+   * @param window The length of a window.
+   */
+  constexpr explicit AsyncLogRateLimit(
+      uint32_t burst = 10,
+      std::chrono::nanoseconds window = std::chrono::seconds(1))
+      : burst_(burst), window_(window.count()) {}
+
+  /**
+   * @brief Checks whether a message may be logged now.
+   *
+   * @return True if the message may be logged, false if it is suppressed.
+   */
+  bool allow() noexcept;
+
+  /**
+   * @brief Returns and resets the number of suppressed messages.
+   */
+  uint32_t takeSuppressed() noexcept {
+    return suppressed_.exchange(0, std::memory_order_relaxed);
+  }
+
+ private:
+  const uint32_t burst_;                  ///< Messages per window.
+  const int64_t window_;                  ///< Window length in nanoseconds.
+  std::atomic<int64_t> windowStart_{0};   ///< Start of the current window.
+  std::atomic<uint32_t> count_{0};        ///< Messages in the window.
+  std::atomic<uint32_t> suppressed_{0};   ///< Messages dropped since the
+                                          ///< last one let through.
+};
+
+/**
+ * @class AsyncLogSink
+ * @brief Writes loguru output on a background thread.
+ *
+ * Registered as a loguru callback, the sink copies each message into a
+ * bounded lock-free ring and returns; a flusher thread writes the ring to
+ * the output and flushes it. Loguru still formats the message on the
+ * logging thread, but the write and flush no longer happen there. Each call
+ * site logs at most 10 messages per second and reports how many it
+ * suppressed; when the ring is full messages are dropped and counted
+ * instead of blocking the caller. A message too long for a slot, such as a
+ * whole parameter table, is written in full right away on the logging
+ * thread, after everything still in the ring, and is not rate limited. A
+ * fatal message, which loguru follows with an abort, is written right away
+ * on the logging thread together with everything still in the ring.
+ *
+ * The `ASYNC_LOG_F` macro goes further for code on hot paths: it copies the
+ * format string pointer and the raw arguments into the ring without
+ * formatting anything, and the flusher thread formats and logs the message
+ * through loguru later. The preamble still shows the thread and time of the
+ * call, so logging a message this way costs a rate-limit check, a clock
+ * read and a copy of its arguments. Only fatal messages skip all of this and
+ * go to loguru right away.
+ *
+ * Only one sink may exist at a time. It must be destroyed after the threads
+ * that use `ASYNC_LOG_F` have stopped logging.
+ *
+ * @code
+ * AsyncLogSink sink;  // takes over stderr
+ * ASYNC_LOG_F(WARNING, "Lost %u frames on device %d", lost, deviceIndex);
+ * @endcode
+ */
+class AsyncLogSink {
+ public:
+  /**
+   * @struct Options
+   * @brief Configures an `AsyncLogSink`.
+   */
+  struct Options {
+    std::string path;  ///< File to append to. Empty for stderr, in which
+                       ///< case loguru's own stderr output is turned off
+                       ///< while the sink exists.
+    loguru::Verbosity verbosity =
+        loguru::Verbosity_INFO;  ///< Most verbose level written.
+    size_t capacity = 4096;      ///< Ring capacity, rounded up to a power
+                                 ///< of two.
+    std::chrono::milliseconds pollInterval{
+        10};  ///< How long the flusher sleeps when the ring is empty.
+  };
+
+  /**
+   * @brief Registers the sink with loguru and starts the flusher thread.
+   *
+   * @param options The configuration.
+   * @throws std::runtime_error If another sink exists or the output file
+   * cannot be opened.
+   */
+  explicit AsyncLogSink(const Options& options);
+
+  /**
+   * @brief Constructs a sink writing to stderr with default options.
+   */
+  AsyncLogSink();
+
+  /**
+   * @brief Stops the flusher thread once it has written the remaining
+   * messages, then unregisters the sink.
+   */
+  ~AsyncLogSink();
+
+  AsyncLogSink(const AsyncLogSink&) = delete;
+  AsyncLogSink& operator=(const AsyncLogSink&) = delete;
+
+  /**
+   * @brief Returns the sink that exists, or nullptr.
+   */
+  static AsyncLogSink* active() noexcept {
+    return active_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Queues a message to be formatted by the flusher thread.
+   *
+   * Called by `ASYNC_LOG_F`. The arguments are copied as they are, except C
+   * strings, whose characters are copied; the combined size is limited to
+   * the payload of a ring slot and longer strings are cut.
+   *
+   * @param verbosity The verbosity of the message.
+   * @param file The source file of the call site.
+   * @param line The source line of the call site.
+   * @param suppressed The number of messages suppressed at the call site
+   * since the last one.
+   * @param format A printf format string with static storage duration.
+   * @param args The arguments for the format string.
+   *
+   * @return False if the ring was full and the message was dropped.
+   */
+  template <typename... Args>
+  bool log(loguru::Verbosity verbosity, const char* file, unsigned line,
+           uint32_t suppressed, const char* format, const Args&... args) {
+    static_assert(((std::is_arithmetic_v<Deferred<Args>> ||
+                    std::is_pointer_v<Deferred<Args>>) &&
+                   ...),
+                  "Deferred log arguments must be numbers or pointers; "
+                  "pass strings with c_str()");
+    suppressed_.fetch_add(suppressed, std::memory_order_relaxed);
+    Slot* slot = claim();
+    if (slot == nullptr) {
+      return false;
+    }
+    slot->kind = Slot::Kind::DEFERRED;
+    slot->verbosity = verbosity;
+    slot->file = file;
+    slot->line = line;
+    slot->suppressed = suppressed;
+    slot->format = format;
+    slot->formatter = &formatDeferred<Deferred<Args>...>;
+    slot->time = std::chrono::steady_clock::now();
+    std::memcpy(slot->thread, threadName(), sizeof(slot->thread));
+    [[maybe_unused]] PayloadWriter writer{slot->payload, 0};
+    (writer.write(static_cast<Deferred<Args>>(args)), ...);
+    publish(slot);
+    return true;
+  }
+
+  /**
+   * @brief Blocks until every message queued so far has been written.
+   *
+   * Must not be called from a loguru callback.
+   */
+  void flush();
+
+  /**
+   * @brief Returns the number of messages dropped because the ring was full.
+   */
+  uint64_t droppedCount() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the number of messages suppressed by rate limiting.
+   *
+   * Suppressed `ASYNC_LOG_F` messages are counted when their call site next
+   * logs.
+   */
+  uint64_t suppressedCount() const noexcept {
+    return suppressed_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /** Bytes of message text or arguments a slot holds. */
+  static constexpr size_t kPayloadSize = 448;
+
+  /** Number of per-call-site rate limits for loguru messages. */
+  static constexpr size_t kCallSiteCount = 256;
+
+  /** The type an argument is queued as; string literals become pointers. */
+  template <typename T>
+  using Deferred = std::decay_t<const T&>;
+
+  /** Formats the arguments of a deferred message. */
+  using Formatter = void (*)(const char* format, const unsigned char* payload,
+                             char* output, size_t size);
+
+  /**
+   * @struct Slot
+   * @brief One message in the ring.
+   */
+  struct alignas(64) Slot {
+    /** What the payload holds. */
+    enum class Kind : uint8_t {
+      TEXT,      ///< A message formatted by loguru.
+      DEFERRED,  ///< Arguments for `formatter`.
+    };
+
+    std::atomic<size_t> sequence{0};  ///< Ring position the slot is
+                                      ///< ready for.
+    Kind kind = Kind::TEXT;           ///< What the payload holds.
+    loguru::Verbosity verbosity = loguru::Verbosity_INFO;  ///< Level.
+    unsigned line = 0;                ///< Source line.
+    uint32_t suppressed = 0;          ///< Messages suppressed before it.
+    uint16_t size = 0;                ///< Bytes of text in the payload.
+    const char* file = nullptr;       ///< Source file.
+    const char* format = nullptr;     ///< Format of a deferred message.
+    Formatter formatter = nullptr;    ///< Formatter of a deferred message.
+    std::chrono::steady_clock::time_point
+        time;                         ///< When a deferred message was logged.
+    char thread[LOGURU_THREADNAME_WIDTH + 1] = {};  ///< Its logging thread.
+    alignas(8) unsigned char payload[kPayloadSize];  ///< Text or arguments.
+  };
+
+  /**
+   * @struct PayloadWriter
+   * @brief Packs deferred arguments into a slot payload.
+   */
+  struct PayloadWriter {
+    unsigned char* payload;  ///< The payload to write to.
+    size_t offset;           ///< Bytes written so far.
+
+    template <typename T>
+    void write(const T& value) {
+      if constexpr (std::is_same_v<std::decay_t<T>, const char*> ||
+                    std::is_same_v<std::decay_t<T>, char*>) {
+        // Copy the characters; the pointer may not outlive the call
+        const char* text = value ? value : "(null)";
+        const size_t room = offset < kPayloadSize ? kPayloadSize - offset : 0;
+        const size_t length = room > 0 ? strnlen(text, room - 1) : 0;
+        if (room > 0) {
+          std::memcpy(payload + offset, text, length);
+          payload[offset + length] = '\0';
+        }
+        offset += length + 1;
+      } else {
+        offset = (offset + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (offset + sizeof(T) <= kPayloadSize) {
+          std::memcpy(payload + offset, &value, sizeof(T));
+        }
+        offset += sizeof(T);
+      }
+    }
+  };
+
+  /**
+   * @struct PayloadReader
+   * @brief Unpacks deferred arguments in the order they were written.
+   */
+  struct PayloadReader {
+    const unsigned char* payload;  ///< The payload to read from.
+    size_t offset;                 ///< Bytes read so far.
+
+    template <typename T>
+    T read() {
+      if constexpr (std::is_same_v<T, const char*> ||
+                    std::is_same_v<T, char*>) {
+        if (offset >= kPayloadSize) {
+          return const_cast<T>("");
+        }
+        auto text = reinterpret_cast<const char*>(payload + offset);
+        offset += strnlen(text, kPayloadSize - offset) + 1;
+        return const_cast<T>(text);
+      } else {
+        T value{};
+        offset = (offset + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (offset + sizeof(T) <= kPayloadSize) {
+          std::memcpy(&value, payload + offset, sizeof(T));
+        }
+        offset += sizeof(T);
+        return value;
+      }
+    }
+  };
+
+  /**
+   * @brief Formats a deferred message with the argument types it was
+   * queued with.
+   */
+  template <typename... Args>
+  static void formatDeferred(const char* format, const unsigned char* payload,
+                             char* output, size_t size) {
+    if constexpr (sizeof...(Args) == 0) {
+      std::snprintf(output, size, "%s", format);
+    } else {
+      // Braced initialization reads the arguments in order
+      PayloadReader reader{payload, 0};
+      std::tuple<Args...> values{reader.template read<Args>()...};
+      std::apply(
+          [&](const auto&... value) {
+            std::snprintf(output, size, format, value...);
+          },
+          values);
+    }
+  }
+
+  /**
+   * @brief Claims the next free slot, or returns nullptr if the ring is
+   * full.
+   */
+  Slot* claim() noexcept;
+
+  /**
+   * @brief Returns the loguru name of the calling thread.
+   *
+   * The name is looked up once per thread, so a thread renamed after its
+   * first deferred message keeps its old name in the preamble.
+   */
+  static const char* threadName() noexcept;
+
+  /**
+   * @brief Writes the loguru preamble of a deferred message, with the thread
+   * and time it was logged at.
+   *
+   * @return The length of the preamble.
+   */
+  static size_t formatPreamble(const Slot& slot, char* output, size_t size);
+
+  /**
+   * @brief Hands a filled slot to the flusher thread.
+   */
+  void publish(Slot* slot) noexcept {
+    slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+  }
+
+  /**
+   * @brief Receives messages from loguru.
+   */
+  static void onMessage(void* userData, const loguru::Message& message);
+
+  /**
+   * @brief Writes a message formatted by loguru to the output.
+   */
+  void write(const loguru::Message& message);
+
+  /**
+   * @brief Writes every message in the ring.
+   *
+   * @param direct Whether deferred messages are written to the output
+   * directly instead of being logged through loguru, as needed while loguru
+   * handles a fatal message. The call gives up after 100 milliseconds if
+   * another drain does not finish, for example because a signal interrupted
+   * it on the calling thread.
+   *
+   * @return The number of messages written.
+   */
+  size_t drain(bool direct = false);
+
+  /**
+   * @brief Runs the flusher thread.
+   */
+  void run();
+
+  static std::atomic<AsyncLogSink*> active_;  ///< The existing sink.
+
+  Options options_;                  ///< The configuration.
+  std::string callbackId_;           ///< Id of the loguru callback.
+  FILE* output_ = nullptr;           ///< Where messages are written.
+  bool ownsOutput_ = false;          ///< Whether `output_` is closed.
+  loguru::Verbosity stderrVerbosity_;  ///< Stderr level to restore.
+  std::unique_ptr<Slot[]> slots_;    ///< The ring.
+  size_t mask_ = 0;                  ///< Capacity minus one.
+  std::unique_ptr<AsyncLogRateLimit[]>
+      callSites_;                    ///< Rate limits of loguru call sites.
+
+  alignas(64) std::atomic<size_t> tail_{0};  ///< Next position to claim.
+  std::timed_mutex drainMutex_;      ///< Guards `head_` and
+                                     ///< `reportedDropped_`.
+  alignas(64) size_t head_ = 0;      ///< Next position to write.
+  std::atomic<size_t> written_{0};   ///< Positions written so far.
+  std::atomic<uint64_t> dropped_{0};     ///< Messages lost to a full ring.
+  std::atomic<uint64_t> suppressed_{0};  ///< Messages rate limited.
+  uint64_t reportedDropped_ = 0;     ///< Drops already reported.
+
+  std::mutex mutex_;                 ///< Guards the flusher's waiting.
+  std::condition_variable wakeUp_;   ///< Wakes up the flusher thread.
+  std::condition_variable drained_;  ///< Signals progress to `flush`.
+  bool running_ = false;             ///< Whether the flusher should run.
+  std::thread flusher_;              ///< The flusher thread.
+};
+
+/**
+ * @brief Logs a message with deferred formatting and per-call-site rate
+ * limiting.
+ *
+ * Used like `LOG_F`. With an `AsyncLogSink`, the message is queued and
+ * formatted on the flusher thread; without one, it is logged through loguru
+ * right away. Either way, each call site logs at most 10 messages per
+ * second and reports how many it suppressed. Fatal messages are logged
+ * through loguru right away and never suppressed, so that they abort on the
+ * calling thread.
+ */
+#define ASYNC_LOG_F(verbosity_name, ...)                                    \
+  do {                                                                      \
+    if (loguru::Verbosity_##verbosity_name <=                               \
+        loguru::current_verbosity_cutoff()) {                               \
+      if (loguru::Verbosity_##verbosity_name == loguru::Verbosity_FATAL) {  \
+        loguru::log(loguru::Verbosity_##verbosity_name, __FILE__, __LINE__, \
+                    __VA_ARGS__);                                           \
+        break;                                                              \
+      }                                                                     \
+      static AsyncLogRateLimit asyncLogRateLimit;                           \
+      if (asyncLogRateLimit.allow()) {                                      \
+        const uint32_t asyncLogDropped = asyncLogRateLimit.takeSuppressed(); \
+        if (AsyncLogSink* asyncLogSink = AsyncLogSink::active()) {          \
+          asyncLogSink->log(loguru::Verbosity_##verbosity_name, __FILE__,   \
+                            __LINE__, asyncLogDropped, __VA_ARGS__);        \
+        } else {                                                            \
+          loguru::log(loguru::Verbosity_##verbosity_name, __FILE__,         \
+                      __LINE__, __VA_ARGS__);                               \
+          if (asyncLogDropped > 0) {                                        \
+            loguru::log(loguru::Verbosity_##verbosity_name, __FILE__,       \
+                        __LINE__, "(%u similar messages suppressed)",       \
+                        asyncLogDropped);                                   \
+          }                                                                 \
+        }                                                                   \
+      }                                                                     \
+    }                                                                       \
+  } while (false)
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @class CancellationToken
+ * @brief Lets one thread ask a multi-step operation on another to stop.
+ *
+ * Operations that take a token check it before every step, such as every
+ * segment of a file transfer, and throw `OperationCanceled` once it is set.
+ * A step that is already on the wire is finished first, so an operation
+ * stops within one step of `cancel`. The token must outlive the operations
+ * it is passed to; it can be reused after `reset`.
+ *
+ * @code
+ * CancellationToken token;
+ * std::thread transfer([&] {
+ *   connection.readFile("log.txt", deadline, token);
+ * });
+ * token.cancel();
+ * @endcode
+ */
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+
+  CancellationToken(const CancellationToken&) = delete;
+  CancellationToken& operator=(const CancellationToken&) = delete;
+
+  /**
+   * @brief Asks the operations using this token to stop.
+   */
+  void cancel() noexcept { canceled_.store(true, std::memory_order_release); }
+
+  /**
+   * @brief Clears the request, so that the token can be used again.
+   */
+  void reset() noexcept { canceled_.store(false, std::memory_order_release); }
+
+  /**
+   * @brief Checks whether `cancel` was called.
+   */
+  bool canceled() const noexcept {
+    return canceled_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Returns a token that is never canceled, for operations that are
+   * not meant to be stopped.
+   */
+  static const CancellationToken& none() noexcept {
+    static const CancellationToken token;
+    return token;
+  }
+
+ private:
+  std::atomic<bool> canceled_{false};  ///< Whether `cancel` was called.
+};
+
+/**
+ * @class OperationCanceled
+ * @brief Thrown by operations that were stopped with a `CancellationToken`.
+ */
+class OperationCanceled : public std::runtime_error {
+ public:
+  explicit OperationCanceled(const std::string& what)
+      : std::runtime_error(what) {}
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <type_traits>
+
+#include "common.h"
+#include "ethernet_client.h"
+
+/**
+ * @struct ReconnectPolicy
+ * @brief Controls how often and how quickly a session tries to reconnect.
+ *
+ * The first attempt is made immediately. Each further attempt waits for the
+ * previous delay multiplied by `multiplier`, capped at `maxDelay`, and
+ * randomly stretched or shortened by up to `jitter` of its length so that
+ * several clients that lost the same link do not reconnect in lockstep.
+ */
+struct ReconnectPolicy {
+  std::chrono::milliseconds initialDelay{50};  ///< Delay before attempt 2.
+  std::chrono::milliseconds maxDelay{2000};    ///< Upper bound of the delay.
+  double multiplier = 2.0;  ///< Growth of the delay per attempt.
+  double jitter = 0.2;      ///< Relative random spread of each delay.
+  unsigned maxAttempts = 0;  ///< Attempts before giving up; 0 for no limit.
+  std::chrono::milliseconds probeTimeout{
+      250};  ///< Wait for the state read that checks the link after an error.
+};
+
+/**
+ * @class DeviceSession
+ * @brief Keeps an `EthernetDevice` connected and restores its session state
+ * after the connection was lost.
+ *
+ * The session remembers the EtherCAT state and the PDO mapping the
+ * application asked for. When an operation run through `call` fails, the
+ * session reconnects with jittered exponential backoff and restores that
+ * state. The parameter dictionary the device has already loaded is kept as
+ * is; only the parameters marked with `markChanged` are read again, instead
+ * of repeating the full `loadParameters`.
+ *
+ * If the device is still in the target state after reconnecting, nothing but
+ * the state itself is read, so recovering from a short link interruption
+ * costs roughly one TCP handshake.
+ */
+class DeviceSession {
+ public:
+  /** The EtherCAT PRE-OPERATIONAL state, in which PDOs can be remapped. */
+  static constexpr uint8_t kPreOperationalState = 0x02;
+
+  /**
+   * @brief Constructs a session for a device.
+   *
+   * @param device The device to keep connected. It must outlive the session.
+   * @param policy The reconnect policy.
+   */
+  explicit DeviceSession(EthernetDevice& device, ReconnectPolicy policy = {});
+
+  /**
+   * @brief Returns the device of the session.
+   */
+  EthernetDevice& device() noexcept { return device_; }
+
+  /**
+   * @brief Sets the EtherCAT state and remembers it as the target state.
+   *
+   * @param state The target state.
+   * @param expiryTime The duration to wait for the state change.
+   *
+   * @return `true` if the state was set; `false` otherwise.
+   */
+  bool setState(uint8_t state,
+                const std::chrono::steady_clock::duration expiryTime =
+                    std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Remembers the PDO mapping to restore after a reconnection.
+   *
+   * The mapping is not written now; it is expected to have been applied to
+   * the device already. Each entry is encoded as
+   * `index << 16 | subindex << 8 | bitLength`.
+   *
+   * @param mapping The PDO mapping, keyed by the PDO index.
+   */
+  void setPdoMapping(const common::UiPdoMapping& mapping);
+
+  /**
+   * @brief Marks a parameter to be read again after a reconnection.
+   *
+   * Use it for values that the device may change on its own while the
+   * connection is down.
+   *
+   * @param index The index of the parameter.
+   * @param subindex The subindex of the parameter.
+   */
+  void markChanged(uint16_t index, uint8_t subindex);
+
+  /**
+   * @brief Removes the mark set by `markChanged`.
+   */
+  void unmarkChanged(uint16_t index, uint8_t subindex);
+
+  /**
+   * @brief Reconnects the device and restores the session state.
+   *
+   * Retries according to the policy until the state is restored or the
+   * maximum number of attempts is reached.
+   *
+   * @return `true` if the session was restored; `false` otherwise.
+   */
+  bool reconnect();
+
+  /**
+   * @brief Runs an operation on the device, recovering from a lost connection
+   * once.
+   *
+   * If the device is not connected, or the operation throws a
+   * `std::runtime_error` and the connection was lost, the session is
+   * reconnected and the operation is run again. The device keeps its socket
+   * open after a timeout, a read error or the peer closing the connection,
+   * and may still receive the response to the failed request, so a failed
+   * exchange always counts as a lost connection. After any other error the
+   * link is checked by reading the state within
+   * `ReconnectPolicy::probeTimeout`. Errors reported by a device that still
+   * answers, such as a refused write, are rethrown without a retry.
+   *
+   * @param operation Callable taking `EthernetDevice&`.
+   *
+   * @return The result of the operation.
+   *
+   * @throws std::runtime_error If the operation fails while the device still
+   * answers, if the session cannot be restored, or if the operation fails
+   * again after the reconnection.
+   */
+  template <typename Operation>
+  auto call(Operation&& operation)
+      -> std::invoke_result_t<Operation&, EthernetDevice&> {
+    if (!device_.isConnected() && !reconnect()) {
+      throw std::runtime_error("Failed to restore the device session");
+    }
+
+    try {
+      return operation(device_);
+    } catch (const std::runtime_error& e) {
+      if (!connectionLost(e) || !reconnect()) {
+        throw;
+      }
+    }
+
+    return operation(device_);
+  }
+
+  /**
+   * @brief Returns the number of successful reconnections.
+   */
+  unsigned reconnectCount() const noexcept { return reconnectCount_; }
+
+ private:
+  /**
+   * @brief Checks after a failed operation whether the connection was lost,
+   * and disconnects the device if so.
+   *
+   * @param error The error the operation threw.
+   */
+  bool connectionLost(const std::runtime_error& error);
+
+  /**
+   * @brief Connects once and restores the session state.
+   *
+   * @return `true` if the session was restored; `false` otherwise.
+   */
+  bool tryRestore();
+
+  /**
+   * @brief Returns the delay before the given attempt.
+   */
+  std::chrono::milliseconds backoff(unsigned attempt);
+
+  EthernetDevice& device_;  ///< The device kept connected.
+  ReconnectPolicy policy_;  ///< The reconnect policy.
+  std::minstd_rand random_;  ///< Source of the backoff jitter.
+
+  std::optional<uint8_t> targetState_;  ///< State to restore, if any.
+  std::optional<common::UiPdoMapping>
+      pdoMapping_;  ///< PDO mapping to restore, if any.
+  std::set<common::ParameterKey> changed_;  ///< Parameters to read again.
+  unsigned reconnectCount_ = 0;  ///< Number of successful reconnections.
+};
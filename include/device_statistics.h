@@ -0,0 +1,308 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ethernet_client.h"
+#include "ethernet_frame.h"
+
+/**
+ * @class DeviceStatistics
+ * @brief Traffic and error counters of the connection to one device.
+ *
+ * The counters are relaxed atomics, each group on a cache line of its own,
+ * so the thread owning the socket updates them with a single uncontended
+ * increment and monitoring threads can take a `snapshot` at any time without
+ * slowing it down. Frames and bytes are counted per `EthernetMessageType`;
+ * messages of types not listed in `kMessageTypes` share one extra slot.
+ */
+class DeviceStatistics {
+ public:
+  /** The message types counted individually, in slot order. */
+  static constexpr std::array<EthernetMessageType, 12> kMessageTypes{
+      EthernetMessageType::SDO_READ,
+      EthernetMessageType::SDO_WRITE,
+      EthernetMessageType::PDO_RXTX_FRAME,
+      EthernetMessageType::PDO_CONTROL,
+      EthernetMessageType::PDO_MAP,
+      EthernetMessageType::FIRMWARE_UPDATE,
+      EthernetMessageType::FILE_READ,
+      EthernetMessageType::FILE_WRITE,
+      EthernetMessageType::STATE_CONTROL,
+      EthernetMessageType::STATE_READ,
+      EthernetMessageType::PARAM_FULL_LIST,
+      EthernetMessageType::SERVER_INFO};
+
+  /** The number of type slots, including the one for unknown types. */
+  static constexpr size_t kTypeSlots = kMessageTypes.size() + 1;
+
+  /**
+   * @struct MessageCounts
+   * @brief Frames and bytes of one message type, headers included.
+   */
+  struct MessageCounts {
+    uint64_t framesSent = 0;      ///< Requests written.
+    uint64_t bytesSent = 0;       ///< Bytes of the requests written.
+    uint64_t framesReceived = 0;  ///< Messages received.
+    uint64_t bytesReceived = 0;   ///< Bytes of the messages received.
+  };
+
+  /**
+   * @struct Snapshot
+   * @brief Plain copy of all counters.
+   */
+  struct Snapshot {
+    std::array<MessageCounts, kTypeSlots> messages{};  ///< Per type slot.
+    uint64_t timeouts = 0;     ///< Exchanges that timed out.
+    uint64_t reconnects = 0;   ///< Connections made after the first one.
+    uint64_t sqiBusy = 0;      ///< Messages with SQI status BSY.
+    uint64_t sqiErrors = 0;    ///< Messages with SQI status ERR.
+    uint64_t pdoOverruns = 0;  ///< Pushed TxPDO frames the device skipped.
+    std::chrono::nanoseconds roundTripTime{};  ///< Of the last exchange.
+  };
+
+  /**
+   * @brief Returns the type slot of a message type.
+   */
+  static size_t slotOf(EthernetMessageType type) noexcept {
+    return kSlotOfType[static_cast<uint8_t>(type)];
+  }
+
+  /**
+   * @brief Returns the name of a type slot, as used in metric labels.
+   */
+  static const char* slotName(size_t slot) noexcept;
+
+  /**
+   * @brief Counts a written request.
+   *
+   * @param type The type of the request.
+   * @param bytes The size of the request, header included.
+   */
+  void recordSent(EthernetMessageType type, size_t bytes) noexcept {
+    auto& counters = messages_[slotOf(type)];
+    counters.framesSent.fetch_add(1, std::memory_order_relaxed);
+    counters.bytesSent.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Counts a received message and its SQI reply status.
+   */
+  void recordReceived(const EthernetMessageView& message) noexcept {
+    auto& counters = messages_[slotOf(message.type)];
+    counters.framesReceived.fetch_add(1, std::memory_order_relaxed);
+    counters.bytesReceived.fetch_add(
+        EthernetMessage::kHeaderSize + message.data.size(),
+        std::memory_order_relaxed);
+    if (message.sqiStatus == EthernetSqiReplyStatus::BSY) {
+      increment(sqiBusy_);
+    } else if (message.sqiStatus == EthernetSqiReplyStatus::ERR) {
+      increment(sqiErrors_);
+    }
+  }
+
+  /** Counts an exchange that timed out. */
+  void recordTimeout() noexcept { increment(timeouts_); }
+
+  /** Counts a connection made after the first one. */
+  void recordReconnect() noexcept { increment(reconnects_); }
+
+  /** Counts pushed TxPDO frames the device skipped. */
+  void recordPdoOverruns(uint64_t count) noexcept {
+    pdoOverruns_.value.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  /** Records the round-trip time of the last exchange. */
+  void recordRoundTrip(std::chrono::nanoseconds time) noexcept {
+    roundTripTime_.value.store(static_cast<uint64_t>(time.count()),
+                               std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Copies all counters.
+   *
+   * Each counter is read atomically, but the copy as a whole is not taken
+   * at a single instant.
+   */
+  Snapshot snapshot() const noexcept;
+
+ private:
+  /** Type slot of every possible type byte. */
+  static constexpr std::array<uint8_t, 256> kSlotOfType = [] {
+    std::array<uint8_t, 256> slots{};
+    slots.fill(static_cast<uint8_t>(kMessageTypes.size()));
+    for (size_t i = 0; i < kMessageTypes.size(); ++i) {
+      slots[static_cast<uint8_t>(kMessageTypes[i])] =
+          static_cast<uint8_t>(i);
+    }
+    return slots;
+  }();
+
+  /** The counters of one message type, on a cache line of their own. */
+  struct alignas(64) MessageCounters {
+    std::atomic<uint64_t> framesSent{0};      ///< Requests written.
+    std::atomic<uint64_t> bytesSent{0};       ///< Bytes written.
+    std::atomic<uint64_t> framesReceived{0};  ///< Messages received.
+    std::atomic<uint64_t> bytesReceived{0};   ///< Bytes received.
+  };
+
+  /** A counter on a cache line of its own. */
+  struct alignas(64) Counter {
+    std::atomic<uint64_t> value{0};  ///< The count.
+  };
+
+  static void increment(Counter& counter) noexcept {
+    counter.value.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::array<MessageCounters, kTypeSlots> messages_;  ///< Per type slot.
+  Counter timeouts_;       ///< Exchanges that timed out.
+  Counter reconnects_;     ///< Connections made after the first one.
+  Counter sqiBusy_;        ///< Messages with SQI status BSY.
+  Counter sqiErrors_;      ///< Messages with SQI status ERR.
+  Counter pdoOverruns_;    ///< Pushed TxPDO frames the device skipped.
+  Counter roundTripTime_;  ///< Round-trip time in nanoseconds.
+};
+
+/**
+ * @struct DeviceMetrics
+ * @brief The counters of one device, labeled for export.
+ */
+struct DeviceMetrics {
+  std::string device;                  ///< Value of the `device` label.
+  DeviceStatistics::Snapshot snapshot;  ///< The counters.
+};
+
+/**
+ * @brief Renders device counters in the Prometheus text exposition format.
+ *
+ * Every metric is prefixed with `somanet_` and carries a `device` label;
+ * frame and byte counters also carry a `type` label, the SQI counter a
+ * `status` label.
+ *
+ * @param devices The devices to render.
+ *
+ * @return The metrics, ready to be served or written to a file.
+ */
+std::string formatPrometheusMetrics(std::span<const DeviceMetrics> devices);
+
+/**
+ * @class PrometheusExporter
+ * @brief Publishes the statistics of several devices to Prometheus.
+ *
+ * The metrics can be written to a file, for the textfile collector of the
+ * node exporter, or served over HTTP on the loopback interface, where every
+ * `GET /metrics` renders a fresh snapshot. The server runs on a thread of
+ * its own; a connection that does not complete its request within 5
+ * seconds is closed.
+ *
+ * @code
+ * PrometheusExporter exporter;
+ * exporter.add("axis-1", connection.statistics());
+ * exporter.serve(9464);
+ * @endcode
+ */
+class PrometheusExporter {
+ public:
+  PrometheusExporter() = default;
+
+  /**
+   * @brief Stops serving.
+   */
+  ~PrometheusExporter();
+
+  PrometheusExporter(const PrometheusExporter&) = delete;
+  PrometheusExporter& operator=(const PrometheusExporter&) = delete;
+
+  /**
+   * @brief Adds a device.
+   *
+   * @param device The value of the `device` label.
+   * @param statistics The counters. They must outlive the exporter.
+   */
+  void add(const std::string& device, const DeviceStatistics& statistics);
+
+  /**
+   * @brief Renders the current counters of all devices.
+   */
+  std::string render() const;
+
+  /**
+   * @brief Writes the current counters of all devices to a file.
+   *
+   * The metrics are written to a temporary file next to it first, which
+   * then replaces the file, so a scraper never reads a partial file.
+   *
+   * @param path The path of the file.
+   *
+   * @throws std::runtime_error If the file cannot be written.
+   */
+  void writeFile(const std::string& path) const;
+
+  /**
+   * @brief Starts serving the metrics over HTTP on 127.0.0.1.
+   *
+   * @param port The port to listen on, or 0 to pick a free one.
+   *
+   * @throws std::runtime_error If the port cannot be bound.
+   */
+  void serve(unsigned short port);
+
+  /**
+   * @brief Stops serving and waits for the server thread to finish.
+   *
+   * Open connections are closed without an answer.
+   */
+  void stop();
+
+  /**
+   * @brief Returns the port the server listens on, or 0 if it is stopped.
+   */
+  unsigned short port() const noexcept { return port_; }
+
+ private:
+  /**
+   * @brief A device and the counters to export for it.
+   */
+  struct Source {
+    std::string device;                  ///< Value of the `device` label.
+    const DeviceStatistics* statistics;  ///< The counters.
+  };
+
+  /**
+   * @brief Accepts the next connection.
+   */
+  void accept();
+
+  /**
+   * @brief Answers the request on an accepted connection.
+   */
+  void respond(std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+
+  /**
+   * @brief Closes a connection and forgets it.
+   */
+  void close(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket);
+
+  mutable std::mutex mutex_;     ///< Guards `sources_`.
+  std::vector<Source> sources_;  ///< The exported devices.
+
+  boost::asio::io_context context_;  ///< Serves the HTTP connections.
+  boost::asio::ip::tcp::acceptor acceptor_{
+      context_};              ///< Listens on the loopback interface.
+  std::set<std::shared_ptr<boost::asio::ip::tcp::socket>>
+      connections_;           ///< Open connections; server thread only.
+  unsigned short port_ = 0;   ///< The bound port.
+  std::thread thread_;        ///< The server thread.
+};
@@ -0,0 +1,1052 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cancellation_token.h"
+#include "common.h"
+#include "device_statistics.h"
+#include "ethernet_client.h"
+#include "ethernet_frame.h"
+#include "exchange_tracer.h"
+
+/**
+ * @class HandlerMemory
+ * @brief Fixed-size memory blocks recycled for asynchronous operation handlers.
+ *
+ * Boost.Asio allocates the state of every asynchronous operation through the
+ * allocator associated with its completion handler. Handing out these blocks
+ * instead of the default allocator means that the steady-state socket reads
+ * and writes of a connection never touch the heap. Requests that do not fit
+ * into a free block fall back to the global `operator new`.
+ */
+class HandlerMemory {
+ public:
+  HandlerMemory() = default;
+  HandlerMemory(const HandlerMemory&) = delete;
+  HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+  /**
+   * @brief Allocates memory for a handler.
+   *
+   * @param size The number of bytes to allocate.
+   * @return A pointer to the allocated memory.
+   */
+  void* allocate(std::size_t size);
+
+  /**
+   * @brief Releases memory previously obtained from `allocate`.
+   *
+   * @param pointer The pointer returned by `allocate`.
+   */
+  void deallocate(void* pointer) noexcept;
+
+ private:
+  static constexpr std::size_t kBlockCount = 2;   ///< Number of blocks.
+  static constexpr std::size_t kBlockSize = 512;  ///< Size of each block.
+
+  struct Block {
+    alignas(std::max_align_t) unsigned char storage[kBlockSize];
+    bool inUse = false;
+  };
+
+  std::array<Block, kBlockCount> blocks_;  ///< The recycled blocks.
+};
+
+/**
+ * @brief Standard allocator that draws its memory from a `HandlerMemory`.
+ *
+ * @tparam T The type of the objects to allocate.
+ */
+template <typename T>
+class HandlerAllocator {
+ public:
+  using value_type = T;
+
+  explicit HandlerAllocator(HandlerMemory& memory) noexcept
+      : memory_(&memory) {}
+
+  template <typename U>
+  HandlerAllocator(const HandlerAllocator<U>& other) noexcept
+      : memory_(other.memory_) {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T* pointer, std::size_t) noexcept {
+    memory_->deallocate(pointer);
+  }
+
+  bool operator==(const HandlerAllocator& other) const noexcept {
+    return memory_ == other.memory_;
+  }
+
+ private:
+  template <typename>
+  friend class HandlerAllocator;
+
+  HandlerMemory* memory_;  ///< The memory blocks to allocate from.
+};
+
+/**
+ * @brief Completion handler wrapper that associates a `HandlerAllocator`.
+ *
+ * @tparam Handler The type of the wrapped completion handler.
+ */
+template <typename Handler>
+class AllocatingHandler {
+ public:
+  using allocator_type = HandlerAllocator<Handler>;
+
+  AllocatingHandler(HandlerMemory& memory, Handler handler)
+      : memory_(memory), handler_(std::move(handler)) {}
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(memory_);
+  }
+
+  template <typename... Args>
+  void operator()(Args&&... args) {
+    handler_(std::forward<Args>(args)...);
+  }
+
+ private:
+  HandlerMemory& memory_;  ///< The memory blocks to allocate from.
+  Handler handler_;        ///< The wrapped completion handler.
+};
+
+/**
+ * @brief One SDO access of a batch.
+ *
+ * For reads, `data` is the buffer that receives the value and `size` is set
+ * to the number of bytes read. For writes, `data` holds the value to write.
+ */
+struct SdoTransfer {
+  uint16_t index;           ///< The index of the SDO.
+  uint8_t subindex;         ///< The subindex of the SDO.
+  std::span<uint8_t> data;  ///< The value to write or the buffer to read into.
+  size_t size = 0;          ///< The number of bytes read.
+  bool success = false;     ///< Whether the device acknowledged the access.
+};
+
+/**
+ * @class EthernetConnection
+ * @brief Allocation-free TCP connection to a SOMANET device.
+ *
+ * This class speaks the same protocol as `EthernetDevice`, but keeps its
+ * request and response frames in per-connection preallocated buffers and
+ * recycles the memory of its asynchronous handlers. SDO values and process
+ * data are read into, and written from, caller-provided buffers. Once the
+ * connection is established, the SDO, state and PDO exchanges therefore run
+ * without any heap allocation.
+ *
+ * The connection can be shared by several threads. Their requests are put
+ * into a fixed set of slots; whichever thread currently owns the socket
+ * writes all queued requests with a single gathering write, sending headers
+ * and payloads from where they are without concatenating them, and hands the
+ * responses to their waiting threads. Under load, many requests therefore
+ * share one system call and one TCP segment.
+ *
+ * Responses are matched to requests by their sequence ID. When an exchange
+ * times out, the connection stays open: the late response is recognized as
+ * stale when it arrives and is discarded, or handed to the unmatched message
+ * handler, instead of being taken for the reply to the next request. A
+ * timeout therefore costs one lost request rather than a reconnection.
+ *
+ * Process data requests travel in a priority lane. They are written ahead
+ * of queued SDO, state and file requests, two request slots are kept free
+ * for them, and a thread waiting for a bulk response is woken to write them
+ * at once. While process data is exchanged, only a small window of bulk
+ * requests is kept in flight, so a PDO frame waits behind at most that many
+ * segments at the device, however long the transfer they belong to.
+ *
+ * In streaming mode, the device pushes TxPDO frames at a fixed rate without
+ * being asked. They are handed to a callback straight out of the receive
+ * buffer, either by `pumpProcessDataStream` or by any exchange that happens to
+ * be reading when they arrive.
+ *
+ * Failures that `EthernetDevice` reports by throwing (socket errors and
+ * timeouts) are reported the same way here; those paths may allocate.
+ */
+class EthernetConnection {
+ public:
+  /**
+   * @brief Receives the TxPDO frames pushed in streaming mode.
+   *
+   * The view refers to the receive buffer and is only valid during the call.
+   */
+  using ProcessDataHandler = std::function<void(const EthernetMessageView&)>;
+
+  /**
+   * @brief Counters of the process data stream.
+   */
+  struct ProcessDataStreamStats {
+    uint64_t frames = 0;       ///< Frames handed to the handler.
+    uint64_t lostFrames = 0;   ///< Frames missing from the sequence.
+    uint64_t lateFrames = 0;   ///< Frames that arrived over half a period late.
+    uint64_t staleFrames = 0;  ///< Repeated or reordered frames, dropped.
+  };
+
+  /**
+   * @brief Configures the priority lane of the process data requests.
+   */
+  struct PriorityLaneOptions {
+    size_t bulkWindow = 1;  ///< Bulk requests in flight while process data
+                            ///< is exchanged.
+    std::chrono::steady_clock::duration activityHold =
+        std::chrono::milliseconds(100);  ///< How long after the last PDO
+                                         ///< request the window applies.
+  };
+
+  /**
+   * @brief Constructs an EthernetConnection with the specified IP address and
+   * port.
+   *
+   * @param ip The IP address of the device to connect to.
+   * @param port The port number to use for the connection.
+   */
+  EthernetConnection(const std::string& ip, unsigned short port);
+
+  /**
+   * @brief Closes the socket if it is still open.
+   */
+  ~EthernetConnection();
+
+  /**
+   * @brief Increments the sequence ID atomically, wrapping around at 0xFFFF.
+   *
+   * @return The updated sequence ID.
+   */
+  uint16_t incrementSeqId();
+
+  /**
+   * @brief Establishes a connection to the device.
+   *
+   * @return `true` if the connection was established; `false` otherwise.
+   */
+  bool connect();
+
+  /**
+   * @brief Checks if the socket is currently open.
+   *
+   * @return true if the socket is open, false otherwise.
+   */
+  bool isConnected();
+
+  /**
+   * @brief Closes the socket connection.
+   *
+   * @return `true` if the socket was closed successfully, `false` otherwise.
+   */
+  bool disconnect();
+
+  /**
+   * @brief Exchanges a message with the device without allocating.
+   *
+   * Queues the request header in a preallocated slot and writes it together
+   * with the payload and any other queued requests. The response is framed
+   * out of the preallocated receive buffer, which is filled with as many
+   * bytes as the socket has available, and its payload is copied into
+   * `response`.
+   *
+   * @param type The type of the request message.
+   * @param payload The request payload.
+   * @param response The buffer that receives the response payload.
+   * @param expiryTime The duration to wait for the exchange, including the
+   * time spent waiting for other requests, before timing out.
+   * @param status The status of the request message.
+   *
+   * @return A view of the response message whose `data` refers to the
+   * beginning of `response`.
+   *
+   * @throws std::runtime_error If the write or read operation fails, if the
+   * operation times out, or if the response payload does not fit into
+   * `response`.
+   */
+  EthernetMessageView exchangeWithTimeout(
+      EthernetMessageType type, std::span<const uint8_t> payload,
+      std::span<uint8_t> response,
+      const std::chrono::steady_clock::duration expiryTime,
+      EthernetMessageStatus status = EthernetMessageStatus::OK);
+
+  /**
+   * @brief Reads the state of the device.
+   *
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 3000 milliseconds.
+   *
+   * @return The EtherCAT state of the device, or 0 if the response is empty.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  uint8_t getState(const std::chrono::steady_clock::duration expiryTime =
+                       std::chrono::milliseconds(3000));
+
+  /**
+   * @brief Requests an EtherCAT state transition.
+   *
+   * @param state The new state to set on the device.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 3000 milliseconds.
+   *
+   * @return `true` if the response status is `OK`, `false` otherwise.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  bool setState(uint8_t state,
+                const std::chrono::steady_clock::duration expiryTime =
+                    std::chrono::milliseconds(3000));
+
+  /**
+   * @brief Reads an SDO into a caller-provided buffer.
+   *
+   * @param index The index of the SDO to read.
+   * @param subindex The subindex of the SDO to read.
+   * @param value The buffer that receives the SDO value.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 1000 milliseconds.
+   *
+   * @return The number of bytes written to `value`. 0 is returned if the
+   * device reports a failure.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  size_t readSdo(uint16_t index, uint8_t subindex, std::span<uint8_t> value,
+                 const std::chrono::steady_clock::duration expiryTime =
+                     std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Writes an SDO from a caller-provided buffer.
+   *
+   * @param index The index of the SDO to write.
+   * @param subindex The subindex of the SDO to write.
+   * @param data The value to write.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 1000 milliseconds.
+   *
+   * @return `true` if the write operation was successful, `false` otherwise.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  bool writeSdo(uint16_t index, uint8_t subindex,
+                std::span<const uint8_t> data,
+                const std::chrono::steady_clock::duration expiryTime =
+                    std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Reads a batch of SDOs with the requests pipelined.
+   *
+   * Up to 16 requests are queued at once and written with a single gathering
+   * write before any response is awaited.
+   *
+   * @param transfers The SDOs to read. `size` and `success` are updated.
+   * @param expiryTime The duration to wait for the whole batch before timing
+   * out. Defaults to 1000 milliseconds.
+   *
+   * @throws std::runtime_error If an exchange fails or times out.
+   */
+  void readSdos(std::span<SdoTransfer> transfers,
+                const std::chrono::steady_clock::duration expiryTime =
+                    std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Writes a batch of SDOs with the requests pipelined.
+   *
+   * @param transfers The SDOs to write. `success` is updated.
+   * @param expiryTime The duration to wait for the whole batch before timing
+   * out. Defaults to 1000 milliseconds.
+   *
+   * @throws std::runtime_error If an exchange fails or times out.
+   */
+  void writeSdos(std::span<SdoTransfer> transfers,
+                 const std::chrono::steady_clock::duration expiryTime =
+                     std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Uploads the value of a parameter into its existing data buffer.
+   *
+   * The value is read via SDO and assigned to `parameter.data`, which only
+   * allocates if the new value is larger than the capacity of the buffer.
+   *
+   * @param parameter The parameter to update.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 3000 milliseconds.
+   *
+   * @return Reference to the updated parameter.
+   *
+   * @throws std::runtime_error If the upload fails or returns an empty
+   * payload.
+   */
+  common::Parameter& upload(
+      common::Parameter& parameter,
+      const std::chrono::steady_clock::duration expiryTime =
+          std::chrono::milliseconds(3000));
+
+  /**
+   * @brief Uploads an SDO and returns it as an arithmetic value.
+   *
+   * @tparam T The arithmetic type of the value.
+   * @param index The index of the SDO.
+   * @param subindex The subindex of the SDO.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 5000 milliseconds.
+   *
+   * @return The uploaded value.
+   *
+   * @throws std::runtime_error If the upload fails or the size of the value
+   * does not match `sizeof(T)`.
+   */
+  template <typename T>
+  T upload(uint16_t index, uint8_t subindex,
+           const std::chrono::steady_clock::duration expiryTime =
+               std::chrono::milliseconds(5000)) {
+    static_assert(std::is_arithmetic_v<T>, "T must be an arithmetic type");
+
+    std::array<uint8_t, sizeof(T)> bytes;
+    if (readSdo(index, subindex, bytes, expiryTime) != sizeof(T)) {
+      throw std::runtime_error("Failed to upload SDO " +
+                               common::makeParameterId(index, subindex));
+    }
+
+    T value;
+    std::memcpy(&value, bytes.data(), sizeof(T));
+    return value;
+  }
+
+  /**
+   * @brief Downloads the data of a parameter to the device.
+   *
+   * @param parameter The parameter whose data to download.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 5000 milliseconds.
+   *
+   * @throws std::runtime_error If the parameter data is empty or the SDO
+   * download fails.
+   */
+  void download(const common::Parameter& parameter,
+                const std::chrono::steady_clock::duration expiryTime =
+                    std::chrono::milliseconds(5000));
+
+  /**
+   * @brief Downloads an arithmetic value to the device.
+   *
+   * Unlike `EthernetDevice::download`, the value is not wrapped in a
+   * `common::ParameterValue`; its bytes are sent as they are.
+   *
+   * @tparam T The arithmetic type of the value.
+   * @param index The index of the SDO.
+   * @param subindex The subindex of the SDO.
+   * @param value The value to download.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 5000 milliseconds.
+   *
+   * @throws std::runtime_error If the SDO download fails.
+   */
+  template <typename T>
+  void download(uint16_t index, uint8_t subindex, const T& value,
+                const std::chrono::steady_clock::duration expiryTime =
+                    std::chrono::milliseconds(5000)) {
+    static_assert(std::is_arithmetic_v<T>, "T must be an arithmetic type");
+
+    std::array<uint8_t, sizeof(T)> bytes;
+    std::memcpy(bytes.data(), &value, sizeof(T));
+    if (!writeSdo(index, subindex, bytes, expiryTime)) {
+      throw std::runtime_error("Failed to download SDO " +
+                               common::makeParameterId(index, subindex));
+    }
+  }
+
+  /**
+   * @brief Reads a file from the device.
+   *
+   * Like `EthernetDevice::readFile`, the file name is sent in a `FIRST`
+   * segment and further segments are requested until the device answers
+   * with a `LAST` one. The segments are received straight into the returned
+   * buffer.
+   *
+   * @param filename The name of the file to read.
+   * @param deadline The time by which the whole transfer must be complete.
+   * @param token Stops the transfer before the next segment when canceled.
+   *
+   * @return The contents of the file.
+   *
+   * @throws OperationCanceled If the transfer was canceled.
+   * @throws std::runtime_error If an exchange fails, the deadline expires, or
+   * the device reports an error.
+   */
+  std::vector<uint8_t> readFile(
+      const std::string& filename,
+      std::chrono::steady_clock::time_point deadline,
+      const CancellationToken& token = CancellationToken::none());
+
+  /**
+   * @brief Reads a file from the device.
+   *
+   * @param filename The name of the file to read.
+   * @param expiryTime The duration to wait for each segment, as in
+   * `EthernetDevice::readFile`. Defaults to 5000 milliseconds.
+   *
+   * @return The contents of the file.
+   *
+   * @throws std::runtime_error If an exchange fails or times out, or the
+   * device reports an error.
+   */
+  std::vector<uint8_t> readFile(
+      const std::string& filename,
+      const std::chrono::steady_clock::duration expiryTime =
+          std::chrono::milliseconds(5000));
+
+  /**
+   * @brief Writes a file to the device.
+   *
+   * Like `EthernetDevice::writeFile`, the file name is sent in a `FIRST`
+   * segment, followed by the data in segments of 512 bytes, the last of
+   * which is marked `LAST`.
+   *
+   * @param filename The name of the file to write.
+   * @param data The contents of the file.
+   * @param deadline The time by which the whole transfer must be complete.
+   * @param token Stops the transfer before the next segment when canceled.
+   *
+   * @return `true` if the device acknowledged all segments; `false` if it
+   * reported an error, in which case the transfer stops.
+   *
+   * @throws OperationCanceled If the transfer was canceled.
+   * @throws std::runtime_error If an exchange fails or the deadline expires.
+   */
+  bool writeFile(const std::string& filename, std::span<const uint8_t> data,
+                 std::chrono::steady_clock::time_point deadline,
+                 const CancellationToken& token = CancellationToken::none());
+
+  /**
+   * @brief Writes a file to the device.
+   *
+   * @param filename The name of the file to write.
+   * @param data The contents of the file.
+   * @param expiryTime The duration to wait for each segment, as in
+   * `EthernetDevice::writeFile`. Defaults to 5000 milliseconds.
+   *
+   * @return `true` if the device acknowledged all segments; `false` if it
+   * reported an error.
+   *
+   * @throws std::runtime_error If an exchange fails or times out.
+   */
+  bool writeFile(const std::string& filename, std::span<const uint8_t> data,
+                 const std::chrono::steady_clock::duration expiryTime =
+                     std::chrono::milliseconds(5000));
+
+  /**
+   * @brief Reads the list of parameters from the device.
+   *
+   * The list is transferred in segments like `EthernetDevice::getParameters`
+   * does. The values are read with pipelined SDO batches rather than one
+   * SDO at a time; values that fail to read are left empty.
+   *
+   * @param readValues If true, the values of the parameters are read;
+   * otherwise, their data is zero-filled to the size of the parameter.
+   * @param deadline The time by which the list, and the values if requested,
+   * must be complete.
+   * @param token Stops the transfer before the next segment or SDO batch
+   * when canceled.
+   *
+   * @return The parameters, in the order the device lists them.
+   *
+   * @throws OperationCanceled If the transfer was canceled.
+   * @throws std::runtime_error If an exchange fails, the deadline expires, or
+   * the device reports an error.
+   */
+  std::vector<common::Parameter> getParameters(
+      bool readValues, std::chrono::steady_clock::time_point deadline,
+      const CancellationToken& token = CancellationToken::none());
+
+  /**
+   * @brief Reads the list of parameters from the device.
+   *
+   * @param readValues If true, the values of the parameters are read.
+   * @param expiryTime The duration to wait for each segment and each SDO
+   * batch. Defaults to 1000 milliseconds.
+   *
+   * @return The parameters, in the order the device lists them.
+   *
+   * @throws std::runtime_error If an exchange fails or times out, or the
+   * device reports an error.
+   */
+  std::vector<common::Parameter> getParameters(
+      bool readValues = false,
+      const std::chrono::steady_clock::duration expiryTime =
+          std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Exchanges process data with the device without allocating.
+   *
+   * @param data The RxPDO image to transmit to the device.
+   * @param response The buffer that receives the TxPDO image.
+   * @param expiryTime The duration to wait for the socket operation
+   * (read/write) before timing out. Defaults to 1000 milliseconds.
+   *
+   * @return The number of bytes written to `response`. 0 is returned if the
+   * exchange fails with a non-OK status.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  size_t sendAndReceiveProcessData(
+      std::span<const uint8_t> data, std::span<uint8_t> response,
+      const std::chrono::steady_clock::duration expiryTime =
+          std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Sets the handler for received messages that answer no pending
+   * request.
+   *
+   * Such messages are mostly late responses to requests that timed out. The
+   * handler is called on the thread that currently reads from the socket,
+   * while the connection's mutex is held, so it must not call back into the
+   * connection. Without a handler, the messages are discarded.
+   *
+   * @param handler The handler, or an empty function to discard the
+   * messages.
+   */
+  void setUnmatchedMessageHandler(
+      std::function<void(const EthernetMessageView&)> handler);
+
+  /**
+   * @brief Returns the number of received messages that answered no pending
+   * request.
+   */
+  uint64_t unmatchedMessageCount() const noexcept {
+    return unmatchedMessageCount_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the traffic and error counters of the connection.
+   *
+   * The counters can be read from any thread, for example by a
+   * `PrometheusExporter`. Lost frames of the process data stream are counted
+   * as PDO overruns.
+   */
+  const DeviceStatistics& statistics() const noexcept { return statistics_; }
+
+  /**
+   * @brief Asks the device to push TxPDO frames at a fixed rate.
+   *
+   * Sends a `PDO_CONTROL` request whose payload is the enable flag 1 followed
+   * by the period in microseconds (little-endian, 32 bits). The pushed frames
+   * are `PDO_RXTX_FRAME` messages whose sequence IDs count up by one per
+   * frame; a skipped ID is counted as a lost frame.
+   *
+   * @note This wire format is provisional: it has not been verified against
+   * the device firmware, which may expect a different `PDO_CONTROL` payload
+   * or not support pushed frames at all.
+   *
+   * The handler runs on the thread that currently reads from the socket,
+   * while the connection's mutex is held, so it must not call back into the
+   * connection. `sendAndReceiveProcessData` should not be used while
+   * streaming. A failure of the connection ends the stream; it has to be
+   * started again after reconnecting.
+   *
+   * @param period The interval between two pushed frames.
+   * @param handler The handler for the pushed frames.
+   * @param expiryTime The duration to wait for the device to acknowledge.
+   * Defaults to 1000 milliseconds.
+   *
+   * @return `true` if the device started streaming; `false` otherwise.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  bool startProcessDataStream(
+      std::chrono::microseconds period, ProcessDataHandler handler,
+      const std::chrono::steady_clock::duration expiryTime =
+          std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Asks the device to stop pushing TxPDO frames.
+   *
+   * Sends a `PDO_CONTROL` request with the enable flag 0, in the provisional
+   * format described at `startProcessDataStream`.
+   *
+   * @param expiryTime The duration to wait for the device to acknowledge.
+   * Defaults to 1000 milliseconds.
+   *
+   * @return `true` if the device stopped streaming; `false` otherwise.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  bool stopProcessDataStream(const std::chrono::steady_clock::duration
+                                 expiryTime = std::chrono::milliseconds(1000));
+
+  /**
+   * @brief Reads from the socket until at least one pushed frame was handed
+   * to the handler or the timeout expires.
+   *
+   * If another thread is reading from the socket at the same time, it
+   * delivers the frames instead and this call waits for it.
+   *
+   * @param timeout The maximum duration to wait.
+   *
+   * @return The number of frames handed to the handler during the call.
+   *
+   * @throws std::runtime_error If the connection is closed.
+   */
+  size_t pumpProcessDataStream(std::chrono::steady_clock::duration timeout);
+
+  /**
+   * @brief Returns the counters of the current or last process data stream.
+   */
+  ProcessDataStreamStats processDataStreamStats();
+
+  /**
+   * @brief Sets how bulk traffic yields to process data.
+   *
+   * While process data requests are sent, or the device streams process
+   * data, at most `bulkWindow` SDO, state and file requests are in flight
+   * at once; the others wait in the queue. The worst-case latency of a PDO
+   * exchange is thus bounded by that many bulk segments, except for the
+   * first one after an idle period, which may find more bulk requests in
+   * flight. Once no process data was requested for `activityHold`, bulk
+   * requests use all slots again.
+   *
+   * @param options The new options. A window of 0 is treated as 1.
+   */
+  void setPriorityLaneOptions(const PriorityLaneOptions& options);
+
+  /**
+   * @brief Attaches a tracer that records the timeline of every exchange.
+   *
+   * While the tracer is enabled, each exchange is stamped when it is
+   * requested, written and answered, and recorded into the tracer by the
+   * calling thread once it completes. Exchanges that fail or time out are
+   * not recorded.
+   *
+   * @param tracer The tracer, or `nullptr` to detach it. It must outlive the
+   * connection or be detached first.
+   */
+  void setTracer(ExchangeTracer* tracer);
+
+ private:
+  /** Maximum number of requests that are queued or in flight at once. */
+  static constexpr size_t kMaxPendingExchanges = 16;
+
+  /** Request slots that only process data requests may use. */
+  static constexpr size_t kPrioritySlots = 2;
+
+  /** Maximum size of a request prefix stored together with the header. */
+  static constexpr size_t kMaxPrefixSize = 8;
+
+  /**
+   * @brief A request that is queued, in flight, or waiting to be collected.
+   */
+  struct PendingExchange {
+    enum class State : uint8_t {
+      FREE,       ///< The slot is unused.
+      QUEUED,     ///< The request waits to be written.
+      SENDING,    ///< The request is being written.
+      SENT,       ///< The request was written; the response is pending.
+      ABANDONED,  ///< The caller gave up; the response will be dropped.
+      COMPLETED,  ///< The response was received.
+      FAILED      ///< The exchange failed.
+    };
+
+    State state = State::FREE;  ///< The state of the exchange.
+    uint16_t id = 0;            ///< The sequence ID of the request.
+    std::array<uint8_t, EthernetMessage::kHeaderSize + kMaxPrefixSize>
+        head;                          ///< The header followed by the prefix.
+    size_t headSize = 0;               ///< The used size of `head`.
+    std::span<const uint8_t> payload;  ///< The caller's request payload.
+    std::span<uint8_t> response;       ///< The caller's response buffer.
+    EthernetMessageView message{};     ///< The received response.
+    const char* failure = nullptr;     ///< Why the exchange failed.
+    boost::system::error_code error;   ///< The error that made it fail.
+    std::chrono::steady_clock::time_point
+        sentAt;  ///< When writing the request started.
+    bool traced = false;  ///< Whether the times below are taken.
+    std::chrono::steady_clock::time_point
+        enqueuedAt;  ///< When the exchange was requested.
+    std::chrono::steady_clock::time_point
+        writtenAt;  ///< When the request was written.
+    std::chrono::steady_clock::time_point
+        firstByteAt;  ///< When the response started to arrive.
+    std::chrono::steady_clock::time_point
+        parsedAt;  ///< When the response was parsed.
+  };
+
+  /**
+   * @brief Fixed-capacity FIFO of slot indices.
+   */
+  class SlotQueue {
+   public:
+    bool empty() const noexcept { return count_ == 0; }
+    size_t size() const noexcept { return count_; }
+    size_t front() const noexcept { return slots_[head_]; }
+
+    size_t operator[](size_t i) const noexcept {
+      return slots_[(head_ + i) % kMaxPendingExchanges];
+    }
+
+    void push(size_t slot) noexcept {
+      slots_[(head_ + count_++) % kMaxPendingExchanges] =
+          static_cast<uint8_t>(slot);
+    }
+
+    void pop() noexcept {
+      head_ = (head_ + 1) % kMaxPendingExchanges;
+      --count_;
+    }
+
+    void erase(size_t slot) noexcept {
+      size_t kept = 0;
+      for (size_t i = 0; i < count_; ++i) {
+        const uint8_t current = slots_[(head_ + i) % kMaxPendingExchanges];
+        if (current != slot) {
+          slots_[(head_ + kept++) % kMaxPendingExchanges] = current;
+        }
+      }
+      count_ = kept;
+    }
+
+    void clear() noexcept { head_ = count_ = 0; }
+
+   private:
+    std::array<uint8_t, kMaxPendingExchanges> slots_{};  ///< Slot indices.
+    size_t head_ = 0;                                   ///< First element.
+    size_t count_ = 0;                                  ///< Element count.
+  };
+
+  /**
+   * @brief Exchanges a request consisting of a prefix and a payload.
+   *
+   * The prefix is stored behind the header in the request slot; the payload
+   * is written from the caller's buffer. A response buffer without storage
+   * discards the response payload.
+   */
+  EthernetMessageView exchange(EthernetMessageType type,
+                               EthernetMessageStatus status,
+                               std::span<const uint8_t> prefix,
+                               std::span<const uint8_t> payload,
+                               std::span<uint8_t> response,
+                               const std::chrono::steady_clock::duration
+                                   expiryTime);
+
+  /**
+   * @brief Reads a file with the whole transfer bounded by `deadline` and
+   * each segment by `expiryTime`.
+   */
+  std::vector<uint8_t> readFileUntil(
+      const std::string& filename,
+      std::chrono::steady_clock::time_point deadline,
+      std::chrono::steady_clock::duration expiryTime,
+      const CancellationToken& token);
+
+  /**
+   * @brief Writes a file with the whole transfer bounded by `deadline` and
+   * each segment by `expiryTime`.
+   */
+  bool writeFileUntil(const std::string& filename,
+                      std::span<const uint8_t> data,
+                      std::chrono::steady_clock::time_point deadline,
+                      std::chrono::steady_clock::duration expiryTime,
+                      const CancellationToken& token);
+
+  /**
+   * @brief Reads the parameter list with the whole transfer bounded by
+   * `deadline` and each segment and SDO batch by `expiryTime`.
+   */
+  std::vector<common::Parameter> getParametersUntil(
+      bool readValues, std::chrono::steady_clock::time_point deadline,
+      std::chrono::steady_clock::duration expiryTime,
+      const CancellationToken& token);
+
+  /**
+   * @brief Exchanges one segment of a segmented transfer.
+   *
+   * Throws `OperationCanceled` instead if the token was canceled. The
+   * segment must complete by `deadline` and within `expiryTime`.
+   *
+   * @param id The sequence ID of the transfer, or none for its first
+   * segment, in which case it is set to the ID that segment gets.
+   */
+  EthernetMessageView exchangeSegment(
+      EthernetMessageType type, EthernetMessageStatus status,
+      std::optional<uint16_t>& id, std::span<const uint8_t> payload,
+      std::span<uint8_t> response,
+      std::chrono::steady_clock::time_point deadline,
+      std::chrono::steady_clock::duration expiryTime,
+      const CancellationToken& token);
+
+  /**
+   * @brief Exchanges a batch of SDO reads or writes with all requests of a
+   * window in flight at once.
+   */
+  void transferSdos(EthernetMessageType type,
+                    std::span<SdoTransfer> transfers,
+                    std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * @brief Queues a request in a free slot, waiting for one if necessary.
+   *
+   * @return The slot index.
+   *
+   * @throws std::runtime_error If no slot becomes free before the deadline.
+   */
+  size_t enqueue(std::unique_lock<std::mutex>& lock, EthernetMessageType type,
+                 EthernetMessageStatus status, std::span<const uint8_t> prefix,
+                 std::span<const uint8_t> payload, std::span<uint8_t> response,
+                 std::chrono::steady_clock::time_point deadline,
+                 std::optional<uint16_t> id = std::nullopt);
+
+  /**
+   * @brief Queues a request if a slot is free.
+   *
+   * The request gets the next sequence ID unless `id` is given; segments of
+   * one transfer share the ID of their first segment.
+   *
+   * @return The slot index, or `kMaxPendingExchanges` if no slot is free.
+   */
+  size_t tryEnqueue(EthernetMessageType type, EthernetMessageStatus status,
+                    std::span<const uint8_t> prefix,
+                    std::span<const uint8_t> payload,
+                    std::span<uint8_t> response,
+                    std::optional<uint16_t> id = std::nullopt);
+
+  /**
+   * @brief Waits for the exchange in a slot to finish and releases the slot.
+   *
+   * While waiting, the calling thread takes over the socket whenever no other
+   * thread does, writing all queued requests at once and dispatching all
+   * received responses.
+   *
+   * @throws std::runtime_error If the exchange fails or times out.
+   */
+  EthernetMessageView await(std::unique_lock<std::mutex>& lock, size_t slot,
+                            std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * @brief Gives up on the exchange in a slot.
+   */
+  void release(std::unique_lock<std::mutex>& lock, size_t slot);
+
+  /**
+   * @brief Returns the number of queued bulk requests that may be written
+   * now without exceeding the bulk window.
+   */
+  size_t bulkBudget(std::chrono::steady_clock::time_point now) const;
+
+  /**
+   * @brief Checks whether `flush` would write any request.
+   */
+  bool hasWritableRequests() const;
+
+  /**
+   * @brief Writes the queued priority requests, followed by the queued bulk
+   * requests the bulk window admits, with a single gathering write.
+   */
+  void flush(std::unique_lock<std::mutex>& lock,
+             std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * @brief Reads from the socket once and dispatches all complete responses.
+   */
+  void receive(std::unique_lock<std::mutex>& lock,
+               std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * @brief Hands a received response to the exchange with the same sequence
+   * ID.
+   */
+  void dispatch(const EthernetMessageView& message);
+
+  /**
+   * @brief Hands a pushed TxPDO frame to the stream handler and updates the
+   * stream counters.
+   */
+  void deliverStreamFrame(const EthernetMessageView& message);
+
+  /**
+   * @brief Fails all queued and in-flight exchanges, ends the process data
+   * stream and closes the socket.
+   */
+  void failPending(const boost::system::error_code& error,
+                   const char* failure);
+
+  /**
+   * @brief Runs the I/O context until all pending operations complete or the
+   * deadline expires, in which case the operations are canceled.
+   */
+  void runUntil(std::chrono::steady_clock::time_point deadline);
+
+  /**
+   * @brief Wraps a completion handler so that it allocates from
+   * `handlerMemory_`.
+   */
+  template <typename Handler>
+  AllocatingHandler<Handler> makeHandler(Handler handler) {
+    return AllocatingHandler<Handler>(handlerMemory_, std::move(handler));
+  }
+
+  boost::asio::io_context ioContext_;  ///< The Boost.Asio I/O context for
+                                       ///< managing asynchronous operations.
+  boost::asio::ip::tcp::endpoint
+      endpoint_;  ///< The endpoint (IP address and port) to which the client
+                  ///< will connect.
+  boost::asio::ip::tcp::socket
+      socket_;  ///< The TCP socket used for communication with the device.
+
+  std::mutex mutex_;  ///< Mutex for synchronizing access to the request slots
+                      ///< and queues.
+  std::condition_variable
+      condition_;  ///< Signals finished exchanges, freed slots and the
+                   ///< release of the socket.
+  bool ioBusy_ = false;  ///< Whether a thread currently owns the socket.
+  bool connectedBefore_ = false;  ///< Whether a connection was ever made.
+
+  std::atomic<uint16_t> seqId_{0};  ///< Sequence ID for message tracking.
+
+  HandlerMemory handlerMemory_;  ///< Recycled memory for the handlers.
+
+  std::array<PendingExchange, kMaxPendingExchanges>
+      slots_;           ///< Preallocated request slots.
+  SlotQueue priorityQueued_;  ///< Process data slots waiting to be written.
+  SlotQueue queued_;    ///< Slots waiting to be written, in order.
+  SlotQueue inFlight_;  ///< Slots awaiting a response, in order.
+  std::array<boost::asio::const_buffer, 2 * kMaxPendingExchanges>
+      gather_;  ///< Header and payload buffers of a gathering write.
+  EthernetFrameReader reader_;  ///< Buffer the responses are framed out of.
+  std::chrono::steady_clock::time_point
+      messageStart_;  ///< When the first unread byte arrived, if traced.
+  bool readOutstanding_ = false;  ///< Whether a socket read is pending; only
+                                 ///< used by the thread owning the socket.
+  uint64_t readGeneration_ = 0;  ///< Counts the socket reads started, so
+                                 ///< that a cancel only hits its own read.
+
+  PriorityLaneOptions laneOptions_;  ///< How bulk traffic yields.
+  std::chrono::steady_clock::time_point
+      lastPriorityRequest_;  ///< When process data was last requested.
+
+  std::function<void(const EthernetMessageView&)>
+      unmatchedMessageHandler_;  ///< Receives messages without a request.
+  std::atomic<uint64_t> unmatchedMessageCount_{
+      0};  ///< Number of messages without a request.
+  DeviceStatistics statistics_;  ///< Traffic and error counters.
+  ExchangeTracer* tracer_ = nullptr;  ///< Records exchange timelines.
+
+  bool streaming_ = false;  ///< Whether pushed frames are expected.
+  std::chrono::steady_clock::duration
+      streamPeriod_{};                  ///< Interval between pushed frames.
+  ProcessDataHandler streamHandler_;    ///< Receives the pushed frames.
+  ProcessDataStreamStats streamStats_;  ///< Counters of the stream.
+  uint16_t lastStreamId_ = 0;           ///< Sequence ID of the last frame.
+  std::chrono::steady_clock::time_point
+      lastStreamArrival_;  ///< Arrival time of the last frame.
+};
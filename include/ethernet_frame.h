@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "ethernet_client.h"
+
+/**
+ * @struct EthernetMessageView
+ * @brief Non-owning view of an Ethernet message header and payload.
+ *
+ * This structure mirrors `EthernetMessage`, but refers to the payload bytes
+ * in place instead of copying them into a `std::vector`. It is used on the
+ * steady-state exchange paths where the payload is read into, or written from,
+ * a preallocated buffer.
+ *
+ * @note The view is only valid for as long as the buffer it was parsed from.
+ */
+struct EthernetMessageView {
+  EthernetMessageType type;          ///< The type of the message.
+  uint16_t id;                       ///< The sequence ID of the message.
+  EthernetMessageStatus status;      ///< The status of the message.
+  EthernetSqiReplyStatus sqiStatus;  ///< The SQI reply status.
+  uint16_t size;                     ///< The payload size from the header.
+  std::span<const uint8_t> data;     ///< The payload bytes.
+};
+
+/**
+ * @brief Serializes an Ethernet message header into a caller-provided buffer.
+ *
+ * Writes the 7-byte header in the same layout as `serializeEthernetMessage`:
+ * type, sequence ID (little-endian), status, an empty SQI status byte and
+ * payload size (little-endian). No memory is allocated.
+ *
+ * @param type The message type.
+ * @param id The sequence ID of the message.
+ * @param status The status of the message.
+ * @param size The size of the payload that follows the header.
+ * @param header The buffer to write the header into.
+ *
+ * @see serializeEthernetMessage
+ */
+void serializeEthernetMessageHeader(
+    EthernetMessageType type, uint16_t id, EthernetMessageStatus status,
+    uint16_t size,
+    std::span<uint8_t, EthernetMessage::kHeaderSize> header) noexcept;
+
+/**
+ * @brief Parses an Ethernet message header from a raw byte buffer.
+ *
+ * Interprets the first 7 bytes of the buffer in the same layout as
+ * `parseEthernetMessage`, where the SQI reply status precedes the message
+ * status, and fills in all fields of the view except `data`, which is left
+ * empty.
+ *
+ * @param header The buffer holding the message header.
+ * @param message The view to populate.
+ *
+ * @see parseEthernetMessage
+ */
+void parseEthernetMessageHeader(
+    std::span<const uint8_t, EthernetMessage::kHeaderSize> header,
+    EthernetMessageView& message) noexcept;
+
+/**
+ * @brief Parses a complete Ethernet message from a raw byte buffer in place.
+ *
+ * Parses the header and, if the buffer holds the whole payload announced by
+ * the size field, points the view's `data` at it.
+ *
+ * @param buffer The raw bytes, starting at a message header.
+ * @param message The view to populate.
+ *
+ * @return The number of bytes the message occupies in the buffer, or 0 if the
+ * buffer does not yet hold a complete message.
+ */
+size_t parseEthernetMessageView(std::span<const uint8_t> buffer,
+                                EthernetMessageView& message) noexcept;
+
+/**
+ * @class EthernetFrameReader
+ * @brief Receive buffer that frames out every complete message it holds.
+ *
+ * Instead of reading the 7-byte header and the payload of each message with
+ * separate socket reads, the socket is read into this buffer with as many
+ * bytes as are available. All complete messages in the buffer can then be
+ * taken out without further system calls, which matters when several
+ * requests are in flight or when the device sends bursts of segments.
+ *
+ * The buffer works like a ring with read and write cursors. Unread bytes are
+ * moved to the front only when the free space behind the write cursor can no
+ * longer hold a maximum-size message, so every message is contiguous and
+ * views returned by `next` never need to be reassembled.
+ */
+class EthernetFrameReader {
+ public:
+  /** The size of the largest message, including its header. */
+  static constexpr size_t kMaxFrameSize =
+      EthernetMessage::kHeaderSize + EthernetMessage::kBufferSize;
+
+  /** The capacity of the buffer. */
+  static constexpr size_t kCapacity = 16 * kMaxFrameSize;
+
+  /**
+   * @brief Returns the free space to receive bytes into.
+   *
+   * Unread bytes are compacted to the front of the buffer first if needed,
+   * which invalidates views previously returned by `next`. The returned span
+   * always holds at least one maximum-size message.
+   *
+   * @return The writable space behind the received bytes.
+   */
+  std::span<uint8_t> prepare() noexcept;
+
+  /**
+   * @brief Marks bytes written into the span returned by `prepare` as
+   * received.
+   *
+   * @param size The number of bytes received.
+   */
+  void commit(size_t size) noexcept;
+
+  /**
+   * @brief Takes the next complete message out of the buffer.
+   *
+   * @param message The view to populate. Its `data` refers to the buffer and
+   * stays valid until the next call to `prepare` or `clear`.
+   *
+   * @return `true` if a complete message was taken out; `false` if the buffer
+   * holds no complete message.
+   *
+   * @throws std::runtime_error If the header announces a payload larger than
+   * `EthernetMessage::kBufferSize`, which means the stream is corrupt.
+   */
+  bool next(EthernetMessageView& message);
+
+  /**
+   * @brief Returns the number of received bytes not yet taken out.
+   */
+  size_t size() const noexcept { return end_ - begin_; }
+
+  /**
+   * @brief Discards all received bytes.
+   */
+  void clear() noexcept { begin_ = end_ = 0; }
+
+ private:
+  std::array<uint8_t, kCapacity> buffer_;  ///< The received bytes.
+  size_t begin_ = 0;                       ///< Read cursor.
+  size_t end_ = 0;                         ///< Write cursor.
+};
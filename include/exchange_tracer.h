@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "ethernet_client.h"
+
+/**
+ * @class ExchangeTracer
+ * @brief Records the timeline of exchanges and exports it as a Chrome trace.
+ *
+ * An `EthernetConnection` with a tracer attached stamps every exchange at
+ * five points: when the caller asks for it, when writing the request starts
+ * and completes, when the read holding the first byte of the response
+ * completes and when the response has been parsed and copied out. The
+ * phases in between show whether an exchange waited for the mutex and the
+ * queue, for the kernel, or for the device.
+ *
+ * Each calling thread records its spans into a ring buffer of its own, so
+ * recording takes no lock once the thread has recorded its first span; the
+ * oldest spans are overwritten when the ring is full. `chromeTrace` collects
+ * the rings of all threads into the JSON format read by `chrome://tracing`
+ * and Perfetto.
+ *
+ * @code
+ * ExchangeTracer tracer;
+ * connection.setTracer(&tracer);
+ * tracer.enable();
+ * runMachine();
+ * tracer.writeChromeTrace("exchanges.json");
+ * @endcode
+ */
+class ExchangeTracer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @struct Span
+   * @brief The timeline of one exchange.
+   */
+  struct Span {
+    EthernetMessageType type{};       ///< The type of the request.
+    uint8_t reserved = 0;             ///< Padding, 0.
+    uint16_t id = 0;                  ///< The sequence ID of the request.
+    uint32_t requestSize = 0;         ///< Request size, header included.
+    uint32_t responseSize = 0;        ///< Response size, header included.
+    uint32_t thread = 0;              ///< Set by the tracer on recording.
+    Clock::time_point enqueue;        ///< The caller asked for the exchange.
+    Clock::time_point writeStart;     ///< Writing the request started.
+    Clock::time_point writeComplete;  ///< The request was written.
+    Clock::time_point firstByte;      ///< The response started to arrive.
+    Clock::time_point parseComplete;  ///< The response was parsed.
+  };
+
+  static_assert(std::is_trivially_copyable_v<Span> &&
+                    sizeof(Span) % sizeof(uint64_t) == 0,
+                "Spans are stored word by word");
+
+  /**
+   * @brief Constructs a disabled tracer.
+   *
+   * @param capacity The number of spans kept per thread. Defaults to 4096.
+   */
+  explicit ExchangeTracer(size_t capacity = 4096);
+
+  ExchangeTracer(const ExchangeTracer&) = delete;
+  ExchangeTracer& operator=(const ExchangeTracer&) = delete;
+
+  /** Starts recording. */
+  void enable() noexcept { enabled_.store(true, std::memory_order_relaxed); }
+
+  /** Stops recording; the recorded spans are kept. */
+  void disable() noexcept {
+    enabled_.store(false, std::memory_order_relaxed);
+  }
+
+  /** Checks whether spans are recorded. */
+  bool enabled() const noexcept {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Records a span into the ring of the calling thread.
+   *
+   * The first span of a thread allocates its ring; later ones take no lock
+   * and do not allocate.
+   */
+  void record(const Span& span);
+
+  /**
+   * @brief Returns the spans currently held by all rings, ordered by the
+   * time they were enqueued.
+   *
+   * Can be called while other threads record; spans overwritten during the
+   * call are left out.
+   */
+  std::vector<Span> spans() const;
+
+  /**
+   * @brief Renders the recorded spans as Chrome trace JSON.
+   *
+   * Each exchange becomes a slice named after its message type, on the
+   * track of its calling thread, with nested slices for the phases `queue`,
+   * `write`, `device` and `receive`.
+   */
+  std::string chromeTrace() const;
+
+  /**
+   * @brief Writes the recorded spans to a Chrome trace file.
+   *
+   * @throws std::runtime_error If the file cannot be written.
+   */
+  void writeChromeTrace(const std::string& path) const;
+
+ private:
+  /** Words of a stored span. */
+  static constexpr size_t kSpanWords = sizeof(Span) / sizeof(uint64_t);
+
+  /**
+   * @brief A span stored as relaxed atomic words behind a sequence.
+   *
+   * The sequence is `2 * position + 2` once the span recorded at that
+   * position of the ring is complete, and odd while it is being written.
+   */
+  struct Entry {
+    std::atomic<uint64_t> sequence{0};                  ///< See above.
+    std::array<std::atomic<uint64_t>, kSpanWords> words;  ///< The span.
+  };
+
+  /**
+   * @brief The ring of one thread; written only by that thread.
+   */
+  struct Ring {
+    Ring(uint32_t thread, size_t capacity)
+        : thread(thread), entries(new Entry[capacity]) {}
+
+    uint32_t thread;                   ///< Track of the thread in the trace.
+    std::atomic<uint64_t> written{0};  ///< Spans recorded so far.
+    std::unique_ptr<Entry[]> entries;  ///< The stored spans.
+  };
+
+  /**
+   * @brief Returns the ring of the calling thread, creating it if needed.
+   */
+  Ring& ring();
+
+  const uint64_t instance_;         ///< Distinguishes tracers per thread.
+  const size_t capacity_;           ///< Spans kept per thread.
+  std::atomic<bool> enabled_{false};  ///< Whether spans are recorded.
+
+  mutable std::mutex mutex_;                 ///< Guards `rings_`.
+  std::vector<std::unique_ptr<Ring>> rings_;  ///< One ring per thread.
+};
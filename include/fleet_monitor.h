@@ -0,0 +1,219 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ethernet_connection.h"
+#include "ethernet_frame.h"
+#include "timer_wheel.h"
+
+/**
+ * @class FleetMonitor
+ * @brief Watches the EtherCAT state of many devices from one thread.
+ *
+ * Every device gets its own connection, but all of them are served by a
+ * single Boost.Asio I/O context on one thread, which on Linux is a single
+ * epoll reactor. Each device is sent a `STATE_READ` request once per period;
+ * the requests of different devices are spread evenly over the period.
+ * Poll deadlines, response timeouts and reconnect delays of all devices live
+ * in one `TimerWheel`, which a single periodic timer advances, so no timer is
+ * armed per request and the work done grows with the number of responses
+ * rather than with the number of devices.
+ *
+ * Changes of state are passed to a handler on the monitor thread. A device
+ * that does not answer within the timeout, or whose connection fails, is
+ * reported as state 0 and reconnected after a delay.
+ *
+ * @code
+ * FleetMonitor monitor([](size_t device, uint8_t previous, uint8_t state) {
+ *   LOG_F(INFO, "Device %zu: %d -> %d", device, previous, state);
+ * });
+ * for (const auto& ip : addresses) {
+ *   monitor.add(ip, 8080);
+ * }
+ * monitor.start();
+ * @endcode
+ */
+class FleetMonitor {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Receives state changes: the device number as returned by `add`,
+   * the previous state and the new state. A state of 0 means that the state
+   * is unknown because the device cannot be reached.
+   */
+  using StateHandler =
+      std::function<void(size_t device, uint8_t previous, uint8_t state)>;
+
+  /**
+   * @struct Options
+   * @brief Configures a `FleetMonitor`.
+   */
+  struct Options {
+    Clock::duration period =
+        std::chrono::milliseconds(100);  ///< Interval between polls.
+    Clock::duration timeout =
+        std::chrono::milliseconds(3000);  ///< Time to wait for a response.
+    Clock::duration reconnectDelay =
+        std::chrono::milliseconds(1000);  ///< Delay before reconnecting.
+    Clock::duration tick =
+        std::chrono::milliseconds(5);  ///< Resolution of the timers.
+  };
+
+  /**
+   * @brief Constructs a monitor. Monitoring starts with `start`.
+   *
+   * @param handler Called on the monitor thread whenever the state of a
+   * device changes.
+   * @param options The configuration.
+   */
+  explicit FleetMonitor(StateHandler handler, const Options& options);
+
+  /**
+   * @brief Constructs a monitor with the default configuration.
+   *
+   * @param handler Called on the monitor thread whenever the state of a
+   * device changes.
+   */
+  explicit FleetMonitor(StateHandler handler);
+
+  /**
+   * @brief Stops monitoring and closes all connections.
+   */
+  ~FleetMonitor();
+
+  FleetMonitor(const FleetMonitor&) = delete;
+  FleetMonitor& operator=(const FleetMonitor&) = delete;
+
+  /**
+   * @brief Adds a device. Must be called before `start`.
+   *
+   * @param ip The IP address of the device.
+   * @param port The port of the device.
+   *
+   * @return The number of the device, counting from 0.
+   */
+  size_t add(const std::string& ip, unsigned short port);
+
+  /**
+   * @brief Connects to all devices and starts polling on the monitor thread.
+   */
+  void start();
+
+  /**
+   * @brief Stops the monitor thread and closes all connections.
+   */
+  void stop();
+
+  /**
+   * @brief Returns the last known state of a device, or 0 if it is unknown.
+   *
+   * @param device The number of the device.
+   */
+  uint8_t state(size_t device) const noexcept {
+    return devices_[device]->state.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the number of devices.
+   */
+  size_t size() const noexcept { return devices_.size(); }
+
+ private:
+  /** What a timer of the wheel is for. */
+  enum class TimerKind : uint64_t {
+    POLL,       ///< Send the next request.
+    TIMEOUT,    ///< The pending request was not answered in time.
+    RECONNECT,  ///< Connect again after a failure.
+  };
+
+  /**
+   * @struct Device
+   * @brief The connection and polling state of one device.
+   */
+  struct Device {
+    explicit Device(boost::asio::io_context& context,
+                    boost::asio::ip::tcp::endpoint endpoint)
+        : endpoint(std::move(endpoint)), socket(context) {}
+
+    boost::asio::ip::tcp::endpoint endpoint;  ///< Address of the device.
+    boost::asio::ip::tcp::socket socket;      ///< Connection to the device.
+    EthernetFrameReader reader;               ///< Received bytes.
+    HandlerMemory handlerMemory;              ///< Memory for the handlers.
+    std::array<uint8_t, EthernetMessage::kHeaderSize>
+        request{};                 ///< The STATE_READ request.
+    uint32_t generation = 0;       ///< Counts connections, so that handlers
+                                   ///< of closed ones are ignored.
+    uint16_t sequenceId = 0;       ///< Sequence ID of the last request.
+    bool connected = false;        ///< Whether the connection is up.
+    bool pending = false;          ///< Whether a request is unanswered.
+    Clock::time_point nextPoll;    ///< When the next request is due.
+    TimerWheel::TimerId pollTimer =
+        TimerWheel::kInvalidTimer;  ///< Timer of the next request.
+    TimerWheel::TimerId timeoutTimer =
+        TimerWheel::kInvalidTimer;  ///< Timer of the pending request.
+    std::atomic<uint8_t> state{0};  ///< The last known state.
+  };
+
+  /**
+   * @brief Encodes a timer value for a device.
+   */
+  static uint64_t timerValue(size_t device, TimerKind kind) noexcept {
+    return static_cast<uint64_t>(device) << 2 | static_cast<uint64_t>(kind);
+  }
+
+  /**
+   * @brief Starts connecting to a device.
+   */
+  void connect(size_t device);
+
+  /**
+   * @brief Sends a request to a device, unless one is still unanswered, and
+   * schedules the next one.
+   */
+  void poll(size_t device);
+
+  /**
+   * @brief Starts receiving from a device.
+   */
+  void read(size_t device);
+
+  /**
+   * @brief Closes the connection to a device, reports its state as unknown
+   * and schedules a reconnect.
+   */
+  void fail(size_t device);
+
+  /**
+   * @brief Records the state of a device and reports it if it changed.
+   */
+  void publish(size_t device, uint8_t state);
+
+  /**
+   * @brief Handles an expired timer of the wheel.
+   */
+  void onTimer(uint64_t value);
+
+  /**
+   * @brief Arms the periodic timer that advances the wheel.
+   */
+  void tick();
+
+  StateHandler handler_;  ///< Receives state changes.
+  Options options_;       ///< The configuration.
+
+  boost::asio::io_context context_;          ///< Serves all connections.
+  boost::asio::steady_timer ticker_;         ///< Advances the wheel.
+  TimerWheel wheel_;                         ///< All per-device timers.
+  std::vector<std::unique_ptr<Device>> devices_;  ///< The devices.
+  std::thread thread_;                       ///< The monitor thread.
+};
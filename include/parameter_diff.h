@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "ethernet_client.h"
+#include "ethernet_connection.h"
+
+/**
+ * @struct ParameterChange
+ * @brief One SDO write needed to bring a device to a target configuration.
+ */
+struct ParameterChange {
+  uint16_t index;             ///< The index of the parameter.
+  uint8_t subindex;           ///< The subindex of the parameter.
+  std::vector<uint8_t> data;  ///< The value to write.
+};
+
+/**
+ * @struct ParameterDiffOptions
+ * @brief Configures `diffParameters`.
+ */
+struct ParameterDiffOptions {
+  /** Flags of which a parameter needs at least one in `Parameter::flags` to
+   * be written. Defaults to write access in PRE-OP, where devices are
+   * configured. */
+  common::ObjectFlags writeAccess = common::ObjectFlags::PO_WR;
+};
+
+/**
+ * @struct ParameterDiff
+ * @brief The writes that turn the current configuration into the target.
+ */
+struct ParameterDiff {
+  std::vector<ParameterChange> changes;  ///< The writes, in order.
+  size_t unchanged = 0;  ///< Target values the device already has.
+  size_t readOnly = 0;   ///< Differing values without write access.
+  size_t unknown = 0;    ///< Target parameters the device does not have.
+};
+
+/**
+ * @brief Computes the writes that bring a device to a target configuration.
+ *
+ * Each target parameter is compared byte for byte with the current value of
+ * the same index and subindex. Equal values, parameters without any of the
+ * `writeAccess` flags, parameters the device does not have and target
+ * parameters without a value are skipped, so pushing a configuration onto a
+ * device that already has it produces no writes at all.
+ *
+ * The changes are ordered by index and subindex. If subindex 0 of an object
+ * is writable, it holds the number of entries and devices reject writes to
+ * the entries while it is nonzero, as with PDO mapping objects; such an
+ * object is written by clearing subindex 0, writing the changed entries and
+ * then writing the target value of subindex 0.
+ *
+ * @param target The target configuration, for example loaded from JSON or
+ * from a `ParameterSnapshotView`.
+ * @param current The current parameters with their values, for example from
+ * `EthernetDevice::getParameters(true)`.
+ * @param options The access flags that allow writing.
+ *
+ * @return The changes and the number of skipped parameters.
+ */
+ParameterDiff diffParameters(std::span<const common::Parameter> target,
+                             std::span<const common::Parameter> current,
+                             const ParameterDiffOptions& options = {});
+
+/**
+ * @brief Computes the writes that bring a device to a target configuration.
+ *
+ * @param target The target configuration.
+ * @param current The current parameters, keyed by index and subindex.
+ * @param options The access flags that allow writing.
+ *
+ * @return The changes and the number of skipped parameters.
+ */
+ParameterDiff diffParameters(
+    std::span<const common::Parameter> target,
+    const std::unordered_map<common::ParameterKey, common::Parameter>& current,
+    const ParameterDiffOptions& options = {});
+
+/**
+ * @brief Computes the writes that bring a device to a target configuration,
+ * comparing with the parameter store of the device.
+ *
+ * @param target The target configuration.
+ * @param device The device. Its parameters must have been loaded with their
+ * values by `loadParameters(true)`.
+ * @param options The access flags that allow writing.
+ *
+ * @return The changes and the number of skipped parameters.
+ */
+ParameterDiff diffParameters(std::span<const common::Parameter> target,
+                             EthernetDevice& device,
+                             const ParameterDiffOptions& options = {});
+
+/**
+ * @brief Applies the changes of a diff as pipelined batches of SDO writes.
+ *
+ * The changes of objects without a guarding count are sent in order as one
+ * batch with `EthernetConnection::writeSdos`, so most of a configuration
+ * costs a few round trips rather than one per parameter. Each object whose
+ * count guards its entries is then written in three checked batches:
+ * clearing the count, writing the entries and restoring the count.
+ *
+ * The unguarded batch is always sent in full, and its results are only
+ * checked once every write of it was answered; if one failed, no guarded
+ * object is written. The steps of a guarded object stop at the step with a
+ * failed write, so a count is never restored over entries that failed to
+ * write.
+ *
+ * @param connection The connection to the device.
+ * @param diff The diff to apply.
+ * @param expiryTime The duration to wait for each batch. Defaults to 5000
+ * milliseconds.
+ *
+ * @throws std::runtime_error If a write fails or times out. The message
+ * names the object whose count was left cleared, if any.
+ */
+void applyParameterDiff(EthernetConnection& connection,
+                        const ParameterDiff& diff,
+                        const std::chrono::steady_clock::duration expiryTime =
+                            std::chrono::milliseconds(5000));
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "common.h"
+
+/**
+ * @struct ParameterDumpOptions
+ * @brief Selects and orders the parameters of a dump.
+ */
+struct ParameterDumpOptions {
+  uint16_t firstIndex = 0x0000;  ///< Lowest index to include.
+  uint16_t lastIndex = 0xFFFF;   ///< Highest index to include.
+  common::ObjectFlags requiredFlags =
+      common::ObjectFlags::None;  ///< Flags a parameter must all have.
+  bool sortParameters = true;     ///< Sort by index and subindex.
+};
+
+/**
+ * @brief Formats a parameter map into a text buffer.
+ *
+ * Produces one line per parameter in the layout of `common::logParametersMap`.
+ * Everything is appended to `output` with `std::to_chars`; values are
+ * decoded from the raw data in place instead of through
+ * `convertParameterValueToString`, and sorting orders pointers rather than
+ * copies of the parameters. Reusing `output` across dumps avoids all
+ * allocations once it has grown to size.
+ *
+ * @param parametersMap The parameters, keyed by index and subindex.
+ * @param output The buffer to append to.
+ * @param options The filters and ordering.
+ *
+ * @return The number of parameters written.
+ */
+size_t formatParametersMap(
+    const std::unordered_map<common::ParameterKey, common::Parameter>&
+        parametersMap,
+    std::string& output, const ParameterDumpOptions& options = {});
+
+/**
+ * @brief Dumps a parameter map in one piece.
+ *
+ * Replaces `common::logParametersMap`, which logs one line per parameter. The
+ * dump is formatted into a single buffer and handed to the sink in one call,
+ * so a logging sink takes its lock once for the whole dump.
+ *
+ * @param parametersMap The parameters, keyed by index and subindex.
+ * @param options The filters and ordering.
+ * @param sink Receives the formatted dump. Without a sink, the dump is logged
+ * as one loguru message.
+ */
+void dumpParametersMap(
+    const std::unordered_map<common::ParameterKey, common::Parameter>&
+        parametersMap,
+    const ParameterDumpOptions& options = {},
+    const std::function<void(std::string_view)>& sink = {});
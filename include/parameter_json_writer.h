@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "common.h"
+
+/**
+ * @class ParameterJsonWriter
+ * @brief Streams parameters as JSON without building a document tree.
+ *
+ * Each parameter is formatted straight into a fixed-size buffer, which is
+ * handed to the sink whenever it fills up, so memory use does not grow with
+ * the number of parameters. Numbers are formatted with `std::to_chars`.
+ *
+ * The output is identical to dumping the `nlohmann::json` produced by
+ * `common::Parameter::to_json` in compact form: the same keys in the same
+ * (sorted) order, enums as numbers, the value as an array of byte values
+ * and strings escaped the same way.
+ *
+ * @code
+ * std::ofstream file("parameters.json");
+ * ParameterJsonWriter writer(file);
+ * writer.beginArray();
+ * for (const auto& parameter : parameters) {
+ *   writer.write(parameter);
+ * }
+ * writer.endArray();
+ * @endcode
+ */
+class ParameterJsonWriter {
+ public:
+  /** Receives the formatted output in chunks. */
+  using Sink = std::function<void(std::string_view)>;
+
+  /**
+   * @brief Constructs a writer that passes its output to a sink.
+   *
+   * @param sink The sink for the output.
+   */
+  explicit ParameterJsonWriter(Sink sink);
+
+  /**
+   * @brief Constructs a writer that writes to a stream.
+   *
+   * @param stream The stream to write to. It must outlive the writer.
+   */
+  explicit ParameterJsonWriter(std::ostream& stream);
+
+  /**
+   * @brief Constructs a writer that appends to a string.
+   *
+   * @param output The string to append to. It must outlive the writer.
+   */
+  explicit ParameterJsonWriter(std::string& output);
+
+  /**
+   * @brief Flushes the remaining output to the sink.
+   */
+  ~ParameterJsonWriter();
+
+  ParameterJsonWriter(const ParameterJsonWriter&) = delete;
+  ParameterJsonWriter& operator=(const ParameterJsonWriter&) = delete;
+
+  /**
+   * @brief Opens a JSON array; subsequent parameters become its elements.
+   */
+  void beginArray();
+
+  /**
+   * @brief Closes the JSON array opened by `beginArray`.
+   */
+  void endArray();
+
+  /**
+   * @brief Writes one parameter as a JSON object.
+   *
+   * @param parameter The parameter to write.
+   */
+  void write(const common::Parameter& parameter);
+
+  /**
+   * @brief Hands the buffered output to the sink.
+   */
+  void flush();
+
+ private:
+  /** Size of the output buffer. */
+  static constexpr size_t kBufferSize = 16 * 1024;
+
+  /** Longest output of a single `number` call. */
+  static constexpr size_t kMaxNumberSize = 24;
+
+  /**
+   * @brief Makes room for at least `size` more bytes.
+   */
+  void reserve(size_t size) {
+    if (kBufferSize - size_ < size) {
+      flush();
+    }
+  }
+
+  /**
+   * @brief Appends raw characters.
+   */
+  void append(std::string_view text);
+
+  /**
+   * @brief Appends a JSON string with escaping.
+   */
+  void appendString(std::string_view text);
+
+  /**
+   * @brief Appends an integer.
+   */
+  template <typename T>
+  void number(T value) {
+    reserve(kMaxNumberSize);
+    auto result =
+        std::to_chars(buffer_.data() + size_, buffer_.data() + kBufferSize,
+                      value);
+    size_ = result.ptr - buffer_.data();
+  }
+
+  Sink sink_;                             ///< Receives the output.
+  std::array<char, kBufferSize> buffer_;  ///< Output not yet flushed.
+  size_t size_ = 0;                       ///< Bytes in `buffer_`.
+  bool first_ = true;  ///< Whether no element was written to the array yet.
+};
+
+/**
+ * @brief Writes parameters to a stream as a JSON array.
+ *
+ * @param stream The stream to write to.
+ * @param parameters The parameters to write.
+ */
+void writeParametersJson(std::ostream& stream,
+                         std::span<const common::Parameter> parameters);
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.h"
+
+/**
+ * @struct ParameterSnapshotHeader
+ * @brief Header at the start of a binary parameter snapshot.
+ *
+ * A snapshot consists of this header, a table of fixed-size
+ * `ParameterSnapshotRecord`s and a blob area holding the names and values the
+ * records point to. All integers are little-endian. Readers accept any
+ * snapshot with the same major version and a record size at least as large
+ * as the one they know, so later versions can append record fields.
+ */
+struct ParameterSnapshotHeader {
+  char magic[8];         ///< `kParameterSnapshotMagic`.
+  uint16_t version;      ///< Major version of the format.
+  uint16_t recordSize;   ///< Size of one record in bytes.
+  uint32_t recordCount;  ///< Number of records.
+  uint64_t blobOffset;   ///< Offset of the blob area from the file start.
+  uint64_t blobSize;     ///< Size of the blob area in bytes.
+};
+
+/**
+ * @struct ParameterSnapshotRecord
+ * @brief Fixed-size record of one parameter in a binary snapshot.
+ *
+ * Names and values are stored out of line in the blob area; offsets are
+ * relative to its start.
+ */
+struct ParameterSnapshotRecord {
+  uint16_t index;       ///< Index of the parameter.
+  uint8_t subindex;     ///< Subindex of the parameter.
+  uint8_t reserved0;    ///< Reserved, 0.
+  uint16_t bitLength;   ///< Bit length of the parameter.
+  uint16_t dataType;    ///< `common::ObjectDataType` of the parameter.
+  uint16_t code;        ///< `common::ObjectCode` of the parameter.
+  uint16_t flags;       ///< `common::ObjectFlags` of the parameter.
+  uint16_t access;      ///< Access `common::ObjectFlags` of the parameter.
+  uint16_t reserved1;   ///< Reserved, 0.
+  int32_t byteLength;   ///< Byte length of the parameter.
+  uint32_t nameOffset;  ///< Offset of the name in the blob area.
+  uint32_t nameSize;    ///< Size of the name in bytes.
+  uint32_t dataOffset;  ///< Offset of the value in the blob area.
+  uint32_t dataSize;    ///< Size of the value in bytes.
+  uint32_t reserved2;   ///< Reserved, 0.
+};
+
+static_assert(sizeof(ParameterSnapshotHeader) == 32,
+              "The snapshot header layout is part of the file format");
+static_assert(sizeof(ParameterSnapshotRecord) == 40,
+              "The snapshot record layout is part of the file format");
+
+/** Magic bytes identifying a binary parameter snapshot. */
+inline constexpr char kParameterSnapshotMagic[8] = {'S', 'O', 'M', 'P',
+                                                    'A', 'R', 'A', 'M'};
+
+/** The major version of the binary parameter snapshot format. */
+inline constexpr uint16_t kParameterSnapshotVersion = 1;
+
+/**
+ * @brief Serializes parameters into a binary snapshot.
+ *
+ * The snapshot is written in one sequential pass into a buffer sized up
+ * front, so it is allocated once.
+ *
+ * @param parameters The parameters to store, in the order to store them.
+ *
+ * @return The snapshot bytes.
+ */
+std::vector<uint8_t> serializeParameterSnapshot(
+    std::span<const common::Parameter> parameters);
+
+/**
+ * @brief Writes parameters into a binary snapshot file.
+ *
+ * @param path The path of the file to write.
+ * @param parameters The parameters to store.
+ *
+ * @throws std::runtime_error If the file cannot be written.
+ */
+void writeParameterSnapshot(const std::string& path,
+                            std::span<const common::Parameter> parameters);
+
+/**
+ * @class ParameterSnapshotView
+ * @brief Read-only view of a binary snapshot held in memory.
+ *
+ * The view validates the header and bounds once and then reads records,
+ * names and values in place, so a memory-mapped snapshot file can be
+ * inspected without copying it.
+ */
+class ParameterSnapshotView {
+ public:
+  /**
+   * @brief Validates a snapshot and creates a view of it.
+   *
+   * @param bytes The snapshot bytes. They must outlive the view.
+   *
+   * @throws std::runtime_error If the bytes are not a valid snapshot of a
+   * supported version.
+   */
+  explicit ParameterSnapshotView(std::span<const uint8_t> bytes);
+
+  /**
+   * @brief Returns the number of parameters in the snapshot.
+   */
+  size_t size() const noexcept { return recordCount_; }
+
+  /**
+   * @brief Returns the record of a parameter.
+   *
+   * @param i The position of the parameter, less than `size()`.
+   */
+  ParameterSnapshotRecord record(size_t i) const noexcept;
+
+  /**
+   * @brief Returns the name of a parameter, in place.
+   */
+  std::string_view name(const ParameterSnapshotRecord& record) const noexcept;
+
+  /**
+   * @brief Returns the value of a parameter, in place.
+   */
+  std::span<const uint8_t> data(
+      const ParameterSnapshotRecord& record) const noexcept;
+
+  /**
+   * @brief Copies a parameter out of the snapshot.
+   *
+   * @param i The position of the parameter, less than `size()`.
+   */
+  common::Parameter parameter(size_t i) const;
+
+  /**
+   * @brief Copies all parameters out of the snapshot in one sequential pass.
+   */
+  std::vector<common::Parameter> parameters() const;
+
+ private:
+  std::span<const uint8_t> bytes_;  ///< The whole snapshot.
+  std::span<const uint8_t> blob_;   ///< The blob area.
+  size_t recordSize_ = 0;           ///< Stride of the record table.
+  size_t recordCount_ = 0;          ///< Number of records.
+};
+
+/**
+ * @class MappedParameterSnapshot
+ * @brief Binary snapshot file mapped into memory.
+ *
+ * The file is mapped read-only and viewed in place; pages are only read
+ * from disk when the records or values on them are accessed.
+ */
+class MappedParameterSnapshot {
+ public:
+  /**
+   * @brief Maps a snapshot file.
+   *
+   * @param path The path of the snapshot file.
+   *
+   * @throws std::runtime_error If the file cannot be mapped or is not a valid
+   * snapshot.
+   */
+  explicit MappedParameterSnapshot(const std::string& path);
+
+  MappedParameterSnapshot(const MappedParameterSnapshot&) = delete;
+  MappedParameterSnapshot& operator=(const MappedParameterSnapshot&) = delete;
+
+  /**
+   * @brief Returns the view of the mapped snapshot.
+   */
+  const ParameterSnapshotView& view() const noexcept { return view_; }
+
+ private:
+  /**
+   * @brief Read-only memory mapping of a whole file.
+   */
+  class FileMapping {
+   public:
+    explicit FileMapping(const std::string& path);
+    ~FileMapping();
+
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+
+    std::span<const uint8_t> bytes() const noexcept {
+      return {address_, size_};
+    }
+
+   private:
+    const uint8_t* address_ = nullptr;  ///< Start of the mapping.
+    size_t size_ = 0;                   ///< Size of the mapping.
+#ifdef _WIN32
+    void* file_ = nullptr;     ///< File handle.
+    void* mapping_ = nullptr;  ///< File mapping handle.
+#endif
+  };
+
+  FileMapping mapping_;         ///< The mapped file.
+  ParameterSnapshotView view_;  ///< The view of the mapping.
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+/**
+ * @class ParameterValueStore
+ * @brief Parameter values that can be read from any thread without locking.
+ *
+ * `EthernetDevice::findParameter` hands out references into the parameter
+ * store of the device, whose values the I/O thread rewrites in place, so
+ * reading them from UI or logging threads races with it. The value store
+ * keeps a copy of each value behind a sequence lock instead: a writer makes
+ * the sequence of the value odd, stores the bytes and makes it even again; a
+ * reader copies the bytes between two reads of the sequence and retries if
+ * they differ or are odd. Readers never take a lock and never hold up a
+ * writer; writers only wait for other writers of the same value.
+ *
+ * The parameters and the capacity of each value are fixed on construction,
+ * so the lookup table is never modified afterwards and publishing never
+ * allocates.
+ *
+ * Only values published into the store are covered. A `PollScheduler` with
+ * `setValueStore` publishes the values it polls, and nothing else does:
+ * values moved by SDO uploads and downloads, by PDO exchanges or by
+ * `loadParameters` reach the store only if the caller publishes them, and
+ * publishing never updates the parameter store of the device.
+ *
+ * @code
+ * ParameterValueStore values(device.getParameters());
+ * scheduler.setValueStore(&values);
+ * // On any thread
+ * auto position = values.getValue<int32_t>(0x6064, 0x00);
+ * @endcode
+ */
+class ParameterValueStore {
+ public:
+  /**
+   * @brief Constructs a store holding the given parameters and their current
+   * values.
+   *
+   * The capacity of each value is the largest of its current size, its byte
+   * length and its bit length rounded up to bytes.
+   *
+   * @param parameters The parameters to hold.
+   */
+  explicit ParameterValueStore(std::span<const common::Parameter> parameters);
+
+  ParameterValueStore(const ParameterValueStore&) = delete;
+  ParameterValueStore& operator=(const ParameterValueStore&) = delete;
+
+  /**
+   * @brief Returns the number of parameters in the store.
+   */
+  size_t size() const noexcept { return parameters_.size(); }
+
+  /**
+   * @brief Checks whether the store holds a parameter.
+   */
+  bool contains(uint16_t index, uint8_t subindex) const {
+    return slots_.count({index, subindex}) != 0;
+  }
+
+  /**
+   * @brief Replaces the value of a parameter.
+   *
+   * @param index The index of the parameter.
+   * @param subindex The subindex of the parameter.
+   * @param value The new value.
+   *
+   * @throws std::runtime_error If the store does not hold the parameter or
+   * the value exceeds its capacity.
+   */
+  void publish(uint16_t index, uint8_t subindex,
+               std::span<const uint8_t> value);
+
+  /**
+   * @brief Replaces the value of a parameter with the value of a parameter
+   * from the device.
+   *
+   * @see publish(uint16_t, uint8_t, std::span<const uint8_t>)
+   */
+  void publish(const common::Parameter& parameter) {
+    publish(parameter.index, parameter.subindex, parameter.data);
+  }
+
+  /**
+   * @brief Returns how often the value of a parameter was published.
+   *
+   * Cheap enough to poll, so a reader can skip copying a value that has not
+   * changed since it last read it.
+   *
+   * @throws std::runtime_error If the store does not hold the parameter.
+   */
+  uint64_t version(uint16_t index, uint8_t subindex) const;
+
+  /**
+   * @brief Copies a consistent value of a parameter.
+   *
+   * @param index The index of the parameter.
+   * @param subindex The subindex of the parameter.
+   * @param data Receives the value; its capacity is reused.
+   *
+   * @return The version of the copied value.
+   *
+   * @throws std::runtime_error If the store does not hold the parameter.
+   */
+  uint64_t read(uint16_t index, uint8_t subindex,
+                std::vector<uint8_t>& data) const;
+
+  /**
+   * @brief Returns a copy of a parameter with a consistent value.
+   *
+   * @throws std::runtime_error If the store does not hold the parameter.
+   */
+  common::Parameter parameter(uint16_t index, uint8_t subindex) const;
+
+  /**
+   * @brief Returns the value of a parameter as the given type.
+   *
+   * @tparam T The type to retrieve, as for `common::Parameter::getValue`.
+   *
+   * @throws std::runtime_error If the store does not hold the parameter.
+   * @throws std::bad_variant_access If `T` does not match the data type of
+   * the parameter.
+   */
+  template <typename T>
+  T getValue(uint16_t index, uint8_t subindex) const {
+    return parameter(index, subindex).getValue<T>();
+  }
+
+ private:
+  /**
+   * @brief The sequence lock and location of one value.
+   *
+   * Each slot has a cache line of its own, so that writers of different
+   * values do not invalidate each other's sequence.
+   */
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> sequence{0};  ///< Odd while a write is under way.
+    std::atomic<uint32_t> size{0};      ///< Size of the value in bytes.
+    uint32_t capacity = 0;              ///< Capacity of the value in bytes.
+    size_t offset = 0;                  ///< First word of the value.
+    size_t parameter = 0;               ///< Position in `parameters_`.
+  };
+
+  /**
+   * @brief Returns the position of the slot of a parameter.
+   *
+   * @throws std::runtime_error If the store does not hold the parameter.
+   */
+  size_t position(uint16_t index, uint8_t subindex) const;
+
+  /**
+   * @brief Stores a value into the words of a slot. The caller must hold
+   * the slot, or be the only thread using the store.
+   */
+  void store(Slot& slot, std::span<const uint8_t> value);
+
+  /**
+   * @brief Copies the value of a slot, retrying until the copy is
+   * consistent, and returns its version.
+   */
+  uint64_t copy(const Slot& slot, std::vector<uint8_t>& data) const;
+
+  std::vector<common::Parameter>
+      parameters_;  ///< Descriptions of the parameters, without values.
+  std::unordered_map<common::ParameterKey, size_t>
+      slots_;  ///< Position of the slot of each parameter.
+  std::unique_ptr<Slot[]> slotStorage_;  ///< One slot per parameter.
+  std::unique_ptr<std::atomic<uint64_t>[]>
+      words_;  ///< The values, word by word.
+};
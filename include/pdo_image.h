@@ -0,0 +1,166 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "common.h"
+
+/**
+ * @struct PdoImageEntry
+ * @brief Location of a mapped object inside a process data image.
+ */
+struct PdoImageEntry {
+  uint16_t index;     ///< The object dictionary index (e.g., 0x607A).
+  uint8_t subindex;   ///< The subindex of the object.
+  uint8_t bitLength;  ///< The size of the object in bits.
+  size_t bitOffset;   ///< The offset of the first bit in the image.
+
+  /** The offset of the first byte the entry occupies. */
+  size_t byteOffset() const noexcept { return bitOffset / 8; }
+
+  /** The number of bytes the entry touches. */
+  size_t byteLength() const noexcept {
+    return (bitOffset % 8 + bitLength + 7) / 8;
+  }
+};
+
+/**
+ * @brief Computes where each mapped object lies in the process data image.
+ *
+ * The entries are laid out in mapping order and packed at exact bit offsets,
+ * the way the device lays out the image. Entries shorter than a byte, such as
+ * the `BIT1` to `BIT16` types of digital inputs and status bits, therefore
+ * share bytes with their neighbors instead of being rounded up to whole
+ * bytes.
+ *
+ * @param pdos The mapped entries of one direction, in mapping order.
+ *
+ * @return The image entries, in mapping order.
+ */
+std::vector<PdoImageEntry> layoutPdoImage(
+    const std::vector<common::PdoMappingEntry>& pdos);
+
+/**
+ * @brief Returns the size of the image in bytes.
+ *
+ * @param entries The image entries returned by `layoutPdoImage`.
+ */
+size_t pdoImageSize(const std::vector<PdoImageEntry>& entries) noexcept;
+
+/**
+ * @brief Checks whether a mapping has exactly the expected entries.
+ *
+ * The first difference is logged.
+ *
+ * @param expected The expected image entries, in mapping order.
+ * @param pdos The mapped entries of one direction, in mapping order.
+ *
+ * @return `true` if index, subindex and bit length match entry by entry.
+ */
+bool matchesPdoMapping(std::span<const PdoImageEntry> expected,
+                       const std::vector<common::PdoMappingEntry>& pdos);
+
+/**
+ * @brief Reads the raw bits of an entry out of a process data image.
+ *
+ * The bytes holding the entry are loaded as one little-endian word, shifted
+ * and masked, instead of being assembled bit by bit.
+ *
+ * @param image The process data image.
+ * @param entry The entry to read. At most 64 bits long.
+ *
+ * @return The bits of the entry, right-aligned.
+ */
+uint64_t readPdoBits(std::span<const uint8_t> image,
+                     const PdoImageEntry& entry) noexcept;
+
+/**
+ * @brief Writes the raw bits of an entry into a process data image.
+ *
+ * Bits of neighboring entries that share bytes with this one are preserved.
+ *
+ * @param image The process data image.
+ * @param entry The entry to write. At most 64 bits long.
+ * @param bits The bits to write, right-aligned. Higher bits are ignored.
+ */
+void writePdoBits(std::span<uint8_t> image, const PdoImageEntry& entry,
+                  uint64_t bits) noexcept;
+
+/**
+ * @brief Reads the raw bits of every entry out of a process data image.
+ *
+ * @param image The process data image.
+ * @param entries The image entries returned by `layoutPdoImage`.
+ * @param values Receives the bits of each entry, in the order of `entries`.
+ */
+void unpackPdoImage(std::span<const uint8_t> image,
+                    std::span<const PdoImageEntry> entries,
+                    std::span<uint64_t> values) noexcept;
+
+/**
+ * @brief Writes the raw bits of every entry into a process data image.
+ *
+ * @param values The bits of each entry, in the order of `entries`.
+ * @param entries The image entries returned by `layoutPdoImage`.
+ * @param image The process data image.
+ */
+void packPdoImage(std::span<const uint64_t> values,
+                  std::span<const PdoImageEntry> entries,
+                  std::span<uint8_t> image) noexcept;
+
+/**
+ * @brief Reads the value of an entry out of a process data image.
+ *
+ * Signed integers shorter than `T` are sign-extended from their bit length.
+ *
+ * @tparam T The arithmetic type of the object.
+ * @param image The process data image.
+ * @param entry The entry to read.
+ *
+ * @return The value of the entry.
+ */
+template <typename T>
+T readPdoValue(std::span<const uint8_t> image, const PdoImageEntry& entry) {
+  static_assert(std::is_arithmetic_v<T>, "T must be an arithmetic type");
+
+  uint64_t bits = readPdoBits(image, entry);
+  if constexpr (std::is_same_v<T, float>) {
+    return std::bit_cast<float>(static_cast<uint32_t>(bits));
+  } else if constexpr (std::is_same_v<T, double>) {
+    return std::bit_cast<double>(bits);
+  } else if constexpr (std::is_signed_v<T>) {
+    if (entry.bitLength == 0 || entry.bitLength >= 64) {
+      return static_cast<T>(bits);
+    }
+    const unsigned shift = 64 - entry.bitLength;
+    return static_cast<T>(static_cast<int64_t>(bits << shift) >> shift);
+  } else {
+    return static_cast<T>(bits);
+  }
+}
+
+/**
+ * @brief Writes the value of an entry into a process data image.
+ *
+ * @tparam T The arithmetic type of the object.
+ * @param image The process data image.
+ * @param entry The entry to write.
+ * @param value The value to write. It is truncated to the bit length.
+ */
+template <typename T>
+void writePdoValue(std::span<uint8_t> image, const PdoImageEntry& entry,
+                   T value) {
+  static_assert(std::is_arithmetic_v<T>, "T must be an arithmetic type");
+
+  if constexpr (std::is_same_v<T, float>) {
+    writePdoBits(image, entry, std::bit_cast<uint32_t>(value));
+  } else if constexpr (std::is_same_v<T, double>) {
+    writePdoBits(image, entry, std::bit_cast<uint64_t>(value));
+  } else {
+    writePdoBits(image, entry, static_cast<uint64_t>(value));
+  }
+}
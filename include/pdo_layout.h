@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "pdo_image.h"
+
+/**
+ * @brief Describes one mapped object of a `PdoLayout` at compile time.
+ *
+ * @tparam Index The object dictionary index (e.g., 0x607A).
+ * @tparam Subindex The subindex of the object.
+ * @tparam T The arithmetic type the object is accessed as.
+ * @tparam BitLength The size of the object in the image, in bits. Defaults to
+ * the size of `T`.
+ */
+template <uint16_t Index, uint8_t Subindex, typename T,
+          uint8_t BitLength = sizeof(T) * 8>
+struct PdoEntry {
+  static_assert(std::is_arithmetic_v<T>, "T must be an arithmetic type");
+  static_assert(BitLength > 0 && BitLength <= sizeof(T) * 8,
+                "BitLength must fit into T");
+
+  using type = T;  ///< The type the object is accessed as.
+
+  static constexpr uint16_t kIndex = Index;         ///< The index.
+  static constexpr uint8_t kSubindex = Subindex;    ///< The subindex.
+  static constexpr uint8_t kBitLength = BitLength;  ///< The size in bits.
+};
+
+/**
+ * @class PdoLayout
+ * @brief Process data image layout known at compile time.
+ *
+ * For a fixed machine configuration, the objects mapped into a PDO direction
+ * can be listed as `PdoEntry` types, for example:
+ *
+ * @code
+ * using RxLayout = PdoLayout<PdoEntry<0x6040, 0, uint16_t>,  // Controlword
+ *                            PdoEntry<0x607A, 0, int32_t>>;  // Target pos.
+ * @endcode
+ *
+ * The offsets of all entries are then constants, and `pack` and `unpack`
+ * compile down to copies at fixed offsets; byte-aligned entries are plain
+ * `memcpy` calls that the compiler merges. The layout is checked once against
+ * the mapping the device actually uses with `validate`, for example the
+ * result of `readPdoMappings`.
+ *
+ * @tparam Entries The mapped objects, in mapping order.
+ */
+template <typename... Entries>
+class PdoLayout {
+ public:
+  /** The values of all entries, in mapping order. */
+  using Values = std::tuple<typename Entries::type...>;
+
+  /** The number of entries. */
+  static constexpr size_t kCount = sizeof...(Entries);
+
+  /** Where each entry lies in the image. */
+  static constexpr std::array<PdoImageEntry, kCount> kEntries = [] {
+    std::array<PdoImageEntry, kCount> entries{};
+    size_t i = 0;
+    size_t bitOffset = 0;
+    ((entries[i++] = {Entries::kIndex, Entries::kSubindex,
+                      Entries::kBitLength, bitOffset},
+      bitOffset += Entries::kBitLength),
+     ...);
+    return entries;
+  }();
+
+  /** The size of the image in bytes. */
+  static constexpr size_t kSize = ((Entries::kBitLength + ... + 0) + 7) / 8;
+
+  /**
+   * @brief Reads one entry out of an image.
+   *
+   * @tparam I The position of the entry in the layout.
+   * @param image The image. It must hold at least `kSize` bytes.
+   *
+   * @return The value of the entry.
+   */
+  template <size_t I>
+  static std::tuple_element_t<I, Values> get(std::span<const uint8_t> image) {
+    using T = std::tuple_element_t<I, Values>;
+    constexpr PdoImageEntry entry = kEntries[I];
+
+    if constexpr (isByteAligned(entry, sizeof(T))) {
+      T value;
+      std::memcpy(&value, image.data() + entry.byteOffset(), sizeof(T));
+      return value;
+    } else {
+      return readPdoValue<T>(image, entry);
+    }
+  }
+
+  /**
+   * @brief Writes one entry into an image.
+   *
+   * @tparam I The position of the entry in the layout.
+   * @param image The image. It must hold at least `kSize` bytes.
+   * @param value The value of the entry.
+   */
+  template <size_t I>
+  static void set(std::span<uint8_t> image,
+                  std::tuple_element_t<I, Values> value) {
+    using T = std::tuple_element_t<I, Values>;
+    constexpr PdoImageEntry entry = kEntries[I];
+
+    if constexpr (isByteAligned(entry, sizeof(T))) {
+      std::memcpy(image.data() + entry.byteOffset(), &value, sizeof(T));
+    } else {
+      writePdoValue<T>(image, entry, value);
+    }
+  }
+
+  /**
+   * @brief Writes all entries into an image.
+   *
+   * @param values The values of the entries.
+   * @param image The image. It must hold at least `kSize` bytes.
+   */
+  static void pack(const Values& values, std::span<uint8_t> image) {
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      (set<I>(image, std::get<I>(values)), ...);
+    }(std::make_index_sequence<kCount>{});
+  }
+
+  /**
+   * @brief Reads all entries out of an image.
+   *
+   * @param image The image. It must hold at least `kSize` bytes.
+   *
+   * @return The values of the entries.
+   */
+  static Values unpack(std::span<const uint8_t> image) {
+    return [&]<size_t... I>(std::index_sequence<I...>) {
+      return Values{get<I>(image)...};
+    }(std::make_index_sequence<kCount>{});
+  }
+
+  /**
+   * @brief Checks the layout against the mapping the device uses.
+   *
+   * Meant to be called once at startup; a mismatch is logged.
+   *
+   * @param pdos The mapped entries of the direction, in mapping order.
+   *
+   * @return `true` if the mapping matches the layout entry by entry.
+   */
+  static bool validate(const std::vector<common::PdoMappingEntry>& pdos) {
+    return matchesPdoMapping(kEntries, pdos);
+  }
+
+ private:
+  static constexpr bool isByteAligned(const PdoImageEntry& entry,
+                                      size_t size) {
+    return entry.bitOffset % 8 == 0 && entry.bitLength == size * 8;
+  }
+};
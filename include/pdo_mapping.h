@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+
+#include "common.h"
+#include "ethernet_connection.h"
+
+/**
+ * @brief Reads the PDO mapping of a device.
+ *
+ * Reads the PDO assignment objects 0x1C12 (RxPDOs) and 0x1C13 (TxPDOs) and
+ * the mapping objects they assign. This is the same mapping
+ * `EthernetDevice` uses internally, which it does not expose. The objects are
+ * read in a few pipelined batches rather than one round trip each.
+ *
+ * @param connection The connection to the device.
+ * @param expiryTime The duration to wait for each batch of SDO reads.
+ * Defaults to 1000 milliseconds.
+ *
+ * @return The mapped entries, in mapping order.
+ *
+ * @throws std::runtime_error If an SDO cannot be read.
+ */
+common::PdoMappings readPdoMappings(
+    EthernetConnection& connection,
+    const std::chrono::steady_clock::duration expiryTime =
+        std::chrono::milliseconds(1000));
+
+/**
+ * @brief Decodes a UI PDO mapping into mapped entries.
+ *
+ * @param mapping The mapping, with each entry encoded as
+ * `index << 16 | subindex << 8 | bitLength`.
+ *
+ * @return The mapped entries, in mapping order.
+ */
+common::PdoMappings toPdoMappings(const common::UiPdoMapping& mapping);
+
+/**
+ * @brief Applies a PDO mapping to a device.
+ *
+ * The current mapping is read first and compared with the desired one. Only
+ * the PDOs whose entries differ are remapped, and the assignment objects are
+ * only rewritten if the set of assigned PDOs changed. Applying an unchanged
+ * mapping writes nothing.
+ *
+ * The writes are sent as four pipelined batches, each only once every write
+ * of the previous one succeeded: clearing the counts (subindex 0) of the
+ * assignments and remapped PDOs, writing the entries, restoring the PDO
+ * counts and restoring the assignment counts. A count is thus never restored
+ * over entries that failed to write, and the error names the objects left
+ * cleared.
+ *
+ * The device must be in a state that allows remapping, usually PRE-OP.
+ *
+ * @param connection The connection to the device.
+ * @param mapping The desired mapping, keyed by the PDO index.
+ * @param expiryTime The duration to wait for each batch of SDO accesses.
+ * Defaults to 1000 milliseconds.
+ *
+ * @return The mapping now in effect on the device.
+ *
+ * @throws std::runtime_error If an SDO cannot be read or written.
+ */
+common::PdoMappings applyPdoMapping(
+    EthernetConnection& connection, const common::UiPdoMapping& mapping,
+    const std::chrono::steady_clock::duration expiryTime =
+        std::chrono::milliseconds(1000));
+
+/**
+ * @brief Writes a PDO mapping to a device.
+ *
+ * Unlike `applyPdoMapping`, the current mapping is not read: every PDO of
+ * the mapping is remapped and both assignment objects are rewritten. The
+ * writes go through the same four steps, sent one write at a time, and a
+ * step is only started once every write of the previous one succeeded.
+ *
+ * The device must be in a state that allows remapping, usually PRE-OP.
+ *
+ * @param device The device.
+ * @param mapping The mapping, keyed by the PDO index.
+ * @param expiryTime The duration to wait for each SDO write. Defaults to
+ * 1000 milliseconds.
+ *
+ * @throws std::runtime_error If an SDO cannot be written.
+ */
+void writePdoMapping(EthernetDevice& device,
+                     const common::UiPdoMapping& mapping,
+                     const std::chrono::steady_clock::duration expiryTime =
+                         std::chrono::milliseconds(1000));
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "common.h"
+#include "pdo_image.h"
+
+/**
+ * @struct PdoDeadband
+ * @brief Minimum change of a value before a subscriber is notified.
+ *
+ * The change is measured against the value last reported to the subscriber,
+ * so slow drifts are reported once they add up to the deadband.
+ */
+struct PdoDeadband {
+  /** How the deadband is measured. */
+  enum class Kind : uint8_t {
+    NONE,      ///< Every change is reported.
+    ABSOLUTE,  ///< Changes by more than `value` units are reported.
+    PERCENT,   ///< Changes by more than `value` percent are reported.
+  };
+
+  Kind kind = Kind::NONE;  ///< How the deadband is measured.
+  double value = 0.0;      ///< The width of the deadband.
+
+  /** Returns a deadband of `value` units. */
+  static PdoDeadband absolute(double value) { return {Kind::ABSOLUTE, value}; }
+
+  /** Returns a deadband of `value` percent of the last reported value. */
+  static PdoDeadband percent(double value) { return {Kind::PERCENT, value}; }
+};
+
+/**
+ * @class PdoSubscriptions
+ * @brief Notifies subscribers about changes of TxPDO-mapped values.
+ *
+ * Each received TxPDO image is handed to `update`. Instead of decoding every
+ * mapped object and comparing it with its previous value, `update` first
+ * compares the whole image with the previous one 64 bits at a time. Only
+ * subscriptions whose bytes lie in a changed word are decoded and checked
+ * against their deadband, so an unchanged image costs little more than a
+ * `memcmp`.
+ */
+class PdoSubscriptions {
+ public:
+  /** Identifies a subscription. */
+  using Handle = size_t;
+
+  /**
+   * @brief Constructs the subscriptions for a TxPDO mapping.
+   *
+   * @param txPdos The mapped TxPDO entries, in mapping order.
+   */
+  explicit PdoSubscriptions(const std::vector<common::PdoMappingEntry>& txPdos);
+
+  /**
+   * @brief Subscribes to changes of a mapped object.
+   *
+   * The callback is called from `update` with the new value, first for the
+   * initial value and then whenever the value leaves the deadband around the
+   * value last reported. If an image has already been received, the initial
+   * value is reported from `subscribe` instead, before it returns.
+   *
+   * @tparam T The arithmetic type of the object.
+   * @param index The index of the object.
+   * @param subindex The subindex of the object.
+   * @param deadband The deadband of the subscription.
+   * @param callback The callback to notify.
+   *
+   * @return The handle of the subscription.
+   *
+   * @throws std::runtime_error If the object is not mapped as TxPDO.
+   */
+  template <typename T>
+  Handle subscribe(uint16_t index, uint8_t subindex, PdoDeadband deadband,
+                   std::function<void(T)> callback) {
+    static_assert(std::is_arithmetic_v<T>, "T must be an arithmetic type");
+    return add(index, subindex, deadband,
+               [](std::span<const uint8_t> image, const PdoImageEntry& entry) {
+                 return static_cast<double>(readPdoValue<T>(image, entry));
+               },
+               [callback = std::move(callback)](
+                   std::span<const uint8_t> image, const PdoImageEntry& entry) {
+                 callback(readPdoValue<T>(image, entry));
+               });
+  }
+
+  /**
+   * @brief Cancels a subscription.
+   *
+   * @param handle The handle returned by `subscribe`.
+   */
+  void unsubscribe(Handle handle);
+
+  /**
+   * @brief Compares a received TxPDO image with the previous one and notifies
+   * the subscribers of the values that changed.
+   *
+   * @param image The received TxPDO image.
+   */
+  void update(std::span<const uint8_t> image);
+
+ private:
+  using Decoder = double (*)(std::span<const uint8_t>, const PdoImageEntry&);
+  using Notifier =
+      std::function<void(std::span<const uint8_t>, const PdoImageEntry&)>;
+
+  /**
+   * @brief A subscription.
+   */
+  struct Subscription {
+    PdoImageEntry entry;   ///< Where the object lies in the image.
+    PdoDeadband deadband;  ///< The deadband of the subscription.
+    Decoder decode;        ///< Reads the value for the deadband check.
+    Notifier notify;       ///< Calls the subscriber with the typed value.
+    size_t firstWord;      ///< The first 64-bit word of the image touched.
+    size_t lastWord;       ///< The last 64-bit word of the image touched.
+    double reported = 0.0;  ///< The value last reported.
+    bool active = true;     ///< `false` once unsubscribed.
+  };
+
+  /**
+   * @brief Adds a type-erased subscription.
+   */
+  Handle add(uint16_t index, uint8_t subindex, PdoDeadband deadband,
+             Decoder decode, Notifier notify);
+
+  /**
+   * @brief Returns whether a value left the deadband around the value last
+   * reported.
+   */
+  static bool exceeds(const Subscription& subscription, double value);
+
+  std::vector<PdoImageEntry> entries_;        ///< Layout of the TxPDO image.
+  std::vector<Subscription> subscriptions_;  ///< Indexed by handle.
+  std::vector<uint8_t> previous_;            ///< The previous image.
+  std::vector<uint64_t> changedWords_;       ///< Bitmap of changed words.
+  bool initialized_ = false;                 ///< Whether an image was seen.
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ethernet_client.h"
+#include "ethernet_connection.h"
+#include "parameter_value_store.h"
+
+/**
+ * @class PollScheduler
+ * @brief Polls parameters at individual rates over one pipelined connection.
+ *
+ * Every registered parameter is read once per period. A single worker thread
+ * wakes up when the earliest poll is due, collects every poll that falls due
+ * within the coalescing window, and reads them as one pipelined SDO burst with
+ * `EthernetConnection::readSdos`. The values are kept by the scheduler, where
+ * `value` returns them, and optionally published into a `ParameterValueStore`
+ * for lock-free readers.
+ *
+ * The worker thread never touches the parameter store of the
+ * `EthernetDevice`, which is not safe to modify while other threads use the
+ * device; `apply` copies the latest values into it on the calling thread.
+ *
+ * Newly registered polls are spread over their period with a low-discrepancy
+ * phase offset, so that parameters with the same rate do not all fall due at
+ * the same instant and the load on the device stays even.
+ */
+class PollScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Constructs a scheduler. Polling starts with `start`.
+   *
+   * @param connection The connection to read the parameters with.
+   * @param device The device whose parameter store `apply` copies the values
+   * into.
+   * @param coalesceWindow Polls falling due within this window of the
+   * earliest one are read in the same burst. Defaults to 5 milliseconds.
+   */
+  PollScheduler(EthernetConnection& connection, EthernetDevice& device,
+                Clock::duration coalesceWindow = std::chrono::milliseconds(5));
+
+  /**
+   * @brief Stops polling.
+   */
+  ~PollScheduler();
+
+  PollScheduler(const PollScheduler&) = delete;
+  PollScheduler& operator=(const PollScheduler&) = delete;
+
+  /**
+   * @brief Registers a parameter to poll, or changes the period of one that
+   * is already registered.
+   *
+   * @param index The index of the parameter.
+   * @param subindex The subindex of the parameter.
+   * @param period The polling period.
+   *
+   * @throws std::invalid_argument If the period is not positive.
+   */
+  void add(uint16_t index, uint8_t subindex, Clock::duration period);
+
+  /**
+   * @brief Stops polling a parameter.
+   *
+   * @param index The index of the parameter.
+   * @param subindex The subindex of the parameter.
+   */
+  void remove(uint16_t index, uint8_t subindex);
+
+  /**
+   * @brief Also publishes the polled values into a value store.
+   *
+   * Values of parameters the store does not hold are skipped. Must be called
+   * before `start`.
+   *
+   * @param store The store, or `nullptr` to stop publishing. It must outlive
+   * the scheduler.
+   */
+  void setValueStore(ParameterValueStore* store) noexcept { store_ = store; }
+
+  /**
+   * @brief Returns the latest polled value of a parameter.
+   *
+   * @param index The index of the parameter.
+   * @param subindex The subindex of the parameter.
+   * @param data Receives the value.
+   *
+   * @return `false` if the parameter is not registered or has not been read
+   * yet; `data` is left unchanged then.
+   */
+  bool value(uint16_t index, uint8_t subindex,
+             std::vector<uint8_t>& data) const;
+
+  /**
+   * @brief Copies the values polled since the last call into the parameter
+   * store of the device.
+   *
+   * Must be called on the thread that uses the device, or with the device
+   * otherwise protected from concurrent use.
+   *
+   * @return The number of parameters updated.
+   */
+  size_t apply();
+
+  /**
+   * @brief Starts the worker thread.
+   */
+  void start();
+
+  /**
+   * @brief Stops the worker thread and waits for it to finish.
+   */
+  void stop();
+
+  /**
+   * @brief Reads every poll that is due now as one burst.
+   *
+   * Used by the worker thread; can also be called directly to drive the
+   * scheduler from an existing loop instead of starting the thread. Calls
+   * made while the worker runs wait for its current burst.
+   *
+   * @return The time at which the next poll falls due.
+   */
+  Clock::time_point pollDue();
+
+ private:
+  /**
+   * @brief A registered poll.
+   */
+  struct Poll {
+    uint16_t index;           ///< The index of the parameter.
+    uint8_t subindex;         ///< The subindex of the parameter.
+    Clock::duration period;   ///< The polling period.
+    Clock::time_point due;    ///< When the next read falls due.
+    std::vector<uint8_t> value;  ///< The latest value read.
+    bool read = false;           ///< Whether `value` holds a value.
+    bool applied = false;        ///< Whether `apply` copied `value`.
+  };
+
+  /**
+   * @brief Worker thread body.
+   */
+  void run();
+
+  /**
+   * @brief Returns the time at which the earliest poll falls due.
+   */
+  Clock::time_point nextDue() const;
+
+  EthernetConnection& connection_;  ///< Transport for the reads.
+  EthernetDevice& device_;          ///< Target of `apply`.
+  Clock::duration coalesceWindow_;  ///< Window merged into one burst.
+  ParameterValueStore* store_ = nullptr;  ///< Lock-free copy of the values.
+
+  mutable std::mutex mutex_;          ///< Guards the members below.
+  std::condition_variable condition_;  ///< Wakes up the worker thread.
+  std::vector<Poll> polls_;            ///< The registered polls.
+  uint64_t registrations_ = 0;         ///< Source of the phase offsets.
+  bool running_ = false;               ///< Whether the worker should run.
+  std::thread worker_;                 ///< The worker thread.
+
+  std::mutex burstMutex_;               ///< Guards the members below.
+  std::vector<SdoTransfer> transfers_;  ///< Transfers of the current burst.
+  std::vector<uint8_t> values_;         ///< Receive buffers of the burst.
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ethernet_client.h"
+#include "state_waiter.h"
+
+/**
+ * @class StateSequencer
+ * @brief Drives many devices through a sequence of EtherCAT states at once.
+ *
+ * Every device gets its own thread, which for each state of the sequence
+ * runs the hooks registered to run before the transition, requests the
+ * state, waits for the device to reach it with a shared `StateWaiter`, and
+ * runs the hooks registered to run after it. Devices do not wait for each
+ * other unless an ordering is declared with `order`, so a line comes up as
+ * fast as its slowest device rather than the sum of all devices.
+ *
+ * Each stage is timed per device, split into the time spent waiting for
+ * other devices, running hooks and performing the transition; the report
+ * shows which device holds the line back at which stage. A device whose
+ * transition or hook fails stops at that stage, and devices ordered after
+ * it fail as well.
+ *
+ * @code
+ * StateSequencer sequencer;
+ * const size_t master = sequencer.add(masterDrive);
+ * const size_t slave = sequencer.add(slaveDrive);
+ * sequencer.addHook(0x04, StateSequencer::HookPoint::BEFORE,
+ *                   [](size_t, EthernetDevice& device) {
+ *                     mapping.apply(device);
+ *                   });
+ * sequencer.order(master, 0x08, slave, 0x08);
+ * auto report = sequencer.run(Clock::now() + std::chrono::seconds(30));
+ * LOG_F(INFO, "%s", formatSequencerReport(report).c_str());
+ * @endcode
+ */
+class StateSequencer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /** When a hook runs relative to the transition into its state. */
+  enum class HookPoint : uint8_t {
+    BEFORE,  ///< Before the state is requested.
+    AFTER,   ///< After the device reached the state.
+  };
+
+  /**
+   * @brief Runs on the thread of a device during a stage.
+   *
+   * Receives the number of the device as returned by `add` and the device.
+   * Throwing fails the device at that stage.
+   */
+  using Hook = std::function<void(size_t index, EthernetDevice& device)>;
+
+  /**
+   * @struct Options
+   * @brief Configures a `StateSequencer`.
+   */
+  struct Options {
+    std::vector<uint8_t> states{0x01, 0x02, 0x04,
+                                0x08};  ///< The states to go through.
+    Clock::duration stageTimeout =
+        std::chrono::seconds(10);  ///< Time a transition may take.
+    Clock::duration requestTimeout =
+        std::chrono::milliseconds(3000);  ///< Timeout of a state request.
+  };
+
+  /**
+   * @struct StageTiming
+   * @brief How one device spent one stage.
+   */
+  struct StageTiming {
+    uint8_t state = 0;             ///< The state of the stage.
+    bool completed = false;        ///< Whether the stage completed.
+    Clock::duration ordering{};    ///< Waiting for other devices.
+    Clock::duration hooks{};       ///< Running the hooks.
+    Clock::duration transition{};  ///< Requesting and reaching the state.
+
+    /** Returns the whole time spent in the stage. */
+    Clock::duration total() const noexcept {
+      return ordering + hooks + transition;
+    }
+  };
+
+  /**
+   * @struct DeviceReport
+   * @brief The outcome of the sequence for one device.
+   */
+  struct DeviceReport {
+    std::vector<StageTiming> stages;  ///< The stages started, in order.
+    bool success = false;             ///< Whether all stages completed.
+    std::string error;                ///< Why the device failed.
+  };
+
+  /**
+   * @struct Report
+   * @brief The outcome of a whole sequence.
+   */
+  struct Report {
+    std::vector<DeviceReport> devices;  ///< One report per device.
+    Clock::duration total{};            ///< Duration of the whole run.
+    bool success = false;               ///< Whether all devices succeeded.
+
+    /**
+     * @brief Returns the number of the device that spent the longest time
+     * in a stage, or the number of devices if no device started it.
+     *
+     * @param stage The position of the stage in the sequence.
+     */
+    size_t slowest(size_t stage) const noexcept;
+  };
+
+  /**
+   * @brief Constructs a sequencer with the default sequence INIT, PRE-OP,
+   * SAFE-OP, OP.
+   */
+  StateSequencer() : StateSequencer(Options{}) {}
+
+  /**
+   * @brief Constructs a sequencer.
+   *
+   * @param options The configuration.
+   */
+  explicit StateSequencer(const Options& options);
+
+  /**
+   * @brief Adds a device.
+   *
+   * @param device The device. It must be connected and outlive the
+   * sequencer.
+   *
+   * @return The number of the device, counting from 0.
+   */
+  size_t add(EthernetDevice& device);
+
+  /**
+   * @brief Registers a hook that runs for every device at a stage.
+   *
+   * Hooks of the same stage and point run in the order they were added.
+   *
+   * @param state The state of the stage.
+   * @param point Whether the hook runs before or after the transition.
+   * @param hook The hook.
+   */
+  void addHook(uint8_t state, HookPoint point, Hook hook);
+
+  /**
+   * @brief Declares that a device may only start a stage once another
+   * device has completed one.
+   *
+   * @param first The device that has to complete a stage first.
+   * @param firstState The state of that stage.
+   * @param then The device that waits.
+   * @param thenState The state of the stage that waits.
+   *
+   * @throws std::invalid_argument If a device or state is unknown.
+   */
+  void order(size_t first, uint8_t firstState, size_t then,
+             uint8_t thenState);
+
+  /**
+   * @brief Drives all devices through the sequence and returns once every
+   * device has completed or failed.
+   *
+   * @param deadline The time by which the whole sequence must complete;
+   * stages still waiting for other devices then fail.
+   *
+   * @return The report.
+   *
+   * @throws std::logic_error If the declared orderings form a cycle.
+   */
+  Report run(Clock::time_point deadline);
+
+ private:
+  /** A point in the sequence: a device and the position of a stage. */
+  struct Step {
+    size_t device;  ///< The device.
+    size_t stage;   ///< The position of the stage.
+  };
+
+  /**
+   * @brief Returns the position of a state in the sequence.
+   *
+   * @throws std::invalid_argument If the state is not in the sequence.
+   */
+  size_t stageOf(uint8_t state) const;
+
+  /**
+   * @brief Throws if the orderings, together with the sequence of each
+   * device, contain a cycle.
+   */
+  void checkOrderings() const;
+
+  /**
+   * @brief Runs the sequence of one device.
+   */
+  void runDevice(size_t device, Clock::time_point deadline,
+                 DeviceReport& report);
+
+  /**
+   * @brief Waits until every step a stage is ordered after has completed.
+   *
+   * @return An empty string, or why the stage cannot start.
+   */
+  std::string awaitOrderings(size_t device, size_t stage,
+                             Clock::time_point deadline);
+
+  Options options_;                         ///< The configuration.
+  StateWaiter waiter_;                      ///< Waits for the transitions.
+  std::vector<EthernetDevice*> devices_;    ///< The devices.
+  std::vector<std::vector<Hook>> before_;   ///< Hooks per stage, before.
+  std::vector<std::vector<Hook>> after_;    ///< Hooks per stage, after.
+  std::vector<std::pair<Step, Step>>
+      orderings_;  ///< Pairs of steps; the first completes before the second.
+
+  std::mutex mutex_;                   ///< Guards the progress below.
+  std::condition_variable condition_;  ///< Signals progress.
+  std::vector<size_t> completed_;      ///< Stages completed per device.
+  std::vector<bool> failed_;           ///< Whether a device has failed.
+};
+
+/**
+ * @brief Formats a sequencer report as a table with one row per device and
+ * the time spent in each stage, marking the slowest device of each stage.
+ */
+std::string formatSequencerReport(const StateSequencer::Report& report);
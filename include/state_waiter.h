@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <span>
+
+#include "ethernet_client.h"
+#include "ethernet_connection.h"
+
+/**
+ * @class StateWaiter
+ * @brief Waits for devices to reach an EtherCAT state, polling with a
+ * backoff that adapts to how long transitions take.
+ *
+ * For every target state, the waiter keeps a moving average of how long
+ * devices took to reach it. Until that time has passed, each poll waits for
+ * half of the remaining time, so the polls close in on the expected
+ * completion instead of hammering the device; after it, the interval grows
+ * geometrically from the minimum. Without an estimate, the interval grows
+ * geometrically right away. The wait ends with the first poll that sees the
+ * target state, or that sees the error flag (0x10) set, in which case the
+ * device refused the transition.
+ *
+ * Several devices can be waited for at once. They are polled from the
+ * calling thread, each on its own schedule, and the wait ends when all of
+ * them are done. The learned estimates are shared by all threads using the
+ * same waiter.
+ *
+ * @code
+ * device.setState(0x08);
+ * if (!waitForState(device, 0x08, std::chrono::steady_clock::now() +
+ *                                     std::chrono::seconds(10))) {
+ *   LOG_F(ERROR, "Device did not reach OP");
+ * }
+ * @endcode
+ */
+class StateWaiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /** Set in the state when the device failed to perform a transition. */
+  static constexpr uint8_t kErrorFlag = 0x10;
+
+  /**
+   * @struct Options
+   * @brief Configures a `StateWaiter`.
+   */
+  struct Options {
+    Clock::duration minInterval =
+        std::chrono::milliseconds(2);  ///< Shortest interval between polls.
+    Clock::duration maxInterval =
+        std::chrono::milliseconds(200);  ///< Longest interval between polls.
+    Clock::duration requestTimeout =
+        std::chrono::milliseconds(1000);  ///< Timeout of one state request.
+    double smoothing = 0.25;  ///< Weight of a new transition time in the
+                              ///< moving average.
+  };
+
+  /**
+   * @brief Reads the state of one device, waiting at most the given time.
+   */
+  using StateReader = std::function<uint8_t(Clock::duration expiryTime)>;
+
+  /**
+   * @brief Constructs a waiter with the default configuration.
+   */
+  StateWaiter() : StateWaiter(Options{}) {}
+
+  /**
+   * @brief Constructs a waiter.
+   *
+   * @param options The configuration.
+   */
+  explicit StateWaiter(const Options& options);
+
+  /**
+   * @brief Waits for a device to reach a state.
+   *
+   * @param device The device.
+   * @param target The state to wait for.
+   * @param deadline The time by which the state must be reached.
+   *
+   * @return `true` if the device reached the state; `false` if the deadline
+   * expired or the device reported an error.
+   *
+   * @throws std::runtime_error If reading the state fails.
+   */
+  bool waitForState(EthernetDevice& device, uint8_t target,
+                    Clock::time_point deadline);
+
+  /**
+   * @brief Waits for the device of a connection to reach a state.
+   *
+   * @see waitForState(EthernetDevice&, uint8_t, Clock::time_point)
+   */
+  bool waitForState(EthernetConnection& connection, uint8_t target,
+                    Clock::time_point deadline);
+
+  /**
+   * @brief Waits for several devices to reach the same state.
+   *
+   * @param devices The devices.
+   * @param target The state to wait for.
+   * @param deadline The time by which the state must be reached.
+   * @param states If not empty, receives the last state read from each
+   * device; it must be as large as `devices`.
+   *
+   * @return `true` if all devices reached the state.
+   *
+   * @throws std::runtime_error If reading a state fails.
+   */
+  bool waitForStates(std::span<EthernetDevice* const> devices, uint8_t target,
+                     Clock::time_point deadline,
+                     std::span<uint8_t> states = {});
+
+  /**
+   * @brief Waits for several devices, given by their state readers, to reach
+   * the same state.
+   *
+   * @see waitForStates(std::span<EthernetDevice* const>, uint8_t,
+   * Clock::time_point, std::span<uint8_t>)
+   */
+  bool waitForStates(std::span<const StateReader> readers, uint8_t target,
+                     Clock::time_point deadline,
+                     std::span<uint8_t> states = {});
+
+  /**
+   * @brief Returns the learned time devices take to reach a state, or zero
+   * if no transition to it was observed yet.
+   */
+  Clock::duration expectedTransitionTime(uint8_t target) const noexcept {
+    return Clock::duration(
+        expected_[target].load(std::memory_order_relaxed));
+  }
+
+ private:
+  /**
+   * @brief Returns how long to wait before the next poll of a device.
+   *
+   * @param elapsed The time since the wait started.
+   * @param expected The learned transition time, or zero.
+   * @param overdue The number of polls made after the expected time.
+   */
+  Clock::duration nextInterval(Clock::duration elapsed,
+                               Clock::duration expected,
+                               unsigned overdue) const noexcept;
+
+  /**
+   * @brief Folds an observed transition time into the moving average.
+   */
+  void learn(uint8_t target, Clock::duration elapsed) noexcept;
+
+  Options options_;  ///< The configuration.
+  std::array<std::atomic<Clock::rep>, 256>
+      expected_{};  ///< Learned transition time per target state.
+};
+
+/**
+ * @brief Waits for a device to reach a state, sharing the learned
+ * transition times with all other callers of this function.
+ *
+ * @see StateWaiter::waitForState
+ */
+bool waitForState(EthernetDevice& device, uint8_t target,
+                  StateWaiter::Clock::time_point deadline);
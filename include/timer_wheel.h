@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class TimerWheel
+ * @brief Hierarchical timer wheel for large numbers of timeouts.
+ *
+ * Time advances in ticks. Timers due within 64 ticks sit in the slots of the
+ * first level, one slot per tick; later timers sit in coarser levels, each
+ * covering 64 times the span of the previous one, and move down a level
+ * when the wheel reaches their slot. Scheduling and cancelling are O(1), and
+ * advancing costs one step per tick plus one per expiring timer, however
+ * many timers are pending. With four levels, timers up to 2^24 ticks ahead
+ * are placed exactly; later ones wait in the last level until they are due.
+ *
+ * A timer carries a 64-bit value instead of a callback, which `advance`
+ * passes to its handler when the timer expires. The wheel is not thread
+ * safe.
+ */
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /** Identifies a scheduled timer. */
+  using TimerId = uint64_t;
+
+  /** Never returned by `schedule`. */
+  static constexpr TimerId kInvalidTimer = 0;
+
+  /**
+   * @brief Constructs an empty wheel.
+   *
+   * @param tick The resolution of the wheel. Timers expire on the first tick
+   * at or after their deadline.
+   * @param start The time of tick 0.
+   */
+  explicit TimerWheel(Clock::duration tick,
+                      Clock::time_point start = Clock::now());
+
+  /**
+   * @brief Schedules a timer.
+   *
+   * @param deadline When the timer expires. Deadlines in the past expire on
+   * the next tick.
+   * @param value The value passed to the handler on expiry.
+   *
+   * @return The id of the timer.
+   */
+  TimerId schedule(Clock::time_point deadline, uint64_t value);
+
+  /**
+   * @brief Cancels a timer.
+   *
+   * @param id The id of the timer. Ids of timers that expired or were
+   * cancelled already are ignored.
+   *
+   * @return True if the timer was pending.
+   */
+  bool cancel(TimerId id) noexcept;
+
+  /**
+   * @brief Advances the wheel to a time and expires the timers due by then.
+   *
+   * @param now The current time.
+   * @param handler Called as `handler(value)` for every expired timer, in
+   * order of their ticks. It may schedule and cancel timers.
+   */
+  template <typename Handler>
+  void advance(Clock::time_point now, Handler&& handler) {
+    const uint64_t target = tickOf(now);
+    while (current_ < target) {
+      ++current_;
+      cascade();
+
+      // Unlink one timer at a time, so that the handler may cancel others
+      // in the same slot; it cannot schedule into this slot
+      int32_t node;
+      while ((node = popSlot(current_ & kSlotMask)) != kNone) {
+        const uint64_t value = nodes_[node].value;
+        release(node);
+        handler(value);
+      }
+    }
+  }
+
+  /**
+   * @brief Returns the number of pending timers.
+   */
+  size_t size() const noexcept { return size_; }
+
+ private:
+  static constexpr int kSlotBits = 6;
+  static constexpr size_t kSlots = size_t{1} << kSlotBits;
+  static constexpr uint64_t kSlotMask = kSlots - 1;
+  static constexpr int kLevels = 4;
+  static constexpr uint64_t kMaxDelta =
+      (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+  static constexpr int32_t kNone = -1;
+
+  /**
+   * @struct Node
+   * @brief A timer, linked into the list of its slot.
+   */
+  struct Node {
+    uint64_t expiry = 0;         ///< The tick the timer expires on.
+    uint64_t value = 0;          ///< Passed to the handler.
+    int32_t previous = kNone;    ///< Previous node in the slot.
+    int32_t next = kNone;        ///< Next node in the slot, or free list.
+    uint32_t generation = 1;     ///< Distinguishes reuses of the node.
+    int16_t level = -1;          ///< Level of the slot, or -1 if free.
+    uint16_t slot = 0;           ///< The slot.
+  };
+
+  /**
+   * @brief Converts a time to the first tick at or after it.
+   */
+  uint64_t tickOf(Clock::time_point time) const noexcept;
+
+  /**
+   * @brief Links a node into the slot matching its expiry.
+   */
+  void insert(int32_t node) noexcept;
+
+  /**
+   * @brief Unlinks and returns the list of a slot.
+   */
+  int32_t takeSlot(int level, uint64_t slot) noexcept;
+
+  /**
+   * @brief Unlinks and returns the first node of a first-level slot.
+   */
+  int32_t popSlot(uint64_t slot) noexcept;
+
+  /**
+   * @brief Moves the timers of the coarser slots the current tick enters
+   * down the hierarchy.
+   */
+  void cascade() noexcept;
+
+  /**
+   * @brief Returns a node to the free list.
+   */
+  void release(int32_t node) noexcept;
+
+  Clock::duration tick_;   ///< Length of a tick.
+  Clock::time_point start_;  ///< Time of tick 0.
+  uint64_t current_ = 0;   ///< The last tick processed.
+  size_t size_ = 0;        ///< Pending timers.
+  std::vector<Node> nodes_;  ///< Timer storage.
+  int32_t free_ = kNone;   ///< First free node.
+  std::array<std::array<int32_t, kSlots>, kLevels>
+      slots_;              ///< First node of each slot.
+};
@@ -0,0 +1,389 @@
+#include "async_log.h"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace {
+
+/** Whether the current thread is the flusher thread of the sink. */
+thread_local bool t_isFlusher = false;
+
+/** Longest line a deferred message is formatted into. */
+constexpr size_t kLineSize = 1024;
+
+/** Origin of the uptime in preambles; loguru's own is set at load as well. */
+const auto startTime = std::chrono::steady_clock::now();
+
+/**
+ * @brief Returns a monotonic time in nanoseconds.
+ *
+ * Rate-limit windows last about a second, so on Linux the coarse clock,
+ * which is several times cheaper to read, is precise enough.
+ */
+int64_t nowNanoseconds() noexcept {
+#ifdef CLOCK_MONOTONIC_COARSE
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return int64_t{now.tv_sec} * 1000000000 + now.tv_nsec;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+}  // namespace
+
+bool AsyncLogRateLimit::allow() noexcept {
+  const int64_t now = nowNanoseconds();
+  int64_t start = windowStart_.load(std::memory_order_relaxed);
+  if (now - start >= window_ &&
+      windowStart_.compare_exchange_strong(start, now,
+                                           std::memory_order_relaxed)) {
+    count_.store(0, std::memory_order_relaxed);
+  }
+
+  if (count_.fetch_add(1, std::memory_order_relaxed) < burst_) {
+    return true;
+  }
+  suppressed_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+std::atomic<AsyncLogSink*> AsyncLogSink::active_{nullptr};
+
+AsyncLogSink::AsyncLogSink() : AsyncLogSink(Options{}) {}
+
+AsyncLogSink::AsyncLogSink(const Options& options)
+    : options_(options), stderrVerbosity_(loguru::g_stderr_verbosity) {
+  const size_t capacity = std::bit_ceil(std::max<size_t>(options.capacity, 2));
+  slots_ = std::make_unique<Slot[]>(capacity);
+  for (size_t i = 0; i < capacity; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  mask_ = capacity - 1;
+
+  callSites_ = std::make_unique<AsyncLogRateLimit[]>(kCallSiteCount);
+
+  if (options.path.empty()) {
+    output_ = stderr;
+  } else {
+    output_ = std::fopen(options.path.c_str(), "a");
+    if (output_ == nullptr) {
+      LOG_F(ERROR, "Failed to open log file %s", options.path.c_str());
+      throw std::runtime_error("Failed to open log file " + options.path);
+    }
+    ownsOutput_ = true;
+  }
+
+  AsyncLogSink* expected = nullptr;
+  if (!active_.compare_exchange_strong(expected, this)) {
+    if (ownsOutput_) {
+      std::fclose(output_);
+    }
+    throw std::runtime_error("An asynchronous log sink already exists");
+  }
+
+  running_ = true;
+  flusher_ = std::thread(&AsyncLogSink::run, this);
+
+  callbackId_ = "async_log_sink";
+  loguru::add_callback(callbackId_.c_str(), &AsyncLogSink::onMessage, this,
+                       options.verbosity);
+  if (!ownsOutput_) {
+    loguru::g_stderr_verbosity = loguru::Verbosity_OFF;
+  }
+}
+
+AsyncLogSink::~AsyncLogSink() {
+  active_.store(nullptr, std::memory_order_release);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  wakeUp_.notify_one();
+  // The flusher's last drain logs deferred messages through loguru, which
+  // hands them back to this sink's callback
+  flusher_.join();
+
+  loguru::remove_callback(callbackId_.c_str());
+  // Messages other threads logged while the flusher was stopping
+  drain(true);
+
+  if (ownsOutput_) {
+    std::fclose(output_);
+  } else {
+    loguru::g_stderr_verbosity = stderrVerbosity_;
+  }
+}
+
+void AsyncLogSink::flush() {
+  const size_t target = tail_.load(std::memory_order_acquire);
+  std::unique_lock<std::mutex> lock(mutex_);
+  wakeUp_.notify_one();
+  drained_.wait(lock, [&] {
+    return written_.load(std::memory_order_acquire) >= target || !running_;
+  });
+}
+
+AsyncLogSink::Slot* AsyncLogSink::claim() noexcept {
+  size_t position = tail_.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot& slot = slots_[position & mask_];
+    const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    const auto distance = static_cast<intptr_t>(sequence - position);
+    if (distance == 0) {
+      if (tail_.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+        return &slot;
+      }
+    } else if (distance < 0) {
+      // The flusher has not written this slot yet: the ring is full
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      position = tail_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+const char* AsyncLogSink::threadName() noexcept {
+  thread_local char name[LOGURU_THREADNAME_WIDTH + 1] = {};
+  if (name[0] == '\0') {
+    loguru::get_thread_name(name, sizeof(name), true);
+  }
+  return name;
+}
+
+size_t AsyncLogSink::formatPreamble(const Slot& slot, char* output,
+                                    size_t size) {
+  using namespace std::chrono;
+
+  // Matches the preamble loguru writes, but with the time and thread of the
+  // call instead of those of the flusher
+  output[0] = '\0';
+  if (!loguru::g_preamble) {
+    return 0;
+  }
+  const auto age = steady_clock::now() - slot.time;
+  const auto milliseconds = duration_cast<std::chrono::milliseconds>(
+                                (system_clock::now() - age).time_since_epoch())
+                                .count();
+  const time_t seconds = static_cast<time_t>(milliseconds / 1000);
+  tm time;
+#ifdef _WIN32
+  localtime_s(&time, &seconds);
+#else
+  localtime_r(&seconds, &time);
+#endif
+  const double uptime =
+      duration_cast<std::chrono::milliseconds>(slot.time - startTime).count() /
+      1000.0;
+
+  char level[6];
+  if (const char* name = loguru::get_verbosity_name(slot.verbosity)) {
+    std::snprintf(level, sizeof(level), "%s", name);
+  } else {
+    std::snprintf(level, sizeof(level), "% 4d",
+                  static_cast<int8_t>(slot.verbosity));
+  }
+
+  size_t length = 0;
+  auto append = [&](const char* format, auto... args) {
+    if (length < size) {
+      const int written =
+          std::snprintf(output + length, size - length, format, args...);
+      length += written > 0 ? static_cast<size_t>(written) : 0;
+    }
+  };
+  if (loguru::g_preamble_date) {
+    append("%04d-%02d-%02d ", 1900 + time.tm_year, 1 + time.tm_mon,
+           time.tm_mday);
+  }
+  if (loguru::g_preamble_time) {
+    append("%02d:%02d:%02d.%03lld ", time.tm_hour, time.tm_min, time.tm_sec,
+           static_cast<long long>(milliseconds % 1000));
+  }
+  if (loguru::g_preamble_uptime) {
+    append("(%8.3fs) ", uptime);
+  }
+  if (loguru::g_preamble_thread) {
+    append("[%-*s]", LOGURU_THREADNAME_WIDTH, slot.thread);
+  }
+  if (loguru::g_preamble_file) {
+    char file[LOGURU_FILENAME_WIDTH + 1];
+    std::snprintf(file, sizeof(file), "%s", loguru::filename(slot.file));
+    append("%*s:%-5u ", LOGURU_FILENAME_WIDTH, file, slot.line);
+  }
+  if (loguru::g_preamble_verbose) {
+    append("%4s", level);
+  }
+  if (loguru::g_preamble_pipe) {
+    append("| ");
+  }
+  return std::min(length, size - 1);
+}
+
+void AsyncLogSink::onMessage(void* userData, const loguru::Message& message) {
+  auto* sink = static_cast<AsyncLogSink*>(userData);
+  if (message.verbosity == loguru::Verbosity_FATAL) {
+    // Loguru aborts as soon as the callbacks return, before the flusher
+    // would get to the ring
+    sink->drain(true);
+    sink->write(message);
+    std::fflush(sink->output_);
+    return;
+  }
+  if (t_isFlusher) {
+    // A deferred message the flusher itself logged through loguru
+    sink->write(message);
+    return;
+  }
+
+  size_t size = 0;
+  for (const char* part : {message.preamble, message.indentation,
+                           message.prefix, message.message}) {
+    size += std::strlen(part);
+  }
+  if (size > kPayloadSize) {
+    // Too long for a slot, as a whole table logged at once is; written in
+    // full after everything queued before it
+    sink->drain(true);
+    std::lock_guard<std::timed_mutex> lock(sink->drainMutex_);
+    sink->write(message);
+    std::fflush(sink->output_);
+    return;
+  }
+
+  // Call sites share a rate limit when their file and line collide
+  const size_t site =
+      (std::hash<const void*>{}(message.filename) ^ (message.line * 31u)) %
+      kCallSiteCount;
+  AsyncLogRateLimit& limit = sink->callSites_[site];
+  if (!limit.allow()) {
+    sink->suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  Slot* slot = sink->claim();
+  if (slot == nullptr) {
+    return;
+  }
+  slot->kind = Slot::Kind::TEXT;
+  slot->verbosity = message.verbosity;
+  slot->file = message.filename;
+  slot->line = message.line;
+  slot->suppressed = limit.takeSuppressed();
+
+  size_t offset = 0;
+  for (const char* part : {message.preamble, message.indentation,
+                           message.prefix, message.message}) {
+    const size_t length = std::strlen(part);
+    std::memcpy(slot->payload + offset, part, length);
+    offset += length;
+  }
+  slot->size = static_cast<uint16_t>(size);
+  sink->publish(slot);
+}
+
+void AsyncLogSink::write(const loguru::Message& message) {
+  std::fprintf(output_, "%s%s%s%s\n", message.preamble, message.indentation,
+               message.prefix, message.message);
+}
+
+size_t AsyncLogSink::drain(bool direct) {
+  std::unique_lock<std::timed_mutex> lock(drainMutex_, std::defer_lock);
+  if (direct) {
+    if (!lock.try_lock_for(std::chrono::milliseconds(100))) {
+      return 0;
+    }
+  } else {
+    lock.lock();
+  }
+
+  char line[kLineSize];
+  size_t count = 0;
+
+  for (;; ++count) {
+    Slot& slot = slots_[head_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+      break;
+    }
+
+    const bool deferred = slot.kind == Slot::Kind::DEFERRED;
+    const loguru::Verbosity verbosity = slot.verbosity;
+    const char* file = slot.file;
+    const unsigned fileLine = slot.line;
+    if (deferred) {
+      const size_t length = formatPreamble(slot, line, sizeof(line));
+      slot.formatter(slot.format, slot.payload, line + length,
+                     sizeof(line) - length);
+      if (slot.suppressed > 0) {
+        const size_t end = std::strlen(line);
+        std::snprintf(line + end, sizeof(line) - end,
+                      " (%u similar messages suppressed)", slot.suppressed);
+      }
+    } else {
+      std::fwrite(slot.payload, 1, slot.size, output_);
+      if (slot.suppressed > 0) {
+        std::fprintf(output_, " (%u similar messages suppressed)",
+                     slot.suppressed);
+      }
+      std::fputc('\n', output_);
+    }
+
+    // Hand the slot back to the producers one lap later
+    slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+
+    if (deferred && direct) {
+      std::fprintf(output_, "%s\n", line);
+    } else if (deferred) {
+      // Loguru takes its own lock, which a thread logging a fatal message
+      // holds while it waits for this one
+      lock.unlock();
+      loguru::raw_log(verbosity, file, fileLine, "%s", line);
+      lock.lock();
+    }
+  }
+
+  const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped != reportedDropped_) {
+    std::fprintf(output_, "Asynchronous log sink dropped %llu messages\n",
+                 static_cast<unsigned long long>(dropped - reportedDropped_));
+    reportedDropped_ = dropped;
+    std::fflush(output_);
+  }
+
+  if (count > 0) {
+    std::fflush(output_);
+    written_.store(head_, std::memory_order_release);
+  }
+  return count;
+}
+
+void AsyncLogSink::run() {
+  t_isFlusher = true;
+  loguru::set_thread_name("log flusher");
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    lock.unlock();
+    const size_t count = drain();
+    lock.lock();
+    drained_.notify_all();
+    if (count == 0 && running_) {
+      // Producers never notify, so that logging stays free of system calls
+      wakeUp_.wait_for(lock, options_.pollInterval);
+    }
+  }
+  lock.unlock();
+
+  drain();
+  drained_.notify_all();
+}
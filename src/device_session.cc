@@ -0,0 +1,132 @@
+#include "device_session.h"
+
+#include <algorithm>
+#include <boost/system/system_error.hpp>
+#include <string_view>
+#include <thread>
+
+#include "loguru.h"
+#include "pdo_mapping.h"
+
+namespace {
+
+/**
+ * @brief Returns whether an error comes from a failed exchange rather than
+ * from a response of the device.
+ *
+ * `EthernetDevice` reports a timeout and a failed read or write with the
+ * same message, so both count as a failed exchange.
+ */
+bool isExchangeFailure(const std::runtime_error& error) {
+  return dynamic_cast<const boost::system::system_error*>(&error) !=
+             nullptr ||
+         std::string_view(error.what()).find("timed out") !=
+             std::string_view::npos;
+}
+
+}  // namespace
+
+DeviceSession::DeviceSession(EthernetDevice& device, ReconnectPolicy policy)
+    : device_(device), policy_(policy), random_(std::random_device{}()) {}
+
+bool DeviceSession::setState(uint8_t state,
+                             const std::chrono::steady_clock::duration
+                                 expiryTime) {
+  targetState_ = state;
+  return device_.setState(state, expiryTime);
+}
+
+void DeviceSession::setPdoMapping(const common::UiPdoMapping& mapping) {
+  pdoMapping_ = mapping;
+}
+
+void DeviceSession::markChanged(uint16_t index, uint8_t subindex) {
+  changed_.emplace(index, subindex);
+}
+
+void DeviceSession::unmarkChanged(uint16_t index, uint8_t subindex) {
+  changed_.erase({index, subindex});
+}
+
+bool DeviceSession::reconnect() {
+  for (unsigned attempt = 0;
+       policy_.maxAttempts == 0 || attempt < policy_.maxAttempts; ++attempt) {
+    if (attempt > 0) {
+      std::this_thread::sleep_for(backoff(attempt));
+    }
+
+    if (tryRestore()) {
+      ++reconnectCount_;
+      LOG_F(INFO, "Device session restored after %u attempt(s)", attempt + 1);
+      return true;
+    }
+  }
+
+  LOG_F(ERROR, "Giving up restoring the device session after %u attempts",
+        policy_.maxAttempts);
+  return false;
+}
+
+bool DeviceSession::connectionLost(const std::runtime_error& error) {
+  // A late response to the failed request could be read as the probe's
+  // reply, leaving the stream one response behind, so it is not probed
+  if (device_.isConnected() && !isExchangeFailure(error)) {
+    try {
+      device_.getState(policy_.probeTimeout);
+      return false;
+    } catch (const std::runtime_error& e) {
+      LOG_F(WARNING, "Device does not answer: %s", e.what());
+    }
+  }
+
+  // The socket stays open after a transport error; drop it before any
+  // further exchange can read a stale response from it
+  device_.disconnect();
+  return true;
+}
+
+bool DeviceSession::tryRestore() {
+  device_.disconnect();
+  if (!device_.connect()) {
+    return false;
+  }
+
+  try {
+    if (targetState_ && device_.getState() != *targetState_) {
+      if (pdoMapping_) {
+        if (!device_.setState(kPreOperationalState)) {
+          return false;
+        }
+        writePdoMapping(device_, *pdoMapping_);
+      }
+      if (!device_.setState(*targetState_)) {
+        return false;
+      }
+    }
+
+    for (const auto& [index, subindex] : changed_) {
+      device_.upload(index, subindex);
+    }
+  } catch (const std::runtime_error& e) {
+    LOG_F(WARNING, "Failed to restore the device session: %s", e.what());
+    return false;
+  }
+
+  return true;
+}
+
+std::chrono::milliseconds DeviceSession::backoff(unsigned attempt) {
+  double delay = static_cast<double>(policy_.initialDelay.count());
+  for (unsigned i = 1; i < attempt; ++i) {
+    delay *= policy_.multiplier;
+    if (delay >= policy_.maxDelay.count()) {
+      break;
+    }
+  }
+  delay = std::min(delay, static_cast<double>(policy_.maxDelay.count()));
+
+  std::uniform_real_distribution<double> spread(1.0 - policy_.jitter,
+                                                1.0 + policy_.jitter);
+  return std::chrono::milliseconds(
+      static_cast<int64_t>(std::max(0.0, delay * spread(random_))));
+}
@@ -0,0 +1,339 @@
+#include "device_statistics.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "loguru.h"
+
+namespace {
+
+/** Names of the type slots, matching `DeviceStatistics::kMessageTypes`. */
+constexpr std::array<const char*, DeviceStatistics::kTypeSlots> kSlotNames{
+    "SDO_READ",       "SDO_WRITE",       "PDO_RXTX_FRAME", "PDO_CONTROL",
+    "PDO_MAP",        "FIRMWARE_UPDATE", "FILE_READ",      "FILE_WRITE",
+    "STATE_CONTROL",  "STATE_READ",      "PARAM_FULL_LIST", "SERVER_INFO",
+    "UNKNOWN"};
+
+/** Longest request head a scraper may send. */
+constexpr size_t kMaxRequestSize = 8192;
+
+/** Time a scraper has to send its request and read the answer. */
+constexpr std::chrono::seconds kRequestTimeout(5);
+
+/**
+ * @brief Escapes a label value as required by the text exposition format.
+ */
+std::string escapeLabel(const std::string& value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+/**
+ * @brief Writes the HELP and TYPE lines of a metric.
+ */
+void appendHeader(std::string& output, const char* name, const char* type,
+                  const char* help) {
+  output += "# HELP somanet_";
+  output += name;
+  output += ' ';
+  output += help;
+  output += "\n# TYPE somanet_";
+  output += name;
+  output += ' ';
+  output += type;
+  output += '\n';
+}
+
+/**
+ * @brief Writes one sample; `labels` holds any labels after `device`.
+ */
+void appendSample(std::string& output, const char* name,
+                  const std::string& device, const std::string& labels,
+                  const char* value) {
+  output += "somanet_";
+  output += name;
+  output += "{device=\"";
+  output += device;
+  output += '"';
+  output += labels;
+  output += "} ";
+  output += value;
+  output += '\n';
+}
+
+void appendSample(std::string& output, const char* name,
+                  const std::string& device, const std::string& labels,
+                  uint64_t value) {
+  char text[24];
+  std::snprintf(text, sizeof(text), "%" PRIu64, value);
+  appendSample(output, name, device, labels, text);
+}
+
+}  // namespace
+
+const char* DeviceStatistics::slotName(size_t slot) noexcept {
+  return slot < kSlotNames.size() ? kSlotNames[slot] : kSlotNames.back();
+}
+
+DeviceStatistics::Snapshot DeviceStatistics::snapshot() const noexcept {
+  auto load = [](const std::atomic<uint64_t>& counter) {
+    return counter.load(std::memory_order_relaxed);
+  };
+
+  Snapshot snapshot;
+  for (size_t i = 0; i < kTypeSlots; ++i) {
+    snapshot.messages[i] = {load(messages_[i].framesSent),
+                            load(messages_[i].bytesSent),
+                            load(messages_[i].framesReceived),
+                            load(messages_[i].bytesReceived)};
+  }
+  snapshot.timeouts = load(timeouts_.value);
+  snapshot.reconnects = load(reconnects_.value);
+  snapshot.sqiBusy = load(sqiBusy_.value);
+  snapshot.sqiErrors = load(sqiErrors_.value);
+  snapshot.pdoOverruns = load(pdoOverruns_.value);
+  snapshot.roundTripTime =
+      std::chrono::nanoseconds(load(roundTripTime_.value));
+  return snapshot;
+}
+
+std::string formatPrometheusMetrics(std::span<const DeviceMetrics> devices) {
+  std::vector<std::string> labels;
+  labels.reserve(devices.size());
+  for (const auto& device : devices) {
+    labels.push_back(escapeLabel(device.device));
+  }
+
+  std::string output;
+  auto perType = [&](const char* name, const char* help,
+                     uint64_t DeviceStatistics::MessageCounts::*counter) {
+    appendHeader(output, name, "counter", help);
+    for (size_t i = 0; i < devices.size(); ++i) {
+      for (size_t slot = 0; slot < DeviceStatistics::kTypeSlots; ++slot) {
+        appendSample(output, name, labels[i],
+                     std::string(",type=\"") +
+                         DeviceStatistics::slotName(slot) + '"',
+                     devices[i].snapshot.messages[slot].*counter);
+      }
+    }
+  };
+  auto perDevice = [&](const char* name, const char* help,
+                       uint64_t DeviceStatistics::Snapshot::*counter) {
+    appendHeader(output, name, "counter", help);
+    for (size_t i = 0; i < devices.size(); ++i) {
+      appendSample(output, name, labels[i], {}, devices[i].snapshot.*counter);
+    }
+  };
+
+  using MessageCounts = DeviceStatistics::MessageCounts;
+  using Snapshot = DeviceStatistics::Snapshot;
+  perType("frames_sent_total", "Requests written to the device.",
+          &MessageCounts::framesSent);
+  perType("bytes_sent_total", "Bytes of the requests, headers included.",
+          &MessageCounts::bytesSent);
+  perType("frames_received_total", "Messages received from the device.",
+          &MessageCounts::framesReceived);
+  perType("bytes_received_total", "Bytes of the messages, headers included.",
+          &MessageCounts::bytesReceived);
+  perDevice("timeouts_total", "Exchanges that timed out.",
+            &Snapshot::timeouts);
+  perDevice("reconnects_total", "Connections made after the first one.",
+            &Snapshot::reconnects);
+  perDevice("pdo_overruns_total", "Pushed TxPDO frames the device skipped.",
+            &Snapshot::pdoOverruns);
+
+  appendHeader(output, "sqi_replies_total", "counter",
+               "Messages with an SQI status other than ACK.");
+  for (size_t i = 0; i < devices.size(); ++i) {
+    appendSample(output, "sqi_replies_total", labels[i], ",status=\"BSY\"",
+                 devices[i].snapshot.sqiBusy);
+    appendSample(output, "sqi_replies_total", labels[i], ",status=\"ERR\"",
+                 devices[i].snapshot.sqiErrors);
+  }
+
+  appendHeader(output, "round_trip_seconds", "gauge",
+               "Round-trip time of the last exchange.");
+  for (size_t i = 0; i < devices.size(); ++i) {
+    char value[32];
+    std::snprintf(
+        value, sizeof(value), "%.9f",
+        std::chrono::duration<double>(devices[i].snapshot.roundTripTime)
+            .count());
+    appendSample(output, "round_trip_seconds", labels[i], {}, value);
+  }
+  return output;
+}
+
+PrometheusExporter::~PrometheusExporter() { stop(); }
+
+void PrometheusExporter::add(const std::string& device,
+                             const DeviceStatistics& statistics) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sources_.push_back({device, &statistics});
+}
+
+std::string PrometheusExporter::render() const {
+  std::vector<DeviceMetrics> devices;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    devices.reserve(sources_.size());
+    for (const auto& source : sources_) {
+      devices.push_back({source.device, source.statistics->snapshot()});
+    }
+  }
+  return formatPrometheusMetrics(devices);
+}
+
+void PrometheusExporter::writeFile(const std::string& path) const {
+  const std::string metrics = render();
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(metrics.data(), static_cast<std::streamsize>(metrics.size()));
+    if (!file) {
+      LOG_F(ERROR, "Failed to write metrics to %s", temporary.c_str());
+      throw std::runtime_error("Failed to write metrics to " + temporary);
+    }
+  }
+  // Unlike std::rename, this also replaces an existing file on Windows
+  std::error_code ec;
+  std::filesystem::rename(temporary, path, ec);
+  if (ec) {
+    LOG_F(ERROR, "Failed to replace %s: %s", path.c_str(),
+          ec.message().c_str());
+    throw std::runtime_error("Failed to replace " + path);
+  }
+}
+
+void PrometheusExporter::serve(unsigned short port) {
+  if (thread_.joinable()) {
+    return;
+  }
+
+  using boost::asio::ip::tcp;
+  boost::system::error_code ec;
+  const tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), port);
+  acceptor_.open(endpoint.protocol(), ec);
+  if (!ec) {
+    acceptor_.set_option(tcp::acceptor::reuse_address(true), ec);
+    acceptor_.bind(endpoint, ec);
+  }
+  if (!ec) {
+    acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+  }
+  if (ec) {
+    LOG_F(ERROR, "Failed to listen on 127.0.0.1:%d: %s", port,
+          ec.message().c_str());
+    acceptor_.close(ec);
+    throw std::runtime_error("Failed to listen on port " +
+                             std::to_string(port));
+  }
+  port_ = acceptor_.local_endpoint().port();
+
+  context_.restart();
+  accept();
+  thread_ = std::thread([this] { context_.run(); });
+}
+
+void PrometheusExporter::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  // Close the acceptor and the open connections on the server thread, so
+  // run() returns without waiting for a scraper
+  boost::asio::post(context_, [this] {
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+    while (!connections_.empty()) {
+      auto socket = *connections_.begin();
+      close(socket);
+    }
+  });
+  thread_.join();
+  port_ = 0;
+}
+
+void PrometheusExporter::accept() {
+  auto socket = std::make_shared<boost::asio::ip::tcp::socket>(context_);
+  acceptor_.async_accept(
+      *socket, [this, socket](const boost::system::error_code& error) {
+        if (error == boost::asio::error::operation_aborted) {
+          return;
+        }
+        if (!error) {
+          connections_.insert(socket);
+          respond(socket);
+        }
+        if (acceptor_.is_open()) {
+          accept();
+        }
+      });
+}
+
+void PrometheusExporter::respond(
+    std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
+  // Closing the socket ends whichever operation is still pending
+  auto deadline =
+      std::make_shared<boost::asio::steady_timer>(context_, kRequestTimeout);
+  deadline->async_wait(
+      [this, socket](const boost::system::error_code& error) {
+        if (!error) {
+          close(socket);
+        }
+      });
+
+  auto request = std::make_shared<std::string>();
+  boost::asio::async_read_until(
+      *socket, boost::asio::dynamic_buffer(*request, kMaxRequestSize),
+      "\r\n\r\n",
+      [this, socket, request, deadline](const boost::system::error_code& error,
+                                        size_t) {
+        if (error) {
+          deadline->cancel();
+          close(socket);
+          return;
+        }
+
+        // Only the request line matters; any path but the metrics is 404
+        const bool metrics = request->starts_with("GET /metrics ") ||
+                             request->starts_with("GET / ");
+        const std::string body = metrics ? render() : "Not found\n";
+        auto response = std::make_shared<std::string>(
+            std::string(metrics ? "HTTP/1.1 200 OK\r\n"
+                                : "HTTP/1.1 404 Not Found\r\n") +
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " +
+            std::to_string(body.size()) +
+            "\r\nConnection: close\r\n\r\n" + body);
+        boost::asio::async_write(
+            *socket, boost::asio::buffer(*response),
+            [this, socket, response, deadline](
+                const boost::system::error_code&, size_t) {
+              deadline->cancel();
+              close(socket);
+            });
+      });
+}
+
+void PrometheusExporter::close(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& socket) {
+  boost::system::error_code ec;
+  socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+  socket->close(ec);
+  connections_.erase(socket);
+}
@@ -0,0 +1,1143 @@
+#include "ethernet_connection.h"
+
+#include <algorithm>
+
+#include "async_log.h"
+#include "loguru.h"
+
+namespace {
+
+/** Size of one entry of the parameter list. */
+constexpr size_t kParameterEntrySize = 68;
+
+/** Offset of the NUL-terminated name within an entry. */
+constexpr size_t kParameterNameOffset = 16;
+
+/**
+ * @brief Returns when a segment must be complete: `expiryTime` from now, but
+ * no later than the deadline of the whole transfer.
+ */
+std::chrono::steady_clock::time_point segmentDeadline(
+    std::chrono::steady_clock::time_point deadline,
+    std::chrono::steady_clock::duration expiryTime) {
+  const auto now = std::chrono::steady_clock::now();
+  return deadline - now < expiryTime ? deadline : now + expiryTime;
+}
+
+/**
+ * @brief Decodes an entry of the parameter list the way
+ * `EthernetDevice::getParameters` does.
+ */
+common::Parameter parseParameterEntry(
+    std::span<const uint8_t, kParameterEntrySize> entry) {
+  auto read16 = [&entry](size_t offset) {
+    return static_cast<uint16_t>(entry[offset] | (entry[offset + 1] << 8));
+  };
+
+  common::Parameter parameter{};
+  parameter.index = read16(0);
+  parameter.subindex = entry[2];
+  parameter.dataType = static_cast<common::ObjectDataType>(read16(4));
+  parameter.code = static_cast<common::ObjectCode>(read16(6));
+  parameter.bitLength = read16(8);
+  parameter.flags = static_cast<common::ObjectFlags>(read16(10));
+
+  const auto name = entry.subspan(kParameterNameOffset);
+  parameter.name.assign(name.begin(),
+                        std::find(name.begin(), name.end(), 0));
+  return parameter;
+}
+
+}  // namespace
+
+void* HandlerMemory::allocate(std::size_t size) {
+  if (size <= kBlockSize) {
+    for (auto& block : blocks_) {
+      if (!block.inUse) {
+        block.inUse = true;
+        return block.storage;
+      }
+    }
+  }
+
+  return ::operator new(size);
+}
+
+void HandlerMemory::deallocate(void* pointer) noexcept {
+  for (auto& block : blocks_) {
+    if (pointer == block.storage) {
+      block.inUse = false;
+      return;
+    }
+  }
+
+  ::operator delete(pointer);
+}
+
+EthernetConnection::EthernetConnection(const std::string& ip,
+                                       unsigned short port)
+    : endpoint_(boost::asio::ip::make_address(ip), port),
+      socket_(ioContext_) {}
+
+EthernetConnection::~EthernetConnection() {
+  if (socket_.is_open()) {
+    disconnect();
+  }
+}
+
+uint16_t EthernetConnection::incrementSeqId() {
+  return seqId_.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+bool EthernetConnection::connect() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this] { return !ioBusy_; });
+
+  boost::system::error_code ec;
+  reader_.clear();
+  socket_.connect(endpoint_, ec);
+  if (ec) {
+    LOG_F(ERROR, "Failed to connect to %s:%d: %s",
+          endpoint_.address().to_string().c_str(), endpoint_.port(),
+          ec.message().c_str());
+    socket_.close(ec);
+    return false;
+  }
+
+  // Requests are small and latency bound, so send them immediately
+  socket_.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+
+  if (connectedBefore_) {
+    statistics_.recordReconnect();
+  }
+  connectedBefore_ = true;
+
+  return true;
+}
+
+bool EthernetConnection::isConnected() { return socket_.is_open(); }
+
+bool EthernetConnection::disconnect() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this] { return !ioBusy_; });
+
+  try {
+    boost::system::error_code ec;
+    socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    socket_.close(ec);
+    if (ec) {
+      LOG_F(ERROR, "Failed to close the socket: %s", ec.message().c_str());
+      return false;
+    }
+    return true;
+  } catch (const std::exception& e) {
+    LOG_F(ERROR, "Exception while closing the socket: %s", e.what());
+    return false;
+  }
+}
+
+EthernetMessageView EthernetConnection::exchangeWithTimeout(
+    EthernetMessageType type, std::span<const uint8_t> payload,
+    std::span<uint8_t> response,
+    const std::chrono::steady_clock::duration expiryTime,
+    EthernetMessageStatus status) {
+  return exchange(type, status, {}, payload, response, expiryTime);
+}
+
+uint8_t EthernetConnection::getState(
+    const std::chrono::steady_clock::duration expiryTime) {
+  std::array<uint8_t, 1> state{0};
+  auto response = exchangeWithTimeout(EthernetMessageType::STATE_READ, {},
+                                      state, expiryTime);
+  return response.data.empty() ? 0 : state[0];
+}
+
+bool EthernetConnection::setState(
+    uint8_t state, const std::chrono::steady_clock::duration expiryTime) {
+  const std::array<uint8_t, 1> request{state};
+  auto response = exchangeWithTimeout(EthernetMessageType::STATE_CONTROL,
+                                      request, {}, expiryTime);
+  return response.status == EthernetMessageStatus::OK;
+}
+
+size_t EthernetConnection::readSdo(
+    uint16_t index, uint8_t subindex, std::span<uint8_t> value,
+    const std::chrono::steady_clock::duration expiryTime) {
+  const std::array<uint8_t, 4> request{static_cast<uint8_t>(index & 0xFF),
+                                       static_cast<uint8_t>(index >> 8),
+                                       subindex, 0};
+  auto response = exchangeWithTimeout(EthernetMessageType::SDO_READ, request,
+                                      value, expiryTime);
+  if (response.status != EthernetMessageStatus::OK) {
+    LOG_F(ERROR, "Failed to read SDO 0x%04X:%02X", index, subindex);
+    return 0;
+  }
+
+  return response.data.size();
+}
+
+bool EthernetConnection::writeSdo(
+    uint16_t index, uint8_t subindex, std::span<const uint8_t> data,
+    const std::chrono::steady_clock::duration expiryTime) {
+  const std::array<uint8_t, 6> prefix{
+      static_cast<uint8_t>(index & 0xFF),
+      static_cast<uint8_t>(index >> 8),
+      subindex,
+      0,
+      static_cast<uint8_t>(data.size() & 0xFF),
+      static_cast<uint8_t>(data.size() >> 8)};
+  auto response = exchange(EthernetMessageType::SDO_WRITE,
+                           EthernetMessageStatus::OK, prefix, data, {},
+                           expiryTime);
+  if (response.status != EthernetMessageStatus::OK) {
+    LOG_F(ERROR, "Failed to write SDO 0x%04X:%02X", index, subindex);
+    return false;
+  }
+
+  return true;
+}
+
+void EthernetConnection::readSdos(
+    std::span<SdoTransfer> transfers,
+    const std::chrono::steady_clock::duration expiryTime) {
+  transferSdos(EthernetMessageType::SDO_READ, transfers,
+               std::chrono::steady_clock::now() + expiryTime);
+}
+
+void EthernetConnection::writeSdos(
+    std::span<SdoTransfer> transfers,
+    const std::chrono::steady_clock::duration expiryTime) {
+  transferSdos(EthernetMessageType::SDO_WRITE, transfers,
+               std::chrono::steady_clock::now() + expiryTime);
+}
+
+common::Parameter& EthernetConnection::upload(
+    common::Parameter& parameter,
+    const std::chrono::steady_clock::duration expiryTime) {
+  std::array<uint8_t, EthernetMessage::kBufferSize> value;
+  const size_t size =
+      readSdo(parameter.index, parameter.subindex, value, expiryTime);
+  if (size == 0) {
+    throw std::runtime_error(
+        "Failed to upload parameter " +
+        common::makeParameterId(parameter.index, parameter.subindex));
+  }
+
+  parameter.data.assign(value.begin(), value.begin() + size);
+  return parameter;
+}
+
+void EthernetConnection::download(
+    const common::Parameter& parameter,
+    const std::chrono::steady_clock::duration expiryTime) {
+  if (parameter.data.empty()) {
+    throw std::runtime_error(
+        "Parameter data is empty for " +
+        common::makeParameterId(parameter.index, parameter.subindex));
+  }
+
+  if (!writeSdo(parameter.index, parameter.subindex, parameter.data,
+                expiryTime)) {
+    throw std::runtime_error(
+        "Failed to download parameter " +
+        common::makeParameterId(parameter.index, parameter.subindex));
+  }
+}
+
+std::vector<uint8_t> EthernetConnection::readFile(
+    const std::string& filename,
+    std::chrono::steady_clock::time_point deadline,
+    const CancellationToken& token) {
+  return readFileUntil(filename, deadline,
+                       std::chrono::steady_clock::duration::max(), token);
+}
+
+std::vector<uint8_t> EthernetConnection::readFile(
+    const std::string& filename,
+    const std::chrono::steady_clock::duration expiryTime) {
+  return readFileUntil(filename, std::chrono::steady_clock::time_point::max(),
+                       expiryTime, CancellationToken::none());
+}
+
+bool EthernetConnection::writeFile(
+    const std::string& filename, std::span<const uint8_t> data,
+    std::chrono::steady_clock::time_point deadline,
+    const CancellationToken& token) {
+  return writeFileUntil(filename, data, deadline,
+                        std::chrono::steady_clock::duration::max(), token);
+}
+
+bool EthernetConnection::writeFile(
+    const std::string& filename, std::span<const uint8_t> data,
+    const std::chrono::steady_clock::duration expiryTime) {
+  return writeFileUntil(filename, data,
+                        std::chrono::steady_clock::time_point::max(),
+                        expiryTime, CancellationToken::none());
+}
+
+std::vector<common::Parameter> EthernetConnection::getParameters(
+    bool readValues, std::chrono::steady_clock::time_point deadline,
+    const CancellationToken& token) {
+  return getParametersUntil(readValues, deadline,
+                            std::chrono::steady_clock::duration::max(),
+                            token);
+}
+
+std::vector<common::Parameter> EthernetConnection::getParameters(
+    bool readValues, const std::chrono::steady_clock::duration expiryTime) {
+  return getParametersUntil(readValues,
+                            std::chrono::steady_clock::time_point::max(),
+                            expiryTime, CancellationToken::none());
+}
+
+size_t EthernetConnection::sendAndReceiveProcessData(
+    std::span<const uint8_t> data, std::span<uint8_t> response,
+    const std::chrono::steady_clock::duration expiryTime) {
+  auto message = exchangeWithTimeout(EthernetMessageType::PDO_RXTX_FRAME,
+                                     data, response, expiryTime);
+  if (message.status != EthernetMessageStatus::OK) {
+    ASYNC_LOG_F(ERROR, "Failed to exchange PDO");
+    return 0;
+  }
+
+  return message.data.size();
+}
+
+EthernetMessageView EthernetConnection::exchange(
+    EthernetMessageType type, EthernetMessageStatus status,
+    std::span<const uint8_t> prefix, std::span<const uint8_t> payload,
+    std::span<uint8_t> response,
+    const std::chrono::steady_clock::duration expiryTime) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = start + expiryTime;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  const size_t slot =
+      enqueue(lock, type, status, prefix, payload, response, deadline);
+  if (slots_[slot].traced) {
+    // Include the wait for the mutex and a free slot
+    slots_[slot].enqueuedAt = start;
+  }
+  return await(lock, slot, deadline);
+}
+
+std::vector<uint8_t> EthernetConnection::readFileUntil(
+    const std::string& filename,
+    std::chrono::steady_clock::time_point deadline,
+    std::chrono::steady_clock::duration expiryTime,
+    const CancellationToken& token) {
+  const std::span<const uint8_t> name(
+      reinterpret_cast<const uint8_t*>(filename.data()), filename.size());
+
+  // Each segment is received straight into the end of the result
+  std::vector<uint8_t> data;
+  std::optional<uint16_t> id;
+  auto status = EthernetMessageStatus::FIRST;
+  std::span<const uint8_t> request = name;
+  while (true) {
+    const size_t size = data.size();
+    data.resize(size + EthernetMessage::kBufferSize);
+    auto response = exchangeSegment(
+        EthernetMessageType::FILE_READ, status, id, request,
+        std::span(data).subspan(size), deadline, expiryTime, token);
+    if (response.status == EthernetMessageStatus::ERR) {
+      LOG_F(ERROR, "Failed to read file %s", filename.c_str());
+      throw std::runtime_error("Failed to read file " + filename);
+    }
+    data.resize(size + response.data.size());
+
+    if (response.status == EthernetMessageStatus::LAST) {
+      return data;
+    }
+    status = EthernetMessageStatus::MIDDLE;
+    request = {};
+  }
+}
+
+bool EthernetConnection::writeFileUntil(
+    const std::string& filename, std::span<const uint8_t> data,
+    std::chrono::steady_clock::time_point deadline,
+    std::chrono::steady_clock::duration expiryTime,
+    const CancellationToken& token) {
+  constexpr size_t kSegmentSize = 512;
+
+  std::optional<uint16_t> id;
+  auto response = exchangeSegment(
+      EthernetMessageType::FILE_WRITE, EthernetMessageStatus::FIRST, id,
+      std::span(reinterpret_cast<const uint8_t*>(filename.data()),
+                filename.size()),
+      {}, deadline, expiryTime, token);
+
+  for (size_t offset = 0;
+       response.status != EthernetMessageStatus::ERR && offset < data.size();
+       offset += kSegmentSize) {
+    const size_t size = std::min(kSegmentSize, data.size() - offset);
+    response = exchangeSegment(EthernetMessageType::FILE_WRITE,
+                               offset + size == data.size()
+                                   ? EthernetMessageStatus::LAST
+                                   : EthernetMessageStatus::MIDDLE,
+                               id, data.subspan(offset, size), {}, deadline,
+                               expiryTime, token);
+  }
+
+  if (response.status == EthernetMessageStatus::ERR) {
+    LOG_F(ERROR, "Failed to write file %s", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::vector<common::Parameter> EthernetConnection::getParametersUntil(
+    bool readValues, std::chrono::steady_clock::time_point deadline,
+    std::chrono::steady_clock::duration expiryTime,
+    const CancellationToken& token) {
+  // The answer to the first segment carries no entries
+  std::optional<uint16_t> id;
+  exchangeSegment(EthernetMessageType::PARAM_FULL_LIST,
+                  EthernetMessageStatus::FIRST, id, {}, {}, deadline,
+                  expiryTime, token);
+
+  std::vector<uint8_t> list;
+  while (true) {
+    const size_t size = list.size();
+    list.resize(size + EthernetMessage::kBufferSize);
+    auto response = exchangeSegment(
+        EthernetMessageType::PARAM_FULL_LIST, EthernetMessageStatus::MIDDLE,
+        id, {}, std::span(list).subspan(size), deadline, expiryTime, token);
+    if (response.status == EthernetMessageStatus::ERR) {
+      LOG_F(ERROR, "Failed to read the parameter list");
+      throw std::runtime_error("Failed to read the parameter list");
+    }
+    list.resize(size + response.data.size());
+    if (response.status == EthernetMessageStatus::LAST) {
+      break;
+    }
+  }
+
+  std::vector<common::Parameter> parameters;
+  parameters.reserve(list.size() / kParameterEntrySize);
+  for (size_t offset = 0; offset + kParameterEntrySize <= list.size();
+       offset += kParameterEntrySize) {
+    parameters.push_back(parseParameterEntry(
+        std::span(list).subspan(offset).first<kParameterEntrySize>()));
+  }
+
+  if (!readValues) {
+    for (auto& parameter : parameters) {
+      parameter.data.assign((parameter.bitLength + 7) / 8, 0);
+    }
+    return parameters;
+  }
+
+  // Read the values a window at a time into scratch buffers
+  std::vector<uint8_t> values(kMaxPendingExchanges *
+                              EthernetMessage::kBufferSize);
+  std::array<SdoTransfer, kMaxPendingExchanges> transfers;
+  for (size_t first = 0; first < parameters.size();
+       first += kMaxPendingExchanges) {
+    if (token.canceled()) {
+      throw OperationCanceled("Reading the parameter values was canceled");
+    }
+
+    const size_t count =
+        std::min(kMaxPendingExchanges, parameters.size() - first);
+    for (size_t i = 0; i < count; ++i) {
+      const auto& parameter = parameters[first + i];
+      transfers[i] = {parameter.index, parameter.subindex,
+                      std::span(values).subspan(
+                          i * EthernetMessage::kBufferSize,
+                          EthernetMessage::kBufferSize)};
+    }
+    transferSdos(EthernetMessageType::SDO_READ,
+                 std::span(transfers).first(count),
+                 segmentDeadline(deadline, expiryTime));
+
+    for (size_t i = 0; i < count; ++i) {
+      const auto& transfer = transfers[i];
+      if (transfer.success) {
+        parameters[first + i].data.assign(
+            transfer.data.begin(), transfer.data.begin() + transfer.size);
+      }
+    }
+  }
+
+  return parameters;
+}
+
+EthernetMessageView EthernetConnection::exchangeSegment(
+    EthernetMessageType type, EthernetMessageStatus status,
+    std::optional<uint16_t>& id, std::span<const uint8_t> payload,
+    std::span<uint8_t> response,
+    std::chrono::steady_clock::time_point deadline,
+    std::chrono::steady_clock::duration expiryTime,
+    const CancellationToken& token) {
+  if (token.canceled()) {
+    throw OperationCanceled("Segmented transfer was canceled");
+  }
+
+  const auto segmentEnd = segmentDeadline(deadline, expiryTime);
+  std::unique_lock<std::mutex> lock(mutex_);
+  const size_t slot =
+      enqueue(lock, type, status, {}, payload, response, segmentEnd, id);
+  id = slots_[slot].id;
+  return await(lock, slot, segmentEnd);
+}
+
+void EthernetConnection::transferSdos(
+    EthernetMessageType type, std::span<SdoTransfer> transfers,
+    std::chrono::steady_clock::time_point deadline) {
+  auto makePrefix = [](const SdoTransfer& transfer) {
+    return std::array<uint8_t, 6>{
+        static_cast<uint8_t>(transfer.index & 0xFF),
+        static_cast<uint8_t>(transfer.index >> 8),
+        transfer.subindex,
+        0,
+        static_cast<uint8_t>(transfer.data.size() & 0xFF),
+        static_cast<uint8_t>(transfer.data.size() >> 8)};
+  };
+  const bool write = type == EthernetMessageType::SDO_WRITE;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t next = 0;
+  while (next < transfers.size()) {
+    // Queue as many requests as there are free slots, so that the first
+    // await writes them all at once
+    std::array<size_t, kMaxPendingExchanges> window;
+    size_t count = 0;
+    const size_t first = next;
+    do {
+      auto& transfer = transfers[next];
+      const auto prefix = makePrefix(transfer);
+      const std::span<const uint8_t> request =
+          write ? std::span<const uint8_t>(prefix)
+                : std::span<const uint8_t>(prefix).first(4);
+      const std::span<const uint8_t> payload =
+          write ? std::span<const uint8_t>(transfer.data)
+                : std::span<const uint8_t>();
+      const std::span<uint8_t> response =
+          write ? std::span<uint8_t>() : transfer.data;
+
+      size_t slot = count == 0 ? enqueue(lock, type, EthernetMessageStatus::OK,
+                                         request, payload, response, deadline)
+                               : tryEnqueue(type, EthernetMessageStatus::OK,
+                                            request, payload, response);
+      if (slot == kMaxPendingExchanges) {
+        break;
+      }
+      window[count++] = slot;
+      ++next;
+    } while (next < transfers.size() && count < kMaxPendingExchanges);
+
+    for (size_t i = 0; i < count; ++i) {
+      EthernetMessageView message;
+      try {
+        message = await(lock, window[i], deadline);
+      } catch (...) {
+        for (size_t j = i + 1; j < count; ++j) {
+          release(lock, window[j]);
+        }
+        throw;
+      }
+
+      auto& transfer = transfers[first + i];
+      transfer.success = message.status == EthernetMessageStatus::OK;
+      transfer.size = write ? 0 : message.data.size();
+      if (!transfer.success) {
+        LOG_F(ERROR, "Failed to %s SDO 0x%04X:%02X", write ? "write" : "read",
+              transfer.index, transfer.subindex);
+      }
+    }
+  }
+}
+
+size_t EthernetConnection::enqueue(
+    std::unique_lock<std::mutex>& lock, EthernetMessageType type,
+    EthernetMessageStatus status, std::span<const uint8_t> prefix,
+    std::span<const uint8_t> payload, std::span<uint8_t> response,
+    std::chrono::steady_clock::time_point deadline,
+    std::optional<uint16_t> id) {
+  size_t slot = kMaxPendingExchanges;
+  const bool queued = condition_.wait_until(lock, deadline, [&] {
+    slot = tryEnqueue(type, status, prefix, payload, response, id);
+    return slot != kMaxPendingExchanges;
+  });
+  if (!queued) {
+    statistics_.recordTimeout();
+    throw std::runtime_error(
+        "Timed out while waiting for a free request slot");
+  }
+
+  return slot;
+}
+
+size_t EthernetConnection::tryEnqueue(EthernetMessageType type,
+                                      EthernetMessageStatus status,
+                                      std::span<const uint8_t> prefix,
+                                      std::span<const uint8_t> payload,
+                                      std::span<uint8_t> response,
+                                      std::optional<uint16_t> id) {
+  const size_t size = prefix.size() + payload.size();
+  if (prefix.size() > kMaxPrefixSize || size > EthernetMessage::kBufferSize) {
+    throw std::runtime_error("Request payload exceeds the buffer size");
+  }
+
+  // Bulk requests leave the first slots to process data
+  const bool priority = type == EthernetMessageType::PDO_RXTX_FRAME;
+  const size_t first = priority ? 0 : kPrioritySlots;
+  size_t slot = first;
+  while (slot < kMaxPendingExchanges &&
+         slots_[slot].state != PendingExchange::State::FREE) {
+    ++slot;
+  }
+
+  if (slot == kMaxPendingExchanges) {
+    // Responses are matched by sequence ID, so the slot of the oldest
+    // abandoned request can be reused; its late response will be discarded
+    for (size_t i = 0; i < inFlight_.size(); ++i) {
+      if (inFlight_[i] >= first &&
+          slots_[inFlight_[i]].state == PendingExchange::State::ABANDONED) {
+        slot = inFlight_[i];
+        inFlight_.erase(slot);
+        break;
+      }
+    }
+  }
+
+  if (slot < kMaxPendingExchanges) {
+    auto& pending = slots_[slot];
+    pending.id = id ? *id : incrementSeqId();
+    serializeEthernetMessageHeader(
+        type, pending.id, status, static_cast<uint16_t>(size),
+        std::span(pending.head).first<EthernetMessage::kHeaderSize>());
+    std::copy(prefix.begin(), prefix.end(),
+              pending.head.begin() + EthernetMessage::kHeaderSize);
+    pending.headSize = EthernetMessage::kHeaderSize + prefix.size();
+    pending.payload = payload;
+    pending.response = response;
+    pending.failure = nullptr;
+    pending.error = {};
+    pending.traced = tracer_ != nullptr && tracer_->enabled();
+    if (pending.traced) {
+      pending.enqueuedAt = std::chrono::steady_clock::now();
+    }
+    pending.state = PendingExchange::State::QUEUED;
+    if (!priority) {
+      queued_.push(slot);
+      return slot;
+    }
+
+    priorityQueued_.push(slot);
+    lastPriorityRequest_ = std::chrono::steady_clock::now();
+    if (ioBusy_) {
+      // Wake the thread waiting for a response, so that it writes this
+      // request now instead of after the response. Once that read completed,
+      // the request is written before the next one and the cancel is dropped
+      boost::asio::post(ioContext_, [this, generation = readGeneration_] {
+        if (readOutstanding_ && readGeneration_ == generation) {
+          socket_.cancel();
+        }
+      });
+    }
+    return slot;
+  }
+
+  return kMaxPendingExchanges;
+}
+
+EthernetMessageView EthernetConnection::await(
+    std::unique_lock<std::mutex>& lock, size_t slot,
+    std::chrono::steady_clock::time_point deadline) {
+  using State = PendingExchange::State;
+  auto& pending = slots_[slot];
+
+  while (pending.state == State::QUEUED || pending.state == State::SENDING ||
+         pending.state == State::SENT) {
+    if (pending.state != State::SENDING &&
+        std::chrono::steady_clock::now() >= deadline) {
+      release(lock, slot);
+      statistics_.recordTimeout();
+      ASYNC_LOG_F(ERROR, "Exchange timed out");
+      throw std::runtime_error(
+          "Failed to read response or timed out while waiting for response.");
+    }
+
+    if (ioBusy_) {
+      // Another thread owns the socket and will hand over the response
+      if (pending.state == State::SENDING) {
+        condition_.wait(lock);
+      } else {
+        condition_.wait_until(lock, deadline);
+      }
+      continue;
+    }
+
+    ioBusy_ = true;
+    if (hasWritableRequests()) {
+      flush(lock, deadline);
+    } else {
+      receive(lock, deadline);
+    }
+    ioBusy_ = false;
+    condition_.notify_all();
+  }
+
+  if (pending.state == State::FAILED) {
+    std::string what = pending.failure;
+    if (pending.error) {
+      what += ". " + pending.error.message();
+    }
+    pending.state = State::FREE;
+    condition_.notify_all();
+    throw std::runtime_error(what);
+  }
+
+  EthernetMessageView message = pending.message;
+  if (pending.traced && tracer_ != nullptr) {
+    ExchangeTracer::Span span;
+    span.type = message.type;
+    span.id = pending.id;
+    span.requestSize =
+        static_cast<uint32_t>(pending.headSize + pending.payload.size());
+    span.responseSize = EthernetMessage::kHeaderSize + message.size;
+    span.enqueue = pending.enqueuedAt;
+    span.writeStart = pending.sentAt;
+    span.writeComplete = pending.writtenAt;
+    span.firstByte = pending.firstByteAt;
+    span.parseComplete = pending.parsedAt;
+    tracer_->record(span);
+  }
+  pending.state = State::FREE;
+  condition_.notify_all();
+  return message;
+}
+
+void EthernetConnection::release(std::unique_lock<std::mutex>& lock,
+                                 size_t slot) {
+  using State = PendingExchange::State;
+  auto& pending = slots_[slot];
+
+  // The payload is still referenced while the request is being written
+  condition_.wait(lock, [&] { return pending.state != State::SENDING; });
+
+  switch (pending.state) {
+    case State::QUEUED: {
+      queued_.erase(slot);
+      priorityQueued_.erase(slot);
+      pending.state = State::FREE;
+      break;
+    }
+    case State::SENT: {
+      pending.state = State::ABANDONED;
+      break;
+    }
+    case State::COMPLETED:
+    case State::FAILED: {
+      pending.state = State::FREE;
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  condition_.notify_all();
+}
+
+size_t EthernetConnection::bulkBudget(
+    std::chrono::steady_clock::time_point now) const {
+  if (!streaming_ && now - lastPriorityRequest_ >= laneOptions_.activityHold) {
+    return kMaxPendingExchanges;
+  }
+
+  // Abandoned requests are not counted, as their responses may never come
+  size_t inFlight = 0;
+  for (size_t i = 0; i < inFlight_.size(); ++i) {
+    const auto& pending = slots_[inFlight_[i]];
+    if (pending.state != PendingExchange::State::ABANDONED &&
+        pending.head[0] !=
+            static_cast<uint8_t>(EthernetMessageType::PDO_RXTX_FRAME)) {
+      ++inFlight;
+    }
+  }
+  const size_t window = std::max<size_t>(laneOptions_.bulkWindow, 1);
+  return inFlight < window ? window - inFlight : 0;
+}
+
+bool EthernetConnection::hasWritableRequests() const {
+  return !priorityQueued_.empty() ||
+         (!queued_.empty() && bulkBudget(std::chrono::steady_clock::now()) > 0);
+}
+
+void EthernetConnection::flush(
+    std::unique_lock<std::mutex>& lock,
+    std::chrono::steady_clock::time_point deadline) {
+  const auto now = std::chrono::steady_clock::now();
+  size_t count = 0;
+  auto take = [this, now, &count](SlotQueue& queue) {
+    const size_t slot = queue.front();
+    queue.pop();
+
+    auto& pending = slots_[slot];
+    gather_[count++] =
+        boost::asio::buffer(pending.head.data(), pending.headSize);
+    gather_[count++] =
+        boost::asio::buffer(pending.payload.data(), pending.payload.size());
+    pending.state = PendingExchange::State::SENDING;
+    pending.sentAt = now;
+    inFlight_.push(slot);
+  };
+
+  while (!priorityQueued_.empty()) {
+    take(priorityQueued_);
+  }
+  for (size_t budget = bulkBudget(now);
+       budget > 0 && !queued_.empty(); --budget) {
+    take(queued_);
+  }
+
+  lock.unlock();
+  boost::system::error_code ec;
+  boost::asio::async_write(
+      socket_, std::span(gather_.data(), count),
+      makeHandler([&ec](const boost::system::error_code& error, size_t) {
+        ec = error;
+      }));
+  runUntil(deadline);
+  lock.lock();
+
+  if (ec) {
+    LOG_F(ERROR, "Write failed or timed out: %s", ec.message().c_str());
+    failPending(ec, "Failed to write request or timed out while writing");
+    return;
+  }
+
+  const auto writtenAt = tracer_ != nullptr
+                             ? std::chrono::steady_clock::now()
+                             : std::chrono::steady_clock::time_point{};
+  for (auto& pending : slots_) {
+    if (pending.state == PendingExchange::State::SENDING) {
+      pending.state = PendingExchange::State::SENT;
+      pending.writtenAt = writtenAt;
+      statistics_.recordSent(
+          static_cast<EthernetMessageType>(pending.head[0]),
+          pending.headSize + pending.payload.size());
+    }
+  }
+}
+
+void EthernetConnection::receive(
+    std::unique_lock<std::mutex>& lock,
+    std::chrono::steady_clock::time_point deadline) {
+  // Read as much as is available and frame the responses out of the receive
+  // buffer; messages that arrive together cost a single read
+  ++readGeneration_;
+  lock.unlock();
+  const std::span<uint8_t> space = reader_.prepare();
+  boost::system::error_code ec;
+  size_t received = 0;
+  readOutstanding_ = true;
+  socket_.async_read_some(
+      boost::asio::buffer(space.data(), space.size()),
+      makeHandler([this, &ec, &received](
+                      const boost::system::error_code& error, size_t bytes) {
+        readOutstanding_ = false;
+        ec = error;
+        received = bytes;
+      }));
+  runUntil(deadline);
+  lock.lock();
+
+  if (ec == boost::asio::error::operation_aborted) {
+    // The deadline of the reading thread expired, or a process data request
+    // has to be written; the responses may still arrive
+    return;
+  }
+
+  if (ec) {
+    LOG_F(ERROR, "Read failed: %s", ec.message().c_str());
+    failPending(ec, "Failed to read response");
+    return;
+  }
+
+  // A response starts in the read that brought its first byte; only the
+  // first message taken out of the buffer may have started earlier
+  const auto readAt = tracer_ != nullptr
+                          ? std::chrono::steady_clock::now()
+                          : std::chrono::steady_clock::time_point{};
+  if (reader_.size() == 0) {
+    messageStart_ = readAt;
+  }
+  reader_.commit(received);
+  try {
+    EthernetMessageView message;
+    while (reader_.next(message)) {
+      statistics_.recordReceived(message);
+      dispatch(message);
+      messageStart_ = readAt;
+    }
+  } catch (const std::runtime_error& e) {
+    LOG_F(ERROR, "%s", e.what());
+    failPending(boost::asio::error::message_size,
+                "Failed to read response");
+  }
+}
+
+void EthernetConnection::dispatch(const EthernetMessageView& message) {
+  using State = PendingExchange::State;
+
+  const auto type = static_cast<uint8_t>(message.type);
+  size_t position = 0;
+  while (position < inFlight_.size() &&
+         (slots_[inFlight_[position]].id != message.id ||
+          slots_[inFlight_[position]].head[0] != type)) {
+    ++position;
+  }
+
+  if (position == inFlight_.size()) {
+    if (streaming_ &&
+        message.type == EthernetMessageType::PDO_RXTX_FRAME) {
+      deliverStreamFrame(message);
+      return;
+    }
+
+    // Most likely the late response to a request that timed out
+    unmatchedMessageCount_.fetch_add(1, std::memory_order_relaxed);
+    if (unmatchedMessageHandler_) {
+      unmatchedMessageHandler_(message);
+    } else {
+      ASYNC_LOG_F(WARNING, "Discarding stale response with sequence ID %d",
+                  message.id);
+    }
+    return;
+  }
+
+  // The device answers requests in order, so abandoned requests sent before
+  // this one will not be answered anymore and their slots can be reused
+  for (size_t i = 0; i < position;) {
+    const size_t slot = inFlight_[i];
+    if (slots_[slot].state == State::ABANDONED) {
+      slots_[slot].state = State::FREE;
+      inFlight_.erase(slot);
+      --position;
+    } else {
+      ++i;
+    }
+  }
+
+  const size_t slot = inFlight_[position];
+  inFlight_.erase(slot);
+
+  auto& pending = slots_[slot];
+  if (pending.state == State::ABANDONED) {
+    pending.state = State::FREE;
+    return;
+  }
+
+  statistics_.recordRoundTrip(std::chrono::steady_clock::now() -
+                              pending.sentAt);
+  pending.message = message;
+  if (pending.response.data() == nullptr) {
+    pending.message.data = {};
+  } else if (message.data.size() > pending.response.size()) {
+    pending.failure = "Response payload exceeds the provided buffer";
+    pending.state = State::FAILED;
+    return;
+  } else {
+    std::copy(message.data.begin(), message.data.end(),
+              pending.response.begin());
+    pending.message.data = pending.response.first(message.data.size());
+  }
+  if (pending.traced) {
+    pending.firstByteAt = messageStart_;
+    pending.parsedAt = std::chrono::steady_clock::now();
+  }
+  pending.state = State::COMPLETED;
+}
+
+void EthernetConnection::setUnmatchedMessageHandler(
+    std::function<void(const EthernetMessageView&)> handler) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  unmatchedMessageHandler_ = std::move(handler);
+}
+
+bool EthernetConnection::startProcessDataStream(
+    std::chrono::microseconds period, ProcessDataHandler handler,
+    const std::chrono::steady_clock::duration expiryTime) {
+  const auto periodUs = static_cast<uint32_t>(period.count());
+  const std::array<uint8_t, 5> payload{
+      1, static_cast<uint8_t>(periodUs), static_cast<uint8_t>(periodUs >> 8),
+      static_cast<uint8_t>(periodUs >> 16),
+      static_cast<uint8_t>(periodUs >> 24)};
+
+  {
+    // Frames may follow the acknowledgment immediately, so the handler has
+    // to be in place before the request is sent
+    std::lock_guard<std::mutex> lock(mutex_);
+    streaming_ = true;
+    streamPeriod_ = period;
+    streamHandler_ = std::move(handler);
+    streamStats_ = {};
+  }
+
+  bool started = false;
+  try {
+    auto message = exchangeWithTimeout(EthernetMessageType::PDO_CONTROL,
+                                       payload, {}, expiryTime);
+    started = message.status == EthernetMessageStatus::OK;
+  } catch (const std::runtime_error&) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streaming_ = false;
+    throw;
+  }
+
+  if (!started) {
+    LOG_F(ERROR, "Failed to start the process data stream");
+    std::lock_guard<std::mutex> lock(mutex_);
+    streaming_ = false;
+  }
+  return started;
+}
+
+bool EthernetConnection::stopProcessDataStream(
+    const std::chrono::steady_clock::duration expiryTime) {
+  const std::array<uint8_t, 1> payload{0};
+  auto message = exchangeWithTimeout(EthernetMessageType::PDO_CONTROL,
+                                     payload, {}, expiryTime);
+  if (message.status != EthernetMessageStatus::OK) {
+    LOG_F(ERROR, "Failed to stop the process data stream");
+    return false;
+  }
+
+  // Frames pushed before the device stopped have been delivered by now, as
+  // they precede the acknowledgment on the stream
+  std::lock_guard<std::mutex> lock(mutex_);
+  streaming_ = false;
+  return true;
+}
+
+size_t EthernetConnection::pumpProcessDataStream(
+    std::chrono::steady_clock::duration timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::unique_lock<std::mutex> lock(mutex_);
+  const uint64_t before = streamStats_.frames;
+
+  while (streamStats_.frames == before &&
+         std::chrono::steady_clock::now() < deadline) {
+    if (!socket_.is_open()) {
+      throw std::runtime_error("Process data stream connection is closed");
+    }
+
+    if (ioBusy_) {
+      condition_.wait_until(lock, deadline);
+      continue;
+    }
+
+    ioBusy_ = true;
+    if (hasWritableRequests()) {
+      flush(lock, deadline);
+    } else {
+      receive(lock, deadline);
+    }
+    ioBusy_ = false;
+    condition_.notify_all();
+  }
+
+  return streamStats_.frames - before;
+}
+
+EthernetConnection::ProcessDataStreamStats
+EthernetConnection::processDataStreamStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return streamStats_;
+}
+
+void EthernetConnection::setPriorityLaneOptions(
+    const PriorityLaneOptions& options) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  laneOptions_ = options;
+  condition_.notify_all();
+}
+
+void EthernetConnection::setTracer(ExchangeTracer* tracer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  tracer_ = tracer;
+}
+
+void EthernetConnection::deliverStreamFrame(
+    const EthernetMessageView& message) {
+  const auto now = std::chrono::steady_clock::now();
+
+  if (streamStats_.frames > 0) {
+    const uint16_t step = message.id - lastStreamId_;
+    if (step == 0 || step > 0x8000) {
+      ++streamStats_.staleFrames;
+      return;
+    }
+    streamStats_.lostFrames += step - 1;
+    if (step > 1) {
+      statistics_.recordPdoOverruns(step - 1);
+    }
+    if (now - lastStreamArrival_ > streamPeriod_ * step + streamPeriod_ / 2) {
+      ++streamStats_.lateFrames;
+    }
+  }
+
+  lastStreamId_ = message.id;
+  lastStreamArrival_ = now;
+  ++streamStats_.frames;
+  if (streamHandler_) {
+    streamHandler_(message);
+  }
+}
+
+void EthernetConnection::failPending(const boost::system::error_code& error,
+                                     const char* failure) {
+  using State = PendingExchange::State;
+
+  for (auto& pending : slots_) {
+    switch (pending.state) {
+      case State::QUEUED:
+      case State::SENDING:
+      case State::SENT: {
+        pending.failure = failure;
+        pending.error = error;
+        pending.state = State::FAILED;
+        break;
+      }
+      case State::ABANDONED: {
+        pending.state = State::FREE;
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+  priorityQueued_.clear();
+  queued_.clear();
+  inFlight_.clear();
+  reader_.clear();
+
+  // A new connection does not resume the stream, and its frames must not be
+  // compared with those of the old one; the counters are kept for inspection
+  streaming_ = false;
+  streamHandler_ = nullptr;
+  lastStreamId_ = 0;
+  lastStreamArrival_ = {};
+
+  // Part of a frame may have been written or read, so the stream cannot be
+  // trusted anymore
+  boost::system::error_code ec;
+  socket_.close(ec);
+}
+
+void EthernetConnection::runUntil(
+    std::chrono::steady_clock::time_point deadline) {
+  ioContext_.restart();
+  ioContext_.run_until(deadline);
+  if (!ioContext_.stopped()) {
+    // The deadline expired; cancel the pending operations and let their
+    // handlers run with boost::asio::error::operation_aborted
+    socket_.cancel();
+    ioContext_.run();
+  }
+}
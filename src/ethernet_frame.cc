@@ -0,0 +1,83 @@
+#include "ethernet_frame.h"
+
+#include <cstring>
+#include <stdexcept>
+
+void serializeEthernetMessageHeader(
+    EthernetMessageType type, uint16_t id, EthernetMessageStatus status,
+    uint16_t size,
+    std::span<uint8_t, EthernetMessage::kHeaderSize> header) noexcept {
+  header[0] = static_cast<uint8_t>(type);
+  header[1] = static_cast<uint8_t>(id & 0xFF);
+  header[2] = static_cast<uint8_t>(id >> 8);
+  header[3] = static_cast<uint8_t>(status);
+  header[4] = 0;
+  header[5] = static_cast<uint8_t>(size & 0xFF);
+  header[6] = static_cast<uint8_t>(size >> 8);
+}
+
+void parseEthernetMessageHeader(
+    std::span<const uint8_t, EthernetMessage::kHeaderSize> header,
+    EthernetMessageView& message) noexcept {
+  message.type = static_cast<EthernetMessageType>(header[0]);
+  message.id = static_cast<uint16_t>(header[1] | (header[2] << 8));
+  message.sqiStatus = static_cast<EthernetSqiReplyStatus>(header[3]);
+  message.status = static_cast<EthernetMessageStatus>(header[4]);
+  message.size = static_cast<uint16_t>(header[5] | (header[6] << 8));
+  message.data = {};
+}
+
+size_t parseEthernetMessageView(std::span<const uint8_t> buffer,
+                                EthernetMessageView& message) noexcept {
+  if (buffer.size() < EthernetMessage::kHeaderSize) {
+    return 0;
+  }
+
+  parseEthernetMessageHeader(buffer.first<EthernetMessage::kHeaderSize>(),
+                             message);
+
+  const size_t frameSize = EthernetMessage::kHeaderSize + message.size;
+  if (buffer.size() < frameSize) {
+    return 0;
+  }
+
+  message.data = buffer.subspan(EthernetMessage::kHeaderSize, message.size);
+  return frameSize;
+}
+
+std::span<uint8_t> EthernetFrameReader::prepare() noexcept {
+  if (begin_ == end_) {
+    begin_ = end_ = 0;
+  } else if (kCapacity - end_ < kMaxFrameSize) {
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+
+  return std::span(buffer_).subspan(end_);
+}
+
+void EthernetFrameReader::commit(size_t size) noexcept { end_ += size; }
+
+bool EthernetFrameReader::next(EthernetMessageView& message) {
+  const std::span<const uint8_t> received(buffer_.data() + begin_,
+                                          end_ - begin_);
+  if (received.size() < EthernetMessage::kHeaderSize) {
+    return false;
+  }
+
+  parseEthernetMessageHeader(received.first<EthernetMessage::kHeaderSize>(),
+                             message);
+  if (message.size > EthernetMessage::kBufferSize) {
+    throw std::runtime_error("Received message exceeds the buffer size");
+  }
+
+  const size_t frameSize = EthernetMessage::kHeaderSize + message.size;
+  if (received.size() < frameSize) {
+    return false;
+  }
+
+  message.data = received.subspan(EthernetMessage::kHeaderSize, message.size);
+  begin_ += frameSize;
+  return true;
+}
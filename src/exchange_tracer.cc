@@ -0,0 +1,148 @@
+#include "exchange_tracer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "device_statistics.h"
+#include "loguru.h"
+
+namespace {
+
+/** Source of the instance numbers of the tracers. */
+std::atomic<uint64_t> nextInstance{1};
+
+/**
+ * @brief Rings the calling thread records into, by tracer instance.
+ *
+ * A thread rarely uses more than one tracer, so a linear search is enough.
+ */
+thread_local std::vector<std::pair<uint64_t, void*>> threadRings;
+
+/**
+ * @brief Converts a time point to microseconds since the trace origin.
+ */
+double microseconds(ExchangeTracer::Clock::time_point time,
+                    ExchangeTracer::Clock::time_point origin) {
+  return std::chrono::duration<double, std::micro>(time - origin).count();
+}
+
+}  // namespace
+
+ExchangeTracer::ExchangeTracer(size_t capacity)
+    : instance_(nextInstance.fetch_add(1, std::memory_order_relaxed)),
+      capacity_(std::max<size_t>(capacity, 1)) {}
+
+void ExchangeTracer::record(const Span& span) {
+  Ring& ring = this->ring();
+
+  Span stamped = span;
+  stamped.thread = ring.thread;
+  const auto words = std::bit_cast<std::array<uint64_t, kSpanWords>>(stamped);
+
+  // Only this thread writes the ring, so no claim is needed
+  const uint64_t position = ring.written.load(std::memory_order_relaxed);
+  Entry& entry = ring.entries[position % capacity_];
+  entry.sequence.store(2 * position + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < kSpanWords; ++i) {
+    entry.words[i].store(words[i], std::memory_order_relaxed);
+  }
+  entry.sequence.store(2 * position + 2, std::memory_order_release);
+  ring.written.store(position + 1, std::memory_order_release);
+}
+
+std::vector<ExchangeTracer::Span> ExchangeTracer::spans() const {
+  std::vector<Span> spans;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& ring : rings_) {
+    const uint64_t written = ring->written.load(std::memory_order_acquire);
+    const uint64_t first = written > capacity_ ? written - capacity_ : 0;
+    for (uint64_t position = first; position < written; ++position) {
+      const Entry& entry = ring->entries[position % capacity_];
+      const uint64_t sequence = entry.sequence.load(std::memory_order_acquire);
+      if (sequence != 2 * position + 2) {
+        continue;
+      }
+
+      std::array<uint64_t, kSpanWords> words;
+      for (size_t i = 0; i < kSpanWords; ++i) {
+        words[i] = entry.words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (entry.sequence.load(std::memory_order_relaxed) != sequence) {
+        continue;
+      }
+
+      spans.push_back(std::bit_cast<Span>(words));
+    }
+  }
+
+  std::sort(spans.begin(), spans.end(), [](const Span& lhs, const Span& rhs) {
+    return lhs.enqueue < rhs.enqueue;
+  });
+  return spans;
+}
+
+std::string ExchangeTracer::chromeTrace() const {
+  const std::vector<Span> spans = this->spans();
+  const Clock::time_point origin =
+      spans.empty() ? Clock::time_point{} : spans.front().enqueue;
+
+  std::string output = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  char event[320];
+  auto slice = [&](const char* name, uint32_t thread, Clock::time_point begin,
+                   Clock::time_point end, const char* args) {
+    std::snprintf(event, sizeof(event),
+                  "%s\n{\"name\":\"%s\",\"cat\":\"exchange\",\"ph\":\"X\","
+                  "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f%s}",
+                  first ? "" : ",", name, thread,
+                  microseconds(begin, origin),
+                  microseconds(std::max(begin, end), begin), args);
+    output += event;
+    first = false;
+  };
+
+  for (const auto& span : spans) {
+    char args[160];
+    std::snprintf(args, sizeof(args),
+                  ",\"args\":{\"id\":%u,\"requestSize\":%u,"
+                  "\"responseSize\":%u}",
+                  span.id, span.requestSize, span.responseSize);
+    slice(DeviceStatistics::slotName(DeviceStatistics::slotOf(span.type)),
+          span.thread, span.enqueue, span.parseComplete, args);
+    slice("queue", span.thread, span.enqueue, span.writeStart, "");
+    slice("write", span.thread, span.writeStart, span.writeComplete, "");
+    slice("device", span.thread, span.writeComplete, span.firstByte, "");
+    slice("receive", span.thread, span.firstByte, span.parseComplete, "");
+  }
+  output += "\n]}\n";
+  return output;
+}
+
+void ExchangeTracer::writeChromeTrace(const std::string& path) const {
+  const std::string trace = chromeTrace();
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+  if (!file) {
+    LOG_F(ERROR, "Failed to write the trace to %s", path.c_str());
+    throw std::runtime_error("Failed to write the trace to " + path);
+  }
+}
+
+ExchangeTracer::Ring& ExchangeTracer::ring() {
+  for (const auto& [instance, ring] : threadRings) {
+    if (instance == instance_) {
+      return *static_cast<Ring*>(ring);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& ring = rings_.emplace_back(std::make_unique<Ring>(
+      static_cast<uint32_t>(rings_.size() + 1), capacity_));
+  threadRings.emplace_back(instance_, ring.get());
+  return *ring;
+}
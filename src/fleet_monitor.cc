@@ -0,0 +1,230 @@
+#include "fleet_monitor.h"
+
+#include "loguru.h"
+
+FleetMonitor::FleetMonitor(StateHandler handler)
+    : FleetMonitor(std::move(handler), Options{}) {}
+
+FleetMonitor::FleetMonitor(StateHandler handler, const Options& options)
+    : handler_(std::move(handler)),
+      options_(options),
+      ticker_(context_),
+      wheel_(options.tick) {}
+
+FleetMonitor::~FleetMonitor() { stop(); }
+
+size_t FleetMonitor::add(const std::string& ip, unsigned short port) {
+  devices_.push_back(std::make_unique<Device>(
+      context_,
+      boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(ip),
+                                     port)));
+  return devices_.size() - 1;
+}
+
+void FleetMonitor::start() {
+  if (thread_.joinable()) {
+    return;
+  }
+
+  context_.restart();
+  wheel_ = TimerWheel(options_.tick);
+  // Ids of the previous wheel would collide with those of the new one
+  for (auto& device : devices_) {
+    device->pollTimer = TimerWheel::kInvalidTimer;
+    device->timeoutTimer = TimerWheel::kInvalidTimer;
+    device->connected = false;
+    device->pending = false;
+  }
+
+  // Spread the polls of the devices evenly over the period
+  const auto now = Clock::now();
+  for (size_t i = 0; i < devices_.size(); ++i) {
+    devices_[i]->nextPoll =
+        now + options_.period * static_cast<int64_t>(i) /
+                  static_cast<int64_t>(devices_.size());
+    connect(i);
+  }
+  tick();
+
+  thread_ = std::thread([this] { context_.run(); });
+}
+
+void FleetMonitor::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  // Close everything on the monitor thread; run() returns once the aborted
+  // handlers have completed
+  boost::asio::post(context_, [this] {
+    for (auto& device : devices_) {
+      ++device->generation;
+      device->connected = false;
+      device->pending = false;
+      boost::system::error_code ec;
+      device->socket.close(ec);
+    }
+    ticker_.cancel();
+  });
+  thread_.join();
+}
+
+void FleetMonitor::connect(size_t index) {
+  Device& device = *devices_[index];
+  const uint32_t generation = ++device.generation;
+  device.reader.clear();
+
+  device.socket.async_connect(
+      device.endpoint,
+      AllocatingHandler(device.handlerMemory, [this, index, generation](
+                                                  boost::system::error_code
+                                                      ec) {
+        Device& device = *devices_[index];
+        if (generation != device.generation) {
+          return;
+        }
+        if (ec) {
+          fail(index);
+          return;
+        }
+
+        device.connected = true;
+        device.socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+        read(index);
+        device.nextPoll = std::max(device.nextPoll, Clock::now());
+        device.pollTimer = wheel_.schedule(
+            device.nextPoll, timerValue(index, TimerKind::POLL));
+      }));
+}
+
+void FleetMonitor::poll(size_t index) {
+  Device& device = *devices_[index];
+  device.pollTimer = TimerWheel::kInvalidTimer;
+  if (!device.connected) {
+    return;
+  }
+
+  const auto now = Clock::now();
+  if (!device.pending) {
+    serializeEthernetMessageHeader(EthernetMessageType::STATE_READ,
+                                   ++device.sequenceId,
+                                   EthernetMessageStatus::OK, 0,
+                                   device.request);
+    const uint32_t generation = device.generation;
+    boost::asio::async_write(
+        device.socket, boost::asio::buffer(device.request),
+        AllocatingHandler(device.handlerMemory,
+                          [this, index, generation](
+                              boost::system::error_code ec, size_t) {
+                            if (ec && generation ==
+                                          devices_[index]->generation) {
+                              fail(index);
+                            }
+                          }));
+    device.pending = true;
+    device.timeoutTimer = wheel_.schedule(
+        now + options_.timeout, timerValue(index, TimerKind::TIMEOUT));
+  }
+
+  // Keep the phase, but do not try to catch up on missed polls
+  device.nextPoll += options_.period;
+  if (device.nextPoll <= now) {
+    device.nextPoll = now + options_.period;
+  }
+  device.pollTimer =
+      wheel_.schedule(device.nextPoll, timerValue(index, TimerKind::POLL));
+}
+
+void FleetMonitor::read(size_t index) {
+  Device& device = *devices_[index];
+  const uint32_t generation = device.generation;
+  const std::span<uint8_t> space = device.reader.prepare();
+
+  device.socket.async_read_some(
+      boost::asio::buffer(space.data(), space.size()),
+      AllocatingHandler(device.handlerMemory, [this, index, generation](
+                                                  boost::system::error_code ec,
+                                                  size_t size) {
+        Device& device = *devices_[index];
+        if (generation != device.generation) {
+          return;
+        }
+        if (ec) {
+          fail(index);
+          return;
+        }
+
+        device.reader.commit(size);
+        try {
+          EthernetMessageView message;
+          while (device.reader.next(message)) {
+            if (message.type != EthernetMessageType::STATE_READ ||
+                message.id != device.sequenceId || !device.pending) {
+              continue;
+            }
+            device.pending = false;
+            wheel_.cancel(device.timeoutTimer);
+            publish(index, message.data.empty() ? 0 : message.data[0]);
+          }
+        } catch (const std::exception& e) {
+          LOG_F(ERROR, "Device %zu: %s", index, e.what());
+          fail(index);
+          return;
+        }
+        read(index);
+      }));
+}
+
+void FleetMonitor::fail(size_t index) {
+  Device& device = *devices_[index];
+  ++device.generation;
+  device.connected = false;
+  device.pending = false;
+  wheel_.cancel(device.timeoutTimer);
+  wheel_.cancel(device.pollTimer);
+  device.pollTimer = TimerWheel::kInvalidTimer;
+
+  boost::system::error_code ec;
+  device.socket.close(ec);
+
+  publish(index, 0);
+  wheel_.schedule(Clock::now() + options_.reconnectDelay,
+                  timerValue(index, TimerKind::RECONNECT));
+}
+
+void FleetMonitor::publish(size_t index, uint8_t state) {
+  const uint8_t previous =
+      devices_[index]->state.exchange(state, std::memory_order_relaxed);
+  if (previous != state && handler_) {
+    handler_(index, previous, state);
+  }
+}
+
+void FleetMonitor::onTimer(uint64_t value) {
+  const size_t index = value >> 2;
+  switch (static_cast<TimerKind>(value & 3)) {
+    case TimerKind::POLL:
+      poll(index);
+      break;
+    case TimerKind::TIMEOUT:
+      if (devices_[index]->pending) {
+        LOG_F(WARNING, "Device %zu did not report its state in time", index);
+        fail(index);
+      }
+      break;
+    case TimerKind::RECONNECT:
+      connect(index);
+      break;
+  }
+}
+
+void FleetMonitor::tick() {
+  ticker_.expires_after(options_.tick);
+  ticker_.async_wait([this](boost::system::error_code ec) {
+    if (ec) {
+      return;
+    }
+    wheel_.advance(Clock::now(), [this](uint64_t value) { onTimer(value); });
+    tick();
+  });
+}
@@ -4,6 +4,7 @@
 #include <string>
 
 #include "loguru.h"
+#include "state_waiter.h"
 
 const std::string kIp = "192.168.100.5";
 const int kPort = 8080;
@@ -18,19 +19,20 @@ int main() {
   auto connected = ed.connect();
   LOG_F(INFO, "done.");
 
-  // Set the state to OP (0x08)
-  ed.setState(0x08);
-
   // Check if the socket is now connected
   assert(connected == true);
   assert(ed.isConnected() == true);
 
-  LOG_F(INFO, "Getting state...");
-  auto state = ed.getState();
-  LOG_F(INFO, "done. State: %d", state);
-
-  // Expecting state to be OP (0x08)
-  assert(state == 0x08);
+  // Set the state to OP (0x08) and wait until the device reaches it
+  LOG_F(INFO, "Switching to OP...");
+  ed.setState(0x08);
+  auto reached = waitForState(
+      ed, 0x08, std::chrono::steady_clock::now() + std::chrono::seconds(10));
+  if (!reached) {
+    LOG_F(ERROR, "Device did not reach OP. State: %d", ed.getState());
+    return 1;
+  }
+  LOG_F(INFO, "done.");
 
   LOG_F(INFO, "Loading parameters and reading their values...");
   ed.loadParameters(true);
@@ -0,0 +1,233 @@
+#include "parameter_diff.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "loguru.h"
+
+namespace {
+
+/**
+ * @brief Diffs a target configuration against current parameters found with
+ * `lookup`, which returns nullptr for parameters the device does not have.
+ */
+template <typename Lookup>
+ParameterDiff diff(std::span<const common::Parameter> target, Lookup lookup,
+                   const ParameterDiffOptions& options) {
+  const auto writeAccess = static_cast<uint16_t>(options.writeAccess);
+  // The device reports the access rights in `flags`; `access` stays zero in
+  // the parameters of `getParameters` and `loadParameters`
+  auto writable = [&](const common::Parameter& parameter) {
+    return (static_cast<uint16_t>(parameter.flags) & writeAccess) != 0;
+  };
+
+  std::vector<const common::Parameter*> sorted;
+  sorted.reserve(target.size());
+  for (const auto& parameter : target) {
+    sorted.push_back(&parameter);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const common::Parameter* lhs, const common::Parameter* rhs) {
+              return *lhs < *rhs;
+            });
+
+  ParameterDiff result;
+  std::vector<const common::Parameter*> entries;
+
+  for (size_t begin = 0; begin < sorted.size();) {
+    const uint16_t index = sorted[begin]->index;
+    size_t end = begin;
+    while (end < sorted.size() && sorted[end]->index == index) {
+      ++end;
+    }
+
+    // Collect the changed subindices of this object
+    entries.clear();
+    const common::Parameter* targetCount = nullptr;
+    for (size_t i = begin; i < end; ++i) {
+      const auto& wanted = *sorted[i];
+      if (wanted.data.empty()) {
+        continue;
+      }
+      const common::Parameter* present = lookup(index, wanted.subindex);
+      if (present == nullptr) {
+        ++result.unknown;
+      } else if (present->data == wanted.data) {
+        ++result.unchanged;
+      } else if (!writable(*present)) {
+        ++result.readOnly;
+      } else if (wanted.subindex == 0) {
+        targetCount = &wanted;
+      } else {
+        entries.push_back(&wanted);
+      }
+    }
+    begin = end;
+
+    // Entries may only be written while a writable count is zero
+    const common::Parameter* count = lookup(index, 0);
+    const bool countGuards = !entries.empty() && count != nullptr &&
+                             writable(*count) &&
+                             std::any_of(count->data.begin(),
+                                         count->data.end(),
+                                         [](uint8_t byte) { return byte; });
+    if (countGuards) {
+      result.changes.push_back(
+          {index, 0, std::vector<uint8_t>(count->data.size(), 0)});
+    }
+    for (const auto* entry : entries) {
+      result.changes.push_back({index, entry->subindex, entry->data});
+    }
+    if (targetCount != nullptr) {
+      result.changes.push_back({index, 0, targetCount->data});
+    } else if (countGuards) {
+      result.changes.push_back({index, 0, count->data});
+    }
+  }
+
+  return result;
+}
+
+/**
+ * @brief Writes changes as one pipelined batch.
+ *
+ * @param cleared Whether the count of the object of the changes is cleared,
+ * which the error then reports.
+ *
+ * @throws std::runtime_error If a write fails or times out.
+ */
+void writeChanges(EthernetConnection& connection,
+                  const std::vector<const ParameterChange*>& changes,
+                  const std::chrono::steady_clock::duration expiryTime,
+                  bool cleared) {
+  // One buffer for all values, since the transfers need mutable spans
+  size_t size = 0;
+  for (const auto* change : changes) {
+    size += change->data.size();
+  }
+  std::vector<uint8_t> values;
+  values.reserve(size);
+  std::vector<SdoTransfer> transfers;
+  transfers.reserve(changes.size());
+  for (const auto* change : changes) {
+    const size_t offset = values.size();
+    values.insert(values.end(), change->data.begin(), change->data.end());
+    transfers.push_back({change->index, change->subindex,
+                         std::span(values).subspan(offset,
+                                                   change->data.size())});
+  }
+
+  const std::string leftCleared =
+      cleared ? "; left cleared: " +
+                    common::makeParameterId(changes.front()->index, 0)
+              : "";
+  try {
+    connection.writeSdos(transfers, expiryTime);
+  } catch (const std::runtime_error& e) {
+    LOG_F(ERROR, "%s%s", e.what(), leftCleared.c_str());
+    throw std::runtime_error(e.what() + leftCleared);
+  }
+
+  for (const auto& transfer : transfers) {
+    if (!transfer.success) {
+      LOG_F(ERROR, "Failed to write SDO 0x%04X:%02X%s", transfer.index,
+            transfer.subindex, leftCleared.c_str());
+      throw std::runtime_error(
+          "Failed to write " +
+          common::makeParameterId(transfer.index, transfer.subindex) +
+          leftCleared);
+    }
+  }
+}
+
+}  // namespace
+
+ParameterDiff diffParameters(std::span<const common::Parameter> target,
+                             std::span<const common::Parameter> current,
+                             const ParameterDiffOptions& options) {
+  std::unordered_map<common::ParameterKey, const common::Parameter*> byKey;
+  byKey.reserve(current.size());
+  for (const auto& parameter : current) {
+    byKey.emplace(common::ParameterKey{parameter.index, parameter.subindex},
+                  &parameter);
+  }
+
+  return diff(
+      target,
+      [&](uint16_t index, uint8_t subindex) -> const common::Parameter* {
+        auto it = byKey.find({index, subindex});
+        return it != byKey.end() ? it->second : nullptr;
+      },
+      options);
+}
+
+ParameterDiff diffParameters(
+    std::span<const common::Parameter> target,
+    const std::unordered_map<common::ParameterKey, common::Parameter>& current,
+    const ParameterDiffOptions& options) {
+  return diff(
+      target,
+      [&](uint16_t index, uint8_t subindex) -> const common::Parameter* {
+        auto it = current.find({index, subindex});
+        return it != current.end() ? &it->second : nullptr;
+      },
+      options);
+}
+
+ParameterDiff diffParameters(std::span<const common::Parameter> target,
+                             EthernetDevice& device,
+                             const ParameterDiffOptions& options) {
+  return diff(
+      target,
+      [&](uint16_t index, uint8_t subindex) -> const common::Parameter* {
+        try {
+          return &device.findParameter(index, subindex);
+        } catch (const std::exception&) {
+          return nullptr;
+        }
+      },
+      options);
+}
+
+void applyParameterDiff(EthernetConnection& connection,
+                        const ParameterDiff& diff,
+                        const std::chrono::steady_clock::duration expiryTime) {
+  // A guarded object starts with clearing its count and ends with restoring
+  // it, see `diff`; everything else goes out in one batch up front
+  std::vector<const ParameterChange*> unguarded;
+  std::vector<std::span<const ParameterChange>> guarded;
+  const std::span<const ParameterChange> changes(diff.changes);
+  for (size_t begin = 0; begin < changes.size();) {
+    size_t end = begin + 1;
+    while (end < changes.size() && changes[end].index == changes[begin].index) {
+      ++end;
+    }
+    if (end - begin > 1 && changes[begin].subindex == 0) {
+      guarded.push_back(changes.subspan(begin, end - begin));
+    } else {
+      for (size_t i = begin; i < end; ++i) {
+        unguarded.push_back(&changes[i]);
+      }
+    }
+    begin = end;
+  }
+
+  if (!unguarded.empty()) {
+    writeChanges(connection, unguarded, expiryTime, false);
+  }
+
+  // Each step of a guarded object is only sent once the previous one
+  // succeeded, so the count is never restored over a failed entry
+  std::vector<const ParameterChange*> step;
+  for (const auto& object : guarded) {
+    step = {&object.front()};
+    writeChanges(connection, step, expiryTime, false);
+    step.clear();
+    for (const auto& change : object.subspan(1, object.size() - 2)) {
+      step.push_back(&change);
+    }
+    writeChanges(connection, step, expiryTime, true);
+    step = {&object.back()};
+    writeChanges(connection, step, expiryTime, true);
+  }
+}
@@ -0,0 +1,210 @@
+#include "parameter_dump.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+#include "loguru.h"
+
+namespace {
+
+/** Typical length of a formatted line, used to size the buffer up front. */
+constexpr size_t kTypicalLineSize = 128;
+
+/**
+ * @brief Appends a number with `std::to_chars`.
+ */
+template <typename T, typename... Args>
+void appendNumber(std::string& output, T value, Args... args) {
+  char buffer[64];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, args...);
+  output.append(buffer, result.ptr);
+}
+
+/**
+ * @brief Appends an unsigned number padded with zeros to `width` digits.
+ */
+void appendPadded(std::string& output, unsigned value, int base, size_t width) {
+  char buffer[16];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, base);
+  const size_t digits = result.ptr - buffer;
+  if (digits < width) {
+    output.append(width - digits, '0');
+  }
+  output.append(buffer, digits);
+}
+
+/**
+ * @brief Appends a number in the form printf's `%#0<width>x` produces.
+ */
+void appendAlternateHex(std::string& output, unsigned value, size_t width) {
+  if (value == 0) {
+    output.append(width, '0');
+    return;
+  }
+  output.append("0x");
+  appendPadded(output, value, 16, width - 2);
+}
+
+/**
+ * @brief Reads an integer of type `T` from the little-endian bytes of a
+ * value, sign-extending values shorter than `T`.
+ */
+template <typename T>
+T readInteger(const std::vector<uint8_t>& data) {
+  using Unsigned = std::make_unsigned_t<T>;
+  const size_t size = std::min(data.size(), sizeof(T));
+  Unsigned bits = 0;
+  for (size_t i = 0; i < size; ++i) {
+    bits |= static_cast<Unsigned>(data[i]) << (8 * i);
+  }
+  if constexpr (std::is_signed_v<T>) {
+    if (size > 0 && size < sizeof(T) && (data[size - 1] & 0x80)) {
+      bits |= static_cast<Unsigned>(~Unsigned{0} << (8 * size));
+    }
+  }
+  return static_cast<T>(bits);
+}
+
+/**
+ * @brief Appends the value of a parameter the way
+ * `convertParameterValueToString` formats it.
+ */
+void appendValue(std::string& output, const common::Parameter& parameter) {
+  using common::ObjectDataType;
+  const auto& data = parameter.data;
+
+  switch (parameter.dataType) {
+    case ObjectDataType::BOOLEAN:
+      output.append(!data.empty() && data[0] ? "true" : "false");
+      break;
+    case ObjectDataType::INTEGER8:
+      appendNumber(output, readInteger<int8_t>(data));
+      break;
+    case ObjectDataType::INTEGER16:
+      appendNumber(output, readInteger<int16_t>(data));
+      break;
+    case ObjectDataType::INTEGER24:
+    case ObjectDataType::INTEGER32:
+      appendNumber(output, readInteger<int32_t>(data));
+      break;
+    case ObjectDataType::INTEGER64:
+      appendNumber(output, readInteger<int64_t>(data));
+      break;
+    case ObjectDataType::UNSIGNED8:
+    case ObjectDataType::PDO_MAPPING:
+    case ObjectDataType::IDENTITY:
+    case ObjectDataType::COMMAND_PAR:
+    case ObjectDataType::RECORD:
+      appendNumber(output, readInteger<uint8_t>(data));
+      break;
+    case ObjectDataType::UNSIGNED16:
+      appendNumber(output, readInteger<uint16_t>(data));
+      break;
+    case ObjectDataType::UNSIGNED24:
+    case ObjectDataType::UNSIGNED32:
+      appendNumber(output, readInteger<uint32_t>(data));
+      break;
+    case ObjectDataType::UNSIGNED64:
+      appendNumber(output, readInteger<uint64_t>(data));
+      break;
+    case ObjectDataType::REAL32: {
+      // std::to_string formats floating-point values with six decimals
+      float value = 0.0f;
+      std::memcpy(&value, data.data(), std::min(data.size(), sizeof(value)));
+      appendNumber(output, value, std::chars_format::fixed, 6);
+      break;
+    }
+    case ObjectDataType::REAL64: {
+      double value = 0.0;
+      std::memcpy(&value, data.data(), std::min(data.size(), sizeof(value)));
+      appendNumber(output, value, std::chars_format::fixed, 6);
+      break;
+    }
+    case ObjectDataType::VISIBLE_STRING:
+    case ObjectDataType::OCTET_STRING:
+    case ObjectDataType::UNICODE_STRING: {
+      auto end = std::find(data.begin(), data.end(), 0);
+      output.append(data.begin(), end);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Appends one line describing a parameter.
+ */
+void appendLine(std::string& output, size_t number,
+                const common::Parameter& parameter) {
+  output.append("  #");
+  appendPadded(output, static_cast<unsigned>(number), 10, 3);
+  output.append("  Index: ");
+  appendAlternateHex(output, parameter.index, 6);
+  output.append(", Subindex: ");
+  appendAlternateHex(output, parameter.subindex, 4);
+  output.append(", Length: ");
+  const size_t start = output.size();
+  appendNumber(output, parameter.bitLength);
+  if (output.size() - start < 4) {
+    output.insert(start, 4 - (output.size() - start), ' ');
+  }
+  output.append(" bits, Access Type: ");
+  appendAlternateHex(output, static_cast<uint16_t>(parameter.access), 6);
+  output.append(", Name: \"");
+  output.append(parameter.name);
+  output.append("\", Value: ");
+  appendValue(output, parameter);
+  output.push_back('\n');
+}
+
+}  // namespace
+
+size_t formatParametersMap(
+    const std::unordered_map<common::ParameterKey, common::Parameter>&
+        parametersMap,
+    std::string& output, const ParameterDumpOptions& options) {
+  const auto required = static_cast<uint16_t>(options.requiredFlags);
+
+  std::vector<const common::Parameter*> selected;
+  selected.reserve(parametersMap.size());
+  for (const auto& [key, parameter] : parametersMap) {
+    if (parameter.index < options.firstIndex ||
+        parameter.index > options.lastIndex ||
+        (static_cast<uint16_t>(parameter.flags) & required) != required) {
+      continue;
+    }
+    selected.push_back(&parameter);
+  }
+
+  if (options.sortParameters) {
+    std::sort(selected.begin(), selected.end(),
+              [](const common::Parameter* lhs, const common::Parameter* rhs) {
+                return *lhs < *rhs;
+              });
+  }
+
+  output.reserve(output.size() + selected.size() * kTypicalLineSize);
+  for (size_t i = 0; i < selected.size(); ++i) {
+    appendLine(output, i + 1, *selected[i]);
+  }
+
+  return selected.size();
+}
+
+void dumpParametersMap(
+    const std::unordered_map<common::ParameterKey, common::Parameter>&
+        parametersMap,
+    const ParameterDumpOptions& options,
+    const std::function<void(std::string_view)>& sink) {
+  std::string output;
+  const size_t count = formatParametersMap(parametersMap, output, options);
+
+  if (sink) {
+    sink(output);
+  } else {
+    LOG_F(INFO, "%zu parameters:\n%s", count, output.c_str());
+  }
+}
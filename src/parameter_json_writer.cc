@@ -0,0 +1,135 @@
+#include "parameter_json_writer.h"
+
+#include <algorithm>
+#include <cstring>
+
+ParameterJsonWriter::ParameterJsonWriter(Sink sink) : sink_(std::move(sink)) {}
+
+ParameterJsonWriter::ParameterJsonWriter(std::ostream& stream)
+    : sink_([&stream](std::string_view chunk) {
+        stream.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+      }) {}
+
+ParameterJsonWriter::ParameterJsonWriter(std::string& output)
+    : sink_([&output](std::string_view chunk) { output.append(chunk); }) {}
+
+ParameterJsonWriter::~ParameterJsonWriter() { flush(); }
+
+void ParameterJsonWriter::beginArray() {
+  append("[");
+  first_ = true;
+}
+
+void ParameterJsonWriter::endArray() { append("]"); }
+
+void ParameterJsonWriter::write(const common::Parameter& parameter) {
+  if (!first_) {
+    append(",");
+  }
+  first_ = false;
+
+  // Keys in the order nlohmann::json sorts the keys set by to_json
+  append("{\"bitLength\":");
+  number(parameter.bitLength);
+  append(",\"code\":");
+  number(static_cast<uint16_t>(parameter.code));
+  append(",\"data\":[");
+  for (size_t i = 0; i < parameter.data.size(); ++i) {
+    if (i > 0) {
+      append(",");
+    }
+    number(parameter.data[i]);
+  }
+  append("],\"dataType\":");
+  number(static_cast<uint16_t>(parameter.dataType));
+  append(",\"flags\":");
+  number(static_cast<uint16_t>(parameter.flags));
+  append(",\"index\":");
+  number(parameter.index);
+  append(",\"name\":");
+  appendString(parameter.name);
+  append(",\"subindex\":");
+  number(parameter.subindex);
+  append("}");
+}
+
+void ParameterJsonWriter::flush() {
+  if (size_ > 0) {
+    sink_(std::string_view(buffer_.data(), size_));
+    size_ = 0;
+  }
+}
+
+void ParameterJsonWriter::append(std::string_view text) {
+  while (!text.empty()) {
+    reserve(1);
+    const size_t count = std::min(text.size(), kBufferSize - size_);
+    std::memcpy(buffer_.data() + size_, text.data(), count);
+    size_ += count;
+    text.remove_prefix(count);
+  }
+}
+
+void ParameterJsonWriter::appendString(std::string_view text) {
+  static constexpr char kHex[] = "0123456789abcdef";
+
+  append("\"");
+  for (const char c : text) {
+    // Same escapes as nlohmann::json; other bytes, including UTF-8
+    // sequences, are copied as they are
+    reserve(6);
+    char* out = buffer_.data() + size_;
+    auto escape = [&](char escaped) {
+      out[0] = '\\';
+      out[1] = escaped;
+      size_ += 2;
+    };
+    switch (c) {
+      case '"':
+        escape('"');
+        break;
+      case '\\':
+        escape('\\');
+        break;
+      case '\b':
+        escape('b');
+        break;
+      case '\f':
+        escape('f');
+        break;
+      case '\n':
+        escape('n');
+        break;
+      case '\r':
+        escape('r');
+        break;
+      case '\t':
+        escape('t');
+        break;
+      default: {
+        const auto byte = static_cast<unsigned char>(c);
+        if (byte < 0x20) {
+          std::memcpy(out, "\\u00", 4);
+          out[4] = kHex[byte >> 4];
+          out[5] = kHex[byte & 0xF];
+          size_ += 6;
+        } else {
+          out[0] = c;
+          size_ += 1;
+        }
+        break;
+      }
+    }
+  }
+  append("\"");
+}
+
+void writeParametersJson(std::ostream& stream,
+                         std::span<const common::Parameter> parameters) {
+  ParameterJsonWriter writer(stream);
+  writer.beginArray();
+  for (const auto& parameter : parameters) {
+    writer.write(parameter);
+  }
+  writer.endArray();
+}
@@ -0,0 +1,254 @@
+#include "parameter_snapshot.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "loguru.h"
+
+namespace {
+
+constexpr size_t kHeaderSize = sizeof(ParameterSnapshotHeader);
+constexpr size_t kRecordSize = sizeof(ParameterSnapshotRecord);
+
+}  // namespace
+
+std::vector<uint8_t> serializeParameterSnapshot(
+    std::span<const common::Parameter> parameters) {
+  size_t blobSize = 0;
+  for (const auto& parameter : parameters) {
+    blobSize += parameter.name.size() + parameter.data.size();
+  }
+  if (blobSize > UINT32_MAX) {
+    throw std::runtime_error("Parameter snapshot exceeds 4 GiB");
+  }
+
+  ParameterSnapshotHeader header{};
+  std::memcpy(header.magic, kParameterSnapshotMagic, sizeof(header.magic));
+  header.version = kParameterSnapshotVersion;
+  header.recordSize = kRecordSize;
+  header.recordCount = static_cast<uint32_t>(parameters.size());
+  header.blobOffset = kHeaderSize + kRecordSize * parameters.size();
+  header.blobSize = blobSize;
+
+  std::vector<uint8_t> bytes(header.blobOffset + blobSize);
+  uint8_t* records = bytes.data() + kHeaderSize;
+  uint8_t* blob = bytes.data() + header.blobOffset;
+  std::memcpy(bytes.data(), &header, kHeaderSize);
+
+  // Records and blob are filled in the same pass, each front to back
+  uint32_t offset = 0;
+  for (const auto& parameter : parameters) {
+    ParameterSnapshotRecord record{};
+    record.index = parameter.index;
+    record.subindex = parameter.subindex;
+    record.bitLength = parameter.bitLength;
+    record.dataType = static_cast<uint16_t>(parameter.dataType);
+    record.code = static_cast<uint16_t>(parameter.code);
+    record.flags = static_cast<uint16_t>(parameter.flags);
+    record.access = static_cast<uint16_t>(parameter.access);
+    record.byteLength = parameter.byteLength;
+
+    record.nameOffset = offset;
+    record.nameSize = static_cast<uint32_t>(parameter.name.size());
+    std::memcpy(blob + offset, parameter.name.data(), record.nameSize);
+    offset += record.nameSize;
+
+    record.dataOffset = offset;
+    record.dataSize = static_cast<uint32_t>(parameter.data.size());
+    if (record.dataSize > 0) {
+      std::memcpy(blob + offset, parameter.data.data(), record.dataSize);
+    }
+    offset += record.dataSize;
+
+    std::memcpy(records, &record, kRecordSize);
+    records += kRecordSize;
+  }
+
+  return bytes;
+}
+
+void writeParameterSnapshot(const std::string& path,
+                            std::span<const common::Parameter> parameters) {
+  const auto bytes = serializeParameterSnapshot(parameters);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(bytes.data()),
+             static_cast<std::streamsize>(bytes.size()));
+  if (!file) {
+    LOG_F(ERROR, "Failed to write parameter snapshot %s", path.c_str());
+    throw std::runtime_error("Failed to write parameter snapshot " + path);
+  }
+}
+
+ParameterSnapshotView::ParameterSnapshotView(std::span<const uint8_t> bytes)
+    : bytes_(bytes) {
+  ParameterSnapshotHeader header;
+  if (bytes.size() < kHeaderSize) {
+    throw std::runtime_error("Parameter snapshot is truncated");
+  }
+  std::memcpy(&header, bytes.data(), kHeaderSize);
+
+  if (std::memcmp(header.magic, kParameterSnapshotMagic,
+                  sizeof(header.magic)) != 0) {
+    throw std::runtime_error("Not a parameter snapshot");
+  }
+  if (header.version != kParameterSnapshotVersion ||
+      header.recordSize < kRecordSize) {
+    throw std::runtime_error("Unsupported parameter snapshot version " +
+                             std::to_string(header.version));
+  }
+
+  const uint64_t tableEnd =
+      kHeaderSize + uint64_t{header.recordSize} * header.recordCount;
+  if (tableEnd > header.blobOffset || header.blobOffset > bytes.size() ||
+      header.blobSize > bytes.size() - header.blobOffset) {
+    throw std::runtime_error("Parameter snapshot is truncated");
+  }
+
+  recordSize_ = header.recordSize;
+  recordCount_ = header.recordCount;
+  blob_ = bytes.subspan(header.blobOffset, header.blobSize);
+
+  // Check every reference into the blob once, so that accessors need not
+  for (size_t i = 0; i < recordCount_; ++i) {
+    const auto entry = record(i);
+    if (uint64_t{entry.nameOffset} + entry.nameSize > blob_.size() ||
+        uint64_t{entry.dataOffset} + entry.dataSize > blob_.size()) {
+      throw std::runtime_error("Parameter snapshot record " +
+                               std::to_string(i) + " is out of bounds");
+    }
+  }
+}
+
+ParameterSnapshotRecord ParameterSnapshotView::record(
+    size_t i) const noexcept {
+  ParameterSnapshotRecord record;
+  std::memcpy(&record, bytes_.data() + kHeaderSize + i * recordSize_,
+              kRecordSize);
+  return record;
+}
+
+std::string_view ParameterSnapshotView::name(
+    const ParameterSnapshotRecord& record) const noexcept {
+  return {reinterpret_cast<const char*>(blob_.data()) + record.nameOffset,
+          record.nameSize};
+}
+
+std::span<const uint8_t> ParameterSnapshotView::data(
+    const ParameterSnapshotRecord& record) const noexcept {
+  return blob_.subspan(record.dataOffset, record.dataSize);
+}
+
+common::Parameter ParameterSnapshotView::parameter(size_t i) const {
+  const auto entry = record(i);
+  const auto value = data(entry);
+
+  common::Parameter parameter{};
+  parameter.name = name(entry);
+  parameter.index = entry.index;
+  parameter.subindex = entry.subindex;
+  parameter.bitLength = entry.bitLength;
+  parameter.byteLength = entry.byteLength;
+  parameter.dataType = static_cast<common::ObjectDataType>(entry.dataType);
+  parameter.code = static_cast<common::ObjectCode>(entry.code);
+  parameter.flags = static_cast<common::ObjectFlags>(entry.flags);
+  parameter.access = static_cast<common::ObjectFlags>(entry.access);
+  parameter.data.assign(value.begin(), value.end());
+  return parameter;
+}
+
+std::vector<common::Parameter> ParameterSnapshotView::parameters() const {
+  std::vector<common::Parameter> parameters;
+  parameters.reserve(recordCount_);
+  for (size_t i = 0; i < recordCount_; ++i) {
+    parameters.push_back(parameter(i));
+  }
+  return parameters;
+}
+
+MappedParameterSnapshot::MappedParameterSnapshot(const std::string& path)
+    : mapping_(path), view_(mapping_.bytes()) {}
+
+#ifdef _WIN32
+
+MappedParameterSnapshot::FileMapping::FileMapping(const std::string& path) {
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    file_ = nullptr;
+    throw std::runtime_error("Failed to open parameter snapshot " + path);
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+    CloseHandle(file_);
+    throw std::runtime_error("Failed to map parameter snapshot " + path);
+  }
+
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  const void* address =
+      mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if (address == nullptr) {
+    if (mapping_) {
+      CloseHandle(mapping_);
+    }
+    CloseHandle(file_);
+    throw std::runtime_error("Failed to map parameter snapshot " + path);
+  }
+
+  address_ = static_cast<const uint8_t*>(address);
+  size_ = static_cast<size_t>(size.QuadPart);
+}
+
+MappedParameterSnapshot::FileMapping::~FileMapping() {
+  UnmapViewOfFile(address_);
+  CloseHandle(mapping_);
+  CloseHandle(file_);
+}
+
+#else
+
+MappedParameterSnapshot::FileMapping::FileMapping(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open parameter snapshot " + path);
+  }
+
+  struct stat status;
+  if (::fstat(fd, &status) != 0 || status.st_size == 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to map parameter snapshot " + path);
+  }
+
+  void* address = ::mmap(nullptr, static_cast<size_t>(status.st_size),
+                         PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (address == MAP_FAILED) {
+    throw std::runtime_error("Failed to map parameter snapshot " + path);
+  }
+
+  address_ = static_cast<const uint8_t*>(address);
+  size_ = static_cast<size_t>(status.st_size);
+}
+
+MappedParameterSnapshot::FileMapping::~FileMapping() {
+  ::munmap(const_cast<uint8_t*>(address_), size_);
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include "parameter_value_store.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "loguru.h"
+
+namespace {
+
+constexpr size_t kWordSize = sizeof(uint64_t);
+
+/** Retries after which a reader yields to a preempted writer. */
+constexpr unsigned kSpinsBeforeYield = 64;
+
+/**
+ * @brief Returns the number of words needed to hold a value.
+ */
+size_t wordsFor(size_t bytes) { return (bytes + kWordSize - 1) / kWordSize; }
+
+/**
+ * @brief Formats the key of a parameter for error messages.
+ */
+std::string describe(uint16_t index, uint8_t subindex) {
+  char key[16];
+  std::snprintf(key, sizeof(key), "0x%04X:%02X", index, subindex);
+  return key;
+}
+
+}  // namespace
+
+ParameterValueStore::ParameterValueStore(
+    std::span<const common::Parameter> parameters)
+    : slotStorage_(std::make_unique<Slot[]>(parameters.size())) {
+  parameters_.reserve(parameters.size());
+  slots_.reserve(parameters.size());
+
+  // Lay out the values first, so the words can be allocated in one block
+  std::vector<const common::Parameter*> initial;
+  initial.reserve(parameters.size());
+  size_t words = 0;
+  for (const auto& parameter : parameters) {
+    const size_t position = parameters_.size();
+    if (!slots_.try_emplace({parameter.index, parameter.subindex}, position)
+             .second) {
+      continue;
+    }
+
+    auto& slot = slotStorage_[position];
+    const size_t capacity = std::max<size_t>(
+        {parameter.data.size(),
+         static_cast<size_t>(std::max(parameter.byteLength, 0)),
+         (static_cast<size_t>(parameter.bitLength) + 7) / 8});
+    slot.capacity = static_cast<uint32_t>(capacity);
+    slot.offset = words;
+    slot.parameter = position;
+    words += wordsFor(capacity);
+
+    auto& description = parameters_.emplace_back(parameter);
+    description.data.clear();
+    description.data.shrink_to_fit();
+    initial.push_back(&parameter);
+  }
+
+  words_ = std::make_unique<std::atomic<uint64_t>[]>(words);
+  for (size_t i = 0; i < initial.size(); ++i) {
+    store(slotStorage_[i], initial[i]->data);
+  }
+}
+
+void ParameterValueStore::publish(uint16_t index, uint8_t subindex,
+                                  std::span<const uint8_t> value) {
+  auto& slot = slotStorage_[position(index, subindex)];
+  if (value.size() > slot.capacity) {
+    LOG_F(ERROR, "Value of %zu bytes exceeds the %u bytes of %s",
+          value.size(), slot.capacity, describe(index, subindex).c_str());
+    throw std::runtime_error("Value exceeds the capacity of parameter " +
+                             describe(index, subindex));
+  }
+
+  // Claim the slot by making the sequence odd; this only waits for another
+  // writer of the same value, never for a reader
+  uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  for (;;) {
+    if ((sequence & 1) != 0) {
+      std::this_thread::yield();
+      sequence = slot.sequence.load(std::memory_order_relaxed);
+    } else if (slot.sequence.compare_exchange_weak(
+                   sequence, sequence + 1, std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  store(slot, value);
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+uint64_t ParameterValueStore::version(uint16_t index,
+                                      uint8_t subindex) const {
+  const auto& slot = slotStorage_[position(index, subindex)];
+  return slot.sequence.load(std::memory_order_acquire) / 2;
+}
+
+uint64_t ParameterValueStore::read(uint16_t index, uint8_t subindex,
+                                   std::vector<uint8_t>& data) const {
+  return copy(slotStorage_[position(index, subindex)], data);
+}
+
+common::Parameter ParameterValueStore::parameter(uint16_t index,
+                                                 uint8_t subindex) const {
+  const auto& slot = slotStorage_[position(index, subindex)];
+  common::Parameter parameter = parameters_[slot.parameter];
+  copy(slot, parameter.data);
+  return parameter;
+}
+
+size_t ParameterValueStore::position(uint16_t index,
+                                     uint8_t subindex) const {
+  auto it = slots_.find({index, subindex});
+  if (it == slots_.end()) {
+    LOG_F(ERROR, "Parameter %s is not in the value store",
+          describe(index, subindex).c_str());
+    throw std::runtime_error("Parameter " + describe(index, subindex) +
+                             " is not in the value store");
+  }
+  return it->second;
+}
+
+void ParameterValueStore::store(Slot& slot, std::span<const uint8_t> value) {
+  // Words are stored whole, so the tail of the last word is zero padded
+  std::atomic<uint64_t>* words = words_.get() + slot.offset;
+  for (size_t offset = 0; offset < value.size(); offset += kWordSize) {
+    uint64_t word = 0;
+    std::memcpy(&word, value.data() + offset,
+                std::min(kWordSize, value.size() - offset));
+    words[offset / kWordSize].store(word, std::memory_order_relaxed);
+  }
+  slot.size.store(static_cast<uint32_t>(value.size()),
+                  std::memory_order_relaxed);
+}
+
+uint64_t ParameterValueStore::copy(const Slot& slot,
+                                   std::vector<uint8_t>& data) const {
+  const std::atomic<uint64_t>* words = words_.get() + slot.offset;
+  for (unsigned attempt = 1;; ++attempt) {
+    const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if ((before & 1) == 0) {
+      const size_t size = std::min<size_t>(
+          slot.size.load(std::memory_order_relaxed), slot.capacity);
+      data.resize(size);
+      for (size_t offset = 0; offset < size; offset += kWordSize) {
+        const uint64_t word =
+            words[offset / kWordSize].load(std::memory_order_relaxed);
+        std::memcpy(data.data() + offset, &word,
+                    std::min(kWordSize, size - offset));
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == before) {
+        return before / 2;
+      }
+    }
+    if (attempt % kSpinsBeforeYield == 0) {
+      std::this_thread::yield();
+    }
+  }
+}
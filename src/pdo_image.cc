@@ -0,0 +1,153 @@
+#include "pdo_image.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "loguru.h"
+
+namespace {
+
+// The process image is little-endian, as are the hosts the client runs on,
+// so words are loaded and stored with plain copies
+constexpr size_t kWordSize = sizeof(uint64_t);
+
+/**
+ * @brief Returns the lowest `length` bits of a word.
+ */
+inline uint64_t lowBits(uint64_t word, unsigned length) noexcept {
+#if defined(__BMI2__)
+  return _bzhi_u64(word, length);
+#else
+  return length >= 64 ? word : word & ((uint64_t{1} << length) - 1);
+#endif
+}
+
+/**
+ * @brief Loads up to 8 bytes starting at `offset` as a little-endian word.
+ */
+inline uint64_t loadWord(std::span<const uint8_t> image,
+                         size_t offset) noexcept {
+  uint64_t word = 0;
+  if (offset + kWordSize <= image.size()) {
+    std::memcpy(&word, image.data() + offset, kWordSize);
+  } else if (offset < image.size()) {
+    std::memcpy(&word, image.data() + offset, image.size() - offset);
+  }
+  return word;
+}
+
+/**
+ * @brief Stores up to 8 bytes of a little-endian word starting at `offset`.
+ */
+inline void storeWord(std::span<uint8_t> image, size_t offset,
+                      uint64_t word) noexcept {
+  if (offset + kWordSize <= image.size()) {
+    std::memcpy(image.data() + offset, &word, kWordSize);
+  } else if (offset < image.size()) {
+    std::memcpy(image.data() + offset, &word, image.size() - offset);
+  }
+}
+
+}  // namespace
+
+std::vector<PdoImageEntry> layoutPdoImage(
+    const std::vector<common::PdoMappingEntry>& pdos) {
+  std::vector<PdoImageEntry> entries;
+  entries.reserve(pdos.size());
+
+  size_t bitOffset = 0;
+  for (const auto& pdo : pdos) {
+    entries.push_back({pdo.index, pdo.subindex, pdo.bitlength, bitOffset});
+    bitOffset += pdo.bitlength;
+  }
+
+  return entries;
+}
+
+size_t pdoImageSize(const std::vector<PdoImageEntry>& entries) noexcept {
+  size_t bits = 0;
+  for (const auto& entry : entries) {
+    bits = std::max(bits, entry.bitOffset + entry.bitLength);
+  }
+  return (bits + 7) / 8;
+}
+
+bool matchesPdoMapping(std::span<const PdoImageEntry> expected,
+                       const std::vector<common::PdoMappingEntry>& pdos) {
+  if (expected.size() != pdos.size()) {
+    LOG_F(ERROR, "PDO mapping has %zu entries, expected %zu", pdos.size(),
+          expected.size());
+    return false;
+  }
+
+  for (size_t i = 0; i < pdos.size(); ++i) {
+    const auto& entry = expected[i];
+    const auto& pdo = pdos[i];
+    if (pdo.index != entry.index || pdo.subindex != entry.subindex ||
+        pdo.bitlength != entry.bitLength) {
+      LOG_F(ERROR,
+            "PDO mapping entry %zu is 0x%04X:%02X (%d bits), expected "
+            "0x%04X:%02X (%d bits)",
+            i, pdo.index, pdo.subindex, pdo.bitlength, entry.index,
+            entry.subindex, entry.bitLength);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint64_t readPdoBits(std::span<const uint8_t> image,
+                     const PdoImageEntry& entry) noexcept {
+  const size_t byte = entry.byteOffset();
+  const unsigned shift = entry.bitOffset % 8;
+  uint64_t bits = loadWord(image, byte) >> shift;
+
+  // An unaligned entry of more than 56 bits spills into a ninth byte
+  if (shift + entry.bitLength > 64) {
+    bits |= loadWord(image, byte + kWordSize) << (64 - shift);
+  }
+
+  return lowBits(bits, entry.bitLength);
+}
+
+void writePdoBits(std::span<uint8_t> image, const PdoImageEntry& entry,
+                  uint64_t bits) noexcept {
+  const size_t byte = entry.byteOffset();
+  const unsigned shift = entry.bitOffset % 8;
+  const uint64_t mask = lowBits(~uint64_t{0}, entry.bitLength);
+  bits &= mask;
+
+  uint64_t word = loadWord(image, byte);
+  word = (word & ~(mask << shift)) | (bits << shift);
+  storeWord(image, byte, word);
+
+  if (shift + entry.bitLength > 64) {
+    const unsigned spilled = shift + entry.bitLength - 64;
+    uint64_t next = loadWord(image, byte + kWordSize);
+    next = (next & ~lowBits(~uint64_t{0}, spilled)) | (bits >> (64 - shift));
+    storeWord(image, byte + kWordSize, next);
+  }
+}
+
+void unpackPdoImage(std::span<const uint8_t> image,
+                    std::span<const PdoImageEntry> entries,
+                    std::span<uint64_t> values) noexcept {
+  const size_t count = std::min(entries.size(), values.size());
+  for (size_t i = 0; i < count; ++i) {
+    values[i] = readPdoBits(image, entries[i]);
+  }
+}
+
+void packPdoImage(std::span<const uint64_t> values,
+                  std::span<const PdoImageEntry> entries,
+                  std::span<uint8_t> image) noexcept {
+  const size_t count = std::min(entries.size(), values.size());
+  for (size_t i = 0; i < count; ++i) {
+    writePdoBits(image, entries[i], values[i]);
+  }
+}
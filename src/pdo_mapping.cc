@@ -0,0 +1,383 @@
+#include "pdo_mapping.h"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <set>
+
+#include "loguru.h"
+
+namespace {
+
+constexpr uint16_t kRxAssignmentIndex = 0x1C12;
+constexpr uint16_t kTxAssignmentIndex = 0x1C13;
+
+/**
+ * @brief SDO writes collected into one pipelined batch.
+ */
+struct SdoWriteBatch {
+  std::deque<std::array<uint8_t, 4>> values;  ///< Stable value storage.
+  std::vector<SdoTransfer> transfers;         ///< The writes, in order.
+
+  /**
+   * @brief Appends a write of the lowest `size` bytes of `value`.
+   */
+  void add(uint16_t index, uint8_t subindex, uint32_t value, size_t size) {
+    auto& bytes = values.emplace_back();
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    transfers.push_back({index, subindex, std::span(bytes).first(size)});
+  }
+};
+
+/**
+ * @brief Reads a batch of SDOs of up to 4 bytes and returns their values.
+ */
+std::vector<uint32_t> readValues(
+    EthernetConnection& connection,
+    const std::vector<std::pair<uint16_t, uint8_t>>& objects,
+    const std::chrono::steady_clock::duration expiryTime) {
+  std::vector<std::array<uint8_t, 4>> buffers(objects.size());
+  std::vector<SdoTransfer> transfers;
+  transfers.reserve(objects.size());
+  for (size_t i = 0; i < objects.size(); ++i) {
+    transfers.push_back({objects[i].first, objects[i].second, buffers[i]});
+  }
+
+  connection.readSdos(transfers, expiryTime);
+
+  std::vector<uint32_t> values;
+  values.reserve(objects.size());
+  for (size_t i = 0; i < transfers.size(); ++i) {
+    if (!transfers[i].success) {
+      throw std::runtime_error(
+          "Failed to read PDO mapping object " +
+          common::makeParameterId(transfers[i].index, transfers[i].subindex));
+    }
+    uint32_t value = 0;
+    for (size_t byte = 0; byte < transfers[i].size; ++byte) {
+      value |= static_cast<uint32_t>(buffers[i][byte]) << (8 * byte);
+    }
+    values.push_back(value);
+  }
+
+  return values;
+}
+
+/**
+ * @brief The PDOs assigned in one PDO assignment object and their entries.
+ */
+struct PdoAssignment {
+  std::vector<uint16_t> assigned;  ///< The assigned PDOs, in order.
+  std::map<uint16_t, std::vector<uint32_t>>
+      pdos;  ///< Encoded entries of each assigned PDO, possibly none.
+};
+
+/**
+ * @brief Reads the PDOs assigned in one PDO assignment object.
+ *
+ * Each level of the mapping is read as one pipelined batch: the number of
+ * assigned PDOs, the PDO indexes, the number of entries of each PDO and
+ * finally all entries.
+ */
+PdoAssignment readAssignment(
+    EthernetConnection& connection, uint16_t assignmentIndex,
+    const std::chrono::steady_clock::duration expiryTime) {
+  std::vector<std::pair<uint16_t, uint8_t>> objects{{assignmentIndex, 0}};
+  const auto count = readValues(connection, objects, expiryTime).front();
+
+  objects.clear();
+  for (uint32_t i = 1; i <= count; ++i) {
+    objects.emplace_back(assignmentIndex, static_cast<uint8_t>(i));
+  }
+  PdoAssignment assignment;
+  for (auto pdoIndex : readValues(connection, objects, expiryTime)) {
+    assignment.assigned.push_back(static_cast<uint16_t>(pdoIndex));
+  }
+
+  objects.clear();
+  for (auto pdoIndex : assignment.assigned) {
+    objects.emplace_back(pdoIndex, 0);
+  }
+  const auto counts = readValues(connection, objects, expiryTime);
+
+  objects.clear();
+  for (size_t i = 0; i < assignment.assigned.size(); ++i) {
+    // PDOs without entries are kept as present and empty
+    assignment.pdos[assignment.assigned[i]];
+    for (uint32_t j = 1; j <= counts[i]; ++j) {
+      objects.emplace_back(assignment.assigned[i], static_cast<uint8_t>(j));
+    }
+  }
+  const auto encoded = readValues(connection, objects, expiryTime);
+
+  for (size_t i = 0; i < encoded.size(); ++i) {
+    assignment.pdos[objects[i].first].push_back(encoded[i]);
+  }
+
+  return assignment;
+}
+
+/**
+ * @brief Decodes the entries of the PDOs of an assignment, in assignment
+ * order.
+ */
+std::vector<common::PdoMappingEntry> toPdoMappingEntries(
+    const PdoAssignment& assignment) {
+  std::vector<common::PdoMappingEntry> entries;
+  for (auto pdoIndex : assignment.assigned) {
+    // Each entry is encoded as index << 16 | subindex << 8 | bit length
+    for (auto entry : assignment.pdos.at(pdoIndex)) {
+      entries.push_back({pdoIndex, static_cast<uint16_t>(entry >> 16),
+                         static_cast<uint8_t>(entry >> 8),
+                         static_cast<uint8_t>(entry)});
+    }
+  }
+  return entries;
+}
+
+/**
+ * @brief The changes that turn the current mapping of one direction into the
+ * desired one.
+ */
+struct PdoChanges {
+  uint16_t assignmentIndex;        ///< The PDO assignment object.
+  std::vector<uint16_t> assigned;  ///< The desired assigned PDOs, in order.
+  std::map<uint16_t, std::vector<uint32_t>>
+      remapped;  ///< Desired entries of the changed PDOs.
+  bool assignmentChanged = false;  ///< Whether the assigned PDOs differ.
+
+  bool empty() const { return remapped.empty() && !assignmentChanged; }
+};
+
+/**
+ * @brief Compares the current mapping of one direction with the desired one.
+ */
+PdoChanges diffPdos(
+    uint16_t assignmentIndex, const PdoAssignment& current,
+    const std::map<std::uint16_t, std::vector<std::uint32_t>>& desired) {
+  PdoChanges changes;
+  changes.assignmentIndex = assignmentIndex;
+  for (const auto& [pdoIndex, entries] : desired) {
+    changes.assigned.push_back(pdoIndex);
+    auto it = current.pdos.find(pdoIndex);
+    if (it == current.pdos.end() || it->second != entries) {
+      changes.remapped.emplace(pdoIndex, entries);
+    }
+  }
+  changes.assignmentChanged = current.assigned != changes.assigned;
+  return changes;
+}
+
+/**
+ * @brief The dependent steps of a remapping, each sent as one batch.
+ *
+ * A step is only sent once every write of the previous one succeeded, so a
+ * count is never restored over entries that failed to write.
+ */
+enum PdoStep : size_t {
+  kClear,             ///< Clear the counts of the assignments and PDOs.
+  kEntries,           ///< Write the PDO entries and the assigned PDOs.
+  kPdoCounts,         ///< Restore the counts of the remapped PDOs.
+  kAssignmentCounts,  ///< Restore the counts of the assignments.
+  kPdoStepCount
+};
+
+/**
+ * @brief Appends the writes of one direction to the steps of a remapping.
+ */
+void appendPdoChanges(std::array<SdoWriteBatch, kPdoStepCount>& steps,
+                      const PdoChanges& changes) {
+  if (changes.empty()) {
+    return;
+  }
+
+  // The assignment is cleared while PDOs are remapped, as the device only
+  // accepts changes to unassigned or disabled PDOs
+  steps[kClear].add(changes.assignmentIndex, 0, 0, 1);
+  for (const auto& [pdoIndex, entries] : changes.remapped) {
+    steps[kClear].add(pdoIndex, 0, 0, 1);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      steps[kEntries].add(pdoIndex, static_cast<uint8_t>(i + 1), entries[i],
+                          4);
+    }
+    steps[kPdoCounts].add(pdoIndex, 0, static_cast<uint32_t>(entries.size()),
+                          1);
+  }
+  if (changes.assignmentChanged) {
+    for (size_t i = 0; i < changes.assigned.size(); ++i) {
+      steps[kEntries].add(changes.assignmentIndex,
+                          static_cast<uint8_t>(i + 1), changes.assigned[i], 2);
+    }
+  }
+  steps[kAssignmentCounts].add(changes.assignmentIndex, 0,
+                               static_cast<uint32_t>(changes.assigned.size()),
+                               1);
+}
+
+/**
+ * @brief Logs and throws a failed remapping, naming the objects whose count
+ * was cleared and not restored.
+ */
+[[noreturn]] void throwPdoMappingError(std::string message,
+                                       const std::set<uint16_t>& cleared) {
+  if (!cleared.empty()) {
+    message += "; left cleared:";
+    for (auto index : cleared) {
+      message += " " + common::makeParameterId(index, 0);
+    }
+  }
+  LOG_F(ERROR, "%s", message.c_str());
+  throw std::runtime_error(message);
+}
+
+/**
+ * @brief Writes the steps of a remapping in order and returns the number of
+ * writes.
+ *
+ * `writeStep` writes the transfers of one step and sets their `success`. A
+ * step is only written once every write of the previous one succeeded.
+ *
+ * @throws std::runtime_error If a write fails, naming the objects left
+ * cleared.
+ */
+template <typename WriteStep>
+size_t writePdoSteps(std::array<SdoWriteBatch, kPdoStepCount>& steps,
+                     WriteStep&& writeStep) {
+  std::set<uint16_t> cleared;
+  size_t writes = 0;
+  for (size_t step = 0; step < steps.size(); ++step) {
+    auto& transfers = steps[step].transfers;
+    if (transfers.empty()) {
+      continue;
+    }
+
+    try {
+      writeStep(std::span<SdoTransfer>(transfers));
+    } catch (const std::runtime_error& e) {
+      // Which writes of the step took effect is unknown, so a clear counts
+      // as done and a restore as not done
+      if (step == kClear) {
+        for (const auto& transfer : transfers) {
+          cleared.insert(transfer.index);
+        }
+      }
+      throwPdoMappingError(e.what(), cleared);
+    }
+
+    for (const auto& transfer : transfers) {
+      if (!transfer.success) {
+        continue;
+      }
+      if (step == kClear) {
+        cleared.insert(transfer.index);
+      } else if (step != kEntries) {
+        cleared.erase(transfer.index);
+      }
+    }
+    for (const auto& transfer : transfers) {
+      if (!transfer.success) {
+        throwPdoMappingError(
+            "Failed to write PDO mapping object " +
+                common::makeParameterId(transfer.index, transfer.subindex),
+            cleared);
+      }
+    }
+    writes += transfers.size();
+  }
+
+  return writes;
+}
+
+/**
+ * @brief Decodes the entries of one direction of a UI PDO mapping.
+ */
+std::vector<common::PdoMappingEntry> toPdoMappingEntries(
+    const std::map<std::uint16_t, std::vector<std::uint32_t>>& pdos) {
+  std::vector<common::PdoMappingEntry> entries;
+  for (const auto& [pdoIndex, encoded] : pdos) {
+    for (auto entry : encoded) {
+      entries.push_back({pdoIndex, static_cast<uint16_t>(entry >> 16),
+                         static_cast<uint8_t>(entry >> 8),
+                         static_cast<uint8_t>(entry)});
+    }
+  }
+  return entries;
+}
+
+}  // namespace
+
+common::PdoMappings readPdoMappings(
+    EthernetConnection& connection,
+    const std::chrono::steady_clock::duration expiryTime) {
+  common::PdoMappings mappings;
+  mappings.rxPdos = toPdoMappingEntries(
+      readAssignment(connection, kRxAssignmentIndex, expiryTime));
+  mappings.txPdos = toPdoMappingEntries(
+      readAssignment(connection, kTxAssignmentIndex, expiryTime));
+  return mappings;
+}
+
+common::PdoMappings toPdoMappings(const common::UiPdoMapping& mapping) {
+  common::PdoMappings mappings;
+  mappings.rxPdos = toPdoMappingEntries(mapping.rx);
+  mappings.txPdos = toPdoMappingEntries(mapping.tx);
+  return mappings;
+}
+
+common::PdoMappings applyPdoMapping(
+    EthernetConnection& connection, const common::UiPdoMapping& mapping,
+    const std::chrono::steady_clock::duration expiryTime) {
+  const auto currentRx =
+      readAssignment(connection, kRxAssignmentIndex, expiryTime);
+  const auto currentTx =
+      readAssignment(connection, kTxAssignmentIndex, expiryTime);
+
+  std::array<SdoWriteBatch, kPdoStepCount> steps;
+  appendPdoChanges(steps, diffPdos(kRxAssignmentIndex, currentRx, mapping.rx));
+  appendPdoChanges(steps, diffPdos(kTxAssignmentIndex, currentTx, mapping.tx));
+
+  if (steps[kClear].transfers.empty()) {
+    LOG_F(INFO, "PDO mapping is unchanged");
+    return {toPdoMappingEntries(currentRx), toPdoMappingEntries(currentTx)};
+  }
+
+  const size_t writes =
+      writePdoSteps(steps, [&](std::span<SdoTransfer> transfers) {
+        connection.writeSdos(transfers, expiryTime);
+      });
+
+  LOG_F(INFO, "PDO mapping applied with %zu SDO writes", writes);
+  return toPdoMappings(mapping);
+}
+
+void writePdoMapping(EthernetDevice& device,
+                     const common::UiPdoMapping& mapping,
+                     const std::chrono::steady_clock::duration expiryTime) {
+  // The current mapping is unknown, so every PDO is remapped and both
+  // assignments are rewritten
+  PdoChanges rx = diffPdos(kRxAssignmentIndex, {}, mapping.rx);
+  PdoChanges tx = diffPdos(kTxAssignmentIndex, {}, mapping.tx);
+  rx.assignmentChanged = true;
+  tx.assignmentChanged = true;
+
+  std::array<SdoWriteBatch, kPdoStepCount> steps;
+  appendPdoChanges(steps, rx);
+  appendPdoChanges(steps, tx);
+
+  const size_t writes =
+      writePdoSteps(steps, [&](std::span<SdoTransfer> transfers) {
+        for (auto& transfer : transfers) {
+          transfer.success = device.writeSdo(
+              transfer.index, transfer.subindex,
+              {transfer.data.begin(), transfer.data.end()}, expiryTime);
+          if (!transfer.success) {
+            // The rest of the step is left unsent
+            break;
+          }
+        }
+      });
+
+  LOG_F(INFO, "PDO mapping written with %zu SDO writes", writes);
+}
@@ -0,0 +1,139 @@
+#include "pdo_subscriptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "loguru.h"
+
+namespace {
+
+constexpr size_t kWordSize = sizeof(uint64_t);
+
+/**
+ * @brief Loads up to 8 bytes of an image as one word.
+ */
+uint64_t loadWord(std::span<const uint8_t> image, size_t word) noexcept {
+  uint64_t value = 0;
+  size_t offset = word * kWordSize;
+  std::memcpy(&value, image.data() + offset,
+              std::min(kWordSize, image.size() - offset));
+  return value;
+}
+
+}  // namespace
+
+PdoSubscriptions::PdoSubscriptions(
+    const std::vector<common::PdoMappingEntry>& txPdos)
+    : entries_(layoutPdoImage(txPdos)) {}
+
+PdoSubscriptions::Handle PdoSubscriptions::add(uint16_t index,
+                                               uint8_t subindex,
+                                               PdoDeadband deadband,
+                                               Decoder decode,
+                                               Notifier notify) {
+  auto it = std::find_if(entries_.begin(), entries_.end(),
+                         [&](const PdoImageEntry& entry) {
+                           return entry.index == index &&
+                                  entry.subindex == subindex;
+                         });
+  if (it == entries_.end()) {
+    LOG_F(ERROR, "Object 0x%04X:%02X is not mapped as TxPDO", index,
+          subindex);
+    throw std::runtime_error("Object is not mapped as TxPDO");
+  }
+
+  Subscription subscription{*it, deadband, decode, std::move(notify),
+                            it->byteOffset() / kWordSize,
+                            (it->byteOffset() + it->byteLength() - 1) /
+                                kWordSize};
+  // Report the current value right away, as `update` would have done for a
+  // subscription made before the first image
+  const PdoImageEntry& entry = subscription.entry;
+  const bool current = initialized_ && entry.byteOffset() +
+                                          entry.byteLength() <=
+                                      previous_.size();
+  if (current) {
+    subscription.reported = decode(previous_, entry);
+  }
+  subscriptions_.push_back(std::move(subscription));
+  if (current) {
+    subscriptions_.back().notify(previous_, subscriptions_.back().entry);
+  }
+  return subscriptions_.size() - 1;
+}
+
+void PdoSubscriptions::unsubscribe(Handle handle) {
+  if (handle < subscriptions_.size()) {
+    subscriptions_[handle].active = false;
+    subscriptions_[handle].notify = nullptr;
+  }
+}
+
+void PdoSubscriptions::update(std::span<const uint8_t> image) {
+  const bool initial = !initialized_ || image.size() != previous_.size();
+
+  if (!initial) {
+    if (std::memcmp(image.data(), previous_.data(), image.size()) == 0) {
+      return;
+    }
+
+    const size_t words = (image.size() + kWordSize - 1) / kWordSize;
+    changedWords_.assign((words + 63) / 64, 0);
+    for (size_t word = 0; word < words; ++word) {
+      if (loadWord(image, word) != loadWord(previous_, word)) {
+        changedWords_[word / 64] |= uint64_t{1} << (word % 64);
+      }
+    }
+  }
+
+  for (auto& subscription : subscriptions_) {
+    const auto& entry = subscription.entry;
+    if (!subscription.active ||
+        entry.byteOffset() + entry.byteLength() > image.size()) {
+      continue;
+    }
+
+    if (!initial) {
+      bool changed = false;
+      for (size_t word = subscription.firstWord;
+           word <= subscription.lastWord && !changed; ++word) {
+        changed = (changedWords_[word / 64] >> (word % 64)) & 1;
+      }
+      if (!changed) {
+        continue;
+      }
+    }
+
+    const double value = subscription.decode(image, entry);
+    bool report = initial;
+    if (!report) {
+      report = subscription.deadband.kind == PdoDeadband::Kind::NONE
+                   ? readPdoBits(image, entry) != readPdoBits(previous_, entry)
+                   : exceeds(subscription, value);
+    }
+    if (report) {
+      subscription.reported = value;
+      subscription.notify(image, entry);
+    }
+  }
+
+  previous_.assign(image.begin(), image.end());
+  initialized_ = true;
+}
+
+bool PdoSubscriptions::exceeds(const Subscription& subscription,
+                               double value) {
+  const double change = std::abs(value - subscription.reported);
+  switch (subscription.deadband.kind) {
+    case PdoDeadband::Kind::ABSOLUTE:
+      return change > subscription.deadband.value;
+    case PdoDeadband::Kind::PERCENT:
+      return change > subscription.deadband.value / 100.0 *
+                          std::abs(subscription.reported);
+    case PdoDeadband::Kind::NONE:
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,206 @@
+#include "poll_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "loguru.h"
+
+PollScheduler::PollScheduler(EthernetConnection& connection,
+                             EthernetDevice& device,
+                             Clock::duration coalesceWindow)
+    : connection_(connection),
+      device_(device),
+      coalesceWindow_(coalesceWindow) {}
+
+PollScheduler::~PollScheduler() { stop(); }
+
+void PollScheduler::add(uint16_t index, uint8_t subindex,
+                        Clock::duration period) {
+  if (period <= Clock::duration::zero()) {
+    throw std::invalid_argument("The polling period must be positive");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = std::find_if(polls_.begin(), polls_.end(), [&](const Poll& poll) {
+    return poll.index == index && poll.subindex == subindex;
+  });
+  if (it != polls_.end()) {
+    it->period = period;
+    it->due = std::min(it->due, Clock::now() + period);
+  } else {
+    // Golden ratio sequence: consecutive registrations land far apart within
+    // the period, however many there are
+    double phase = std::fmod(0.6180339887 * registrations_++, 1.0);
+    auto offset = std::chrono::duration_cast<Clock::duration>(period * phase);
+    polls_.push_back({index, subindex, period, Clock::now() + offset, {}});
+  }
+
+  condition_.notify_one();
+}
+
+void PollScheduler::remove(uint16_t index, uint8_t subindex) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::erase_if(polls_, [&](const Poll& poll) {
+    return poll.index == index && poll.subindex == subindex;
+  });
+}
+
+void PollScheduler::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  worker_ = std::thread(&PollScheduler::run, this);
+}
+
+void PollScheduler::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  condition_.notify_one();
+
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+PollScheduler::Clock::time_point PollScheduler::pollDue() {
+  // Serializes direct calls with the worker thread; `mutex_` is not held
+  // during the reads so that registrations and readers are not blocked
+  std::lock_guard<std::mutex> burstLock(burstMutex_);
+  const size_t bufferSize = EthernetMessage::kBufferSize;
+  transfers_.clear();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = Clock::now();
+    const auto horizon = now + coalesceWindow_;
+
+    for (auto& poll : polls_) {
+      if (poll.due > horizon) {
+        continue;
+      }
+      transfers_.push_back({poll.index, poll.subindex, {}});
+
+      // Keep the phase; skip the periods that were missed entirely
+      poll.due += poll.period;
+      if (poll.due <= now) {
+        auto missed = (now - poll.due) / poll.period + 1;
+        poll.due += missed * poll.period;
+      }
+    }
+  }
+
+  if (!transfers_.empty()) {
+    if (values_.size() < transfers_.size() * bufferSize) {
+      values_.resize(transfers_.size() * bufferSize);
+    }
+    for (size_t i = 0; i < transfers_.size(); ++i) {
+      transfers_[i].data =
+          std::span(values_).subspan(i * bufferSize, bufferSize);
+    }
+
+    try {
+      connection_.readSdos(transfers_);
+    } catch (const std::runtime_error& e) {
+      LOG_F(ERROR, "Failed to poll %zu parameters: %s", transfers_.size(),
+            e.what());
+      transfers_.clear();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& transfer : transfers_) {
+    if (!transfer.success) {
+      continue;
+    }
+    auto value = transfer.data.first(transfer.size);
+
+    // The poll may have been removed while the burst was in flight
+    auto it = std::find_if(polls_.begin(), polls_.end(), [&](const Poll& p) {
+      return p.index == transfer.index && p.subindex == transfer.subindex;
+    });
+    if (it != polls_.end()) {
+      it->value.assign(value.begin(), value.end());
+      it->read = true;
+      it->applied = false;
+    }
+
+    if (store_ && store_->contains(transfer.index, transfer.subindex)) {
+      try {
+        store_->publish(transfer.index, transfer.subindex, value);
+      } catch (const std::runtime_error& e) {
+        LOG_F(WARNING, "Cannot publish polled SDO 0x%04X:%02X: %s",
+              transfer.index, transfer.subindex, e.what());
+      }
+    }
+  }
+  return nextDue();
+}
+
+bool PollScheduler::value(uint16_t index, uint8_t subindex,
+                          std::vector<uint8_t>& data) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find_if(polls_.begin(), polls_.end(), [&](const Poll& poll) {
+    return poll.index == index && poll.subindex == subindex;
+  });
+  if (it == polls_.end() || !it->read) {
+    return false;
+  }
+  data.assign(it->value.begin(), it->value.end());
+  return true;
+}
+
+size_t PollScheduler::apply() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t updated = 0;
+  for (auto& poll : polls_) {
+    if (!poll.read || poll.applied) {
+      continue;
+    }
+    poll.applied = true;
+    try {
+      device_.findParameter(poll.index, poll.subindex)
+          .data.assign(poll.value.begin(), poll.value.end());
+      ++updated;
+    } catch (const std::runtime_error& e) {
+      LOG_F(WARNING, "Cannot apply polled SDO 0x%04X:%02X: %s", poll.index,
+            poll.subindex, e.what());
+    }
+  }
+  return updated;
+}
+
+void PollScheduler::run() {
+  auto due = Clock::now();
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (running_) {
+    if (Clock::now() < due) {
+      // Registrations may bring the next poll forward, so check again
+      if (due == Clock::time_point::max()) {
+        condition_.wait(lock);
+      } else {
+        condition_.wait_until(lock, due);
+      }
+      due = nextDue();
+      continue;
+    }
+
+    lock.unlock();
+    due = pollDue();
+    lock.lock();
+  }
+}
+
+PollScheduler::Clock::time_point PollScheduler::nextDue() const {
+  auto due = Clock::time_point::max();
+  for (const auto& poll : polls_) {
+    due = std::min(due, poll.due);
+  }
+  return due;
+}
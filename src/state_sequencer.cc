@@ -0,0 +1,273 @@
+#include "state_sequencer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include "loguru.h"
+
+namespace {
+
+/**
+ * @brief Returns the waiter configuration matching the sequencer options.
+ */
+StateWaiter::Options waiterOptions(const StateSequencer::Options& options) {
+  StateWaiter::Options waiter;
+  waiter.requestTimeout = options.requestTimeout;
+  return waiter;
+}
+
+/**
+ * @brief Converts a duration to milliseconds for printing.
+ */
+double toMilliseconds(StateSequencer::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+size_t StateSequencer::Report::slowest(size_t stage) const noexcept {
+  size_t slowest = devices.size();
+  Clock::duration longest{-1};
+  for (size_t i = 0; i < devices.size(); ++i) {
+    const auto& stages = devices[i].stages;
+    if (stage < stages.size() && stages[stage].total() > longest) {
+      longest = stages[stage].total();
+      slowest = i;
+    }
+  }
+  return slowest;
+}
+
+StateSequencer::StateSequencer(const Options& options)
+    : options_(options),
+      waiter_(waiterOptions(options)),
+      before_(options.states.size()),
+      after_(options.states.size()) {}
+
+size_t StateSequencer::add(EthernetDevice& device) {
+  devices_.push_back(&device);
+  return devices_.size() - 1;
+}
+
+void StateSequencer::addHook(uint8_t state, HookPoint point, Hook hook) {
+  auto& hooks = point == HookPoint::BEFORE ? before_ : after_;
+  hooks[stageOf(state)].push_back(std::move(hook));
+}
+
+void StateSequencer::order(size_t first, uint8_t firstState, size_t then,
+                           uint8_t thenState) {
+  if (first >= devices_.size() || then >= devices_.size()) {
+    throw std::invalid_argument("Unknown device in state ordering");
+  }
+  orderings_.push_back(
+      {{first, stageOf(firstState)}, {then, stageOf(thenState)}});
+}
+
+StateSequencer::Report StateSequencer::run(Clock::time_point deadline) {
+  checkOrderings();
+
+  const auto start = Clock::now();
+  completed_.assign(devices_.size(), 0);
+  failed_.assign(devices_.size(), false);
+
+  Report report;
+  report.devices.resize(devices_.size());
+  std::vector<std::thread> threads;
+  threads.reserve(devices_.size());
+  for (size_t i = 0; i < devices_.size(); ++i) {
+    threads.emplace_back([this, i, deadline, &report] {
+      runDevice(i, deadline, report.devices[i]);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  report.total = Clock::now() - start;
+  report.success = std::all_of(
+      report.devices.begin(), report.devices.end(),
+      [](const DeviceReport& device) { return device.success; });
+  return report;
+}
+
+size_t StateSequencer::stageOf(uint8_t state) const {
+  auto it = std::find(options_.states.begin(), options_.states.end(), state);
+  if (it == options_.states.end()) {
+    throw std::invalid_argument("State " + std::to_string(state) +
+                                " is not part of the sequence");
+  }
+  return static_cast<size_t>(it - options_.states.begin());
+}
+
+void StateSequencer::checkOrderings() const {
+  // Topologically sort the steps; each step follows the previous stage of
+  // its device and the steps it is ordered after
+  const size_t stages = options_.states.size();
+  const size_t steps = devices_.size() * stages;
+  std::vector<std::vector<size_t>> successors(steps);
+  std::vector<size_t> predecessors(steps, 0);
+  auto link = [&](size_t from, size_t to) {
+    successors[from].push_back(to);
+    ++predecessors[to];
+  };
+  for (size_t device = 0; device < devices_.size(); ++device) {
+    for (size_t stage = 1; stage < stages; ++stage) {
+      link(device * stages + stage - 1, device * stages + stage);
+    }
+  }
+  for (const auto& [first, then] : orderings_) {
+    link(first.device * stages + first.stage,
+         then.device * stages + then.stage);
+  }
+
+  std::vector<size_t> ready;
+  for (size_t step = 0; step < steps; ++step) {
+    if (predecessors[step] == 0) {
+      ready.push_back(step);
+    }
+  }
+  size_t sorted = 0;
+  while (!ready.empty()) {
+    const size_t step = ready.back();
+    ready.pop_back();
+    ++sorted;
+    for (size_t next : successors[step]) {
+      if (--predecessors[next] == 0) {
+        ready.push_back(next);
+      }
+    }
+  }
+
+  if (sorted != steps) {
+    LOG_F(ERROR, "The declared state orderings form a cycle");
+    throw std::logic_error("The declared state orderings form a cycle");
+  }
+}
+
+void StateSequencer::runDevice(size_t device, Clock::time_point deadline,
+                               DeviceReport& report) {
+  EthernetDevice& ethernetDevice = *devices_[device];
+  report.stages.reserve(options_.states.size());
+
+  auto runHooks = [&](const std::vector<Hook>& hooks, StageTiming& timing) {
+    const auto start = Clock::now();
+    for (const auto& hook : hooks) {
+      hook(device, ethernetDevice);
+    }
+    timing.hooks += Clock::now() - start;
+  };
+
+  for (size_t stage = 0; stage < options_.states.size(); ++stage) {
+    const uint8_t state = options_.states[stage];
+    auto& timing = report.stages.emplace_back();
+    timing.state = state;
+
+    auto start = Clock::now();
+    report.error = awaitOrderings(device, stage, deadline);
+    timing.ordering = Clock::now() - start;
+
+    if (report.error.empty()) {
+      try {
+        runHooks(before_[stage], timing);
+
+        start = Clock::now();
+        if (!ethernetDevice.setState(state, options_.requestTimeout)) {
+          report.error = "The state request was refused";
+        } else if (!waiter_.waitForState(
+                       ethernetDevice, state,
+                       std::min(deadline, Clock::now() +
+                                              options_.stageTimeout))) {
+          report.error = "The state was not reached";
+        }
+        timing.transition = Clock::now() - start;
+
+        if (report.error.empty()) {
+          runHooks(after_[stage], timing);
+        }
+      } catch (const std::exception& e) {
+        report.error = e.what();
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!report.error.empty()) {
+      LOG_F(ERROR, "Device %zu failed at state 0x%02X: %s", device, state,
+            report.error.c_str());
+      failed_[device] = true;
+      condition_.notify_all();
+      return;
+    }
+    timing.completed = true;
+    completed_[device] = stage + 1;
+    condition_.notify_all();
+  }
+
+  report.success = true;
+}
+
+std::string StateSequencer::awaitOrderings(size_t device, size_t stage,
+                                           Clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (const auto& [first, then] : orderings_) {
+    if (then.device != device || then.stage != stage) {
+      continue;
+    }
+
+    const bool settled = condition_.wait_until(lock, deadline, [&] {
+      return completed_[first.device] > first.stage || failed_[first.device];
+    });
+    if (!settled) {
+      return "Timed out waiting for device " + std::to_string(first.device);
+    }
+    if (completed_[first.device] <= first.stage) {
+      return "Device " + std::to_string(first.device) +
+             " failed before this stage could start";
+    }
+  }
+  return {};
+}
+
+std::string formatSequencerReport(const StateSequencer::Report& report) {
+  const size_t stages = std::accumulate(
+      report.devices.begin(), report.devices.end(), size_t{0},
+      [](size_t count, const StateSequencer::DeviceReport& device) {
+        return std::max(count, device.stages.size());
+      });
+
+  std::vector<size_t> slowest(stages);
+  for (size_t stage = 0; stage < stages; ++stage) {
+    slowest[stage] = report.slowest(stage);
+  }
+
+  // Each cell shows the total time of a stage and, in parentheses, the parts
+  // spent waiting for other devices and running hooks
+  std::string output;
+  char line[96];
+  std::snprintf(line, sizeof(line), "Sequence %s in %.1f ms\n",
+                report.success ? "completed" : "failed",
+                toMilliseconds(report.total));
+  output += line;
+  for (size_t i = 0; i < report.devices.size(); ++i) {
+    const auto& device = report.devices[i];
+    std::snprintf(line, sizeof(line), "Device %3zu:", i);
+    output += line;
+    for (size_t stage = 0; stage < device.stages.size(); ++stage) {
+      const auto& timing = device.stages[stage];
+      std::snprintf(line, sizeof(line), " 0x%02X %8.1f ms (%.1f/%.1f)%s%s",
+                    timing.state, toMilliseconds(timing.total()),
+                    toMilliseconds(timing.ordering),
+                    toMilliseconds(timing.hooks),
+                    slowest[stage] == i ? "*" : "",
+                    timing.completed ? "" : " FAILED");
+      output += line;
+    }
+    if (!device.success) {
+      output += ": " + device.error;
+    }
+    output += '\n';
+  }
+  return output;
+}
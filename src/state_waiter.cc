@@ -0,0 +1,136 @@
+#include "state_waiter.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+StateWaiter::StateWaiter(const Options& options) : options_(options) {
+  options_.minInterval = std::max(options_.minInterval, Clock::duration(1));
+  options_.maxInterval = std::max(options_.maxInterval, options_.minInterval);
+}
+
+bool StateWaiter::waitForState(EthernetDevice& device, uint8_t target,
+                               Clock::time_point deadline) {
+  EthernetDevice* const devices[] = {&device};
+  return waitForStates(devices, target, deadline);
+}
+
+bool StateWaiter::waitForState(EthernetConnection& connection,
+                               uint8_t target, Clock::time_point deadline) {
+  const StateReader readers[] = {[&connection](Clock::duration expiryTime) {
+    return connection.getState(expiryTime);
+  }};
+  return waitForStates(readers, target, deadline);
+}
+
+bool StateWaiter::waitForStates(std::span<EthernetDevice* const> devices,
+                                uint8_t target, Clock::time_point deadline,
+                                std::span<uint8_t> states) {
+  std::vector<StateReader> readers;
+  readers.reserve(devices.size());
+  for (auto* device : devices) {
+    readers.emplace_back([device](Clock::duration expiryTime) {
+      return device->getState(expiryTime);
+    });
+  }
+  return waitForStates(readers, target, deadline, states);
+}
+
+bool StateWaiter::waitForStates(std::span<const StateReader> readers,
+                                uint8_t target, Clock::time_point deadline,
+                                std::span<uint8_t> states) {
+  if (!states.empty() && states.size() < readers.size()) {
+    throw std::invalid_argument("The state buffer is smaller than the "
+                                "number of devices");
+  }
+
+  struct Waiting {
+    Clock::time_point nextPoll;  // When the device is polled next
+    unsigned overdue = 0;        // Polls after the expected time
+    uint8_t state = 0;           // The last state read
+    bool done = false;           // Whether the state was reached or refused
+  };
+
+  const auto start = Clock::now();
+  const Clock::duration expected = expectedTransitionTime(target);
+  std::vector<Waiting> waiting(readers.size(), Waiting{start});
+  size_t remaining = readers.size();
+
+  while (remaining > 0) {
+    auto next = std::min_element(
+        waiting.begin(), waiting.end(),
+        [](const Waiting& lhs, const Waiting& rhs) {
+          return !lhs.done && (rhs.done || lhs.nextPoll < rhs.nextPoll);
+        });
+    const size_t i = static_cast<size_t>(next - waiting.begin());
+    auto& device = waiting[i];
+
+    // The last poll is made at the deadline
+    const bool last = device.nextPoll >= deadline;
+    std::this_thread::sleep_until(std::min(device.nextPoll, deadline));
+
+    device.state = readers[i](options_.requestTimeout);
+    const auto elapsed = Clock::now() - start;
+    if (device.state == target) {
+      learn(target, elapsed);
+      device.done = true;
+      --remaining;
+    } else if ((device.state & kErrorFlag) != 0 || last) {
+      device.done = true;
+      --remaining;
+    } else {
+      if (elapsed >= expected) {
+        ++device.overdue;
+      }
+      device.nextPoll =
+          Clock::now() + nextInterval(elapsed, expected, device.overdue);
+    }
+  }
+
+  bool reached = true;
+  for (size_t i = 0; i < waiting.size(); ++i) {
+    reached = reached && waiting[i].state == target;
+    if (!states.empty()) {
+      states[i] = waiting[i].state;
+    }
+  }
+  return reached;
+}
+
+StateWaiter::Clock::duration StateWaiter::nextInterval(
+    Clock::duration elapsed, Clock::duration expected,
+    unsigned overdue) const noexcept {
+  Clock::duration interval;
+  if (elapsed < expected) {
+    // Close in on the expected completion
+    interval = (expected - elapsed) / 2;
+  } else {
+    // Back off geometrically once the device is slower than expected
+    interval = options_.minInterval;
+    for (unsigned i = 0; i < overdue && interval < options_.maxInterval;
+         ++i) {
+      interval *= 2;
+    }
+  }
+  return std::clamp(interval, options_.minInterval, options_.maxInterval);
+}
+
+void StateWaiter::learn(uint8_t target, Clock::duration elapsed) noexcept {
+  auto& expected = expected_[target];
+  const Clock::rep previous = expected.load(std::memory_order_relaxed);
+  const Clock::rep observed = elapsed.count();
+  const Clock::rep updated =
+      previous == 0
+          ? observed
+          : previous + static_cast<Clock::rep>(
+                           options_.smoothing *
+                           static_cast<double>(observed - previous));
+  expected.store(std::max<Clock::rep>(updated, 1), std::memory_order_relaxed);
+}
+
+bool waitForState(EthernetDevice& device, uint8_t target,
+                  StateWaiter::Clock::time_point deadline) {
+  static StateWaiter waiter;
+  return waiter.waitForState(device, target, deadline);
+}
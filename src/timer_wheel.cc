@@ -0,0 +1,126 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(Clock::duration tick, Clock::time_point start)
+    : tick_(std::max(tick, Clock::duration(1))), start_(start) {
+  for (auto& level : slots_) {
+    level.fill(kNone);
+  }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(Clock::time_point deadline,
+                                         uint64_t value) {
+  int32_t node = free_;
+  if (node != kNone) {
+    free_ = nodes_[node].next;
+  } else {
+    node = static_cast<int32_t>(nodes_.size());
+    nodes_.emplace_back();
+  }
+
+  // A slot is processed once per tick, so the earliest is the next tick
+  nodes_[node].expiry = std::max(tickOf(deadline), current_ + 1);
+  nodes_[node].value = value;
+  insert(node);
+  ++size_;
+
+  return uint64_t{nodes_[node].generation} << 32 |
+         static_cast<uint32_t>(node);
+}
+
+bool TimerWheel::cancel(TimerId id) noexcept {
+  const auto node = static_cast<int32_t>(id & 0xFFFFFFFF);
+  if (id == kInvalidTimer || node < 0 ||
+      static_cast<size_t>(node) >= nodes_.size()) {
+    return false;
+  }
+  Node& entry = nodes_[node];
+  if (entry.level < 0 || entry.generation != (id >> 32)) {
+    return false;
+  }
+
+  if (entry.previous != kNone) {
+    nodes_[entry.previous].next = entry.next;
+  } else {
+    slots_[entry.level][entry.slot] = entry.next;
+  }
+  if (entry.next != kNone) {
+    nodes_[entry.next].previous = entry.previous;
+  }
+  release(node);
+  return true;
+}
+
+uint64_t TimerWheel::tickOf(Clock::time_point time) const noexcept {
+  if (time <= start_) {
+    return 0;
+  }
+  return static_cast<uint64_t>((time - start_ + tick_ - Clock::duration(1)) /
+                               tick_);
+}
+
+void TimerWheel::insert(int32_t node) noexcept {
+  Node& entry = nodes_[node];
+  const uint64_t expiry = std::min(entry.expiry, current_ + kMaxDelta);
+  const uint64_t delta = expiry - current_;
+
+  int level = 0;
+  while (level + 1 < kLevels &&
+         delta >= (uint64_t{1} << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  const auto slot =
+      static_cast<uint16_t>((expiry >> (kSlotBits * level)) & kSlotMask);
+
+  entry.level = static_cast<int16_t>(level);
+  entry.slot = slot;
+  entry.previous = kNone;
+  entry.next = slots_[level][slot];
+  if (entry.next != kNone) {
+    nodes_[entry.next].previous = node;
+  }
+  slots_[level][slot] = node;
+}
+
+int32_t TimerWheel::takeSlot(int level, uint64_t slot) noexcept {
+  const int32_t first = slots_[level][slot];
+  slots_[level][slot] = kNone;
+  return first;
+}
+
+int32_t TimerWheel::popSlot(uint64_t slot) noexcept {
+  const int32_t first = slots_[0][slot];
+  if (first != kNone) {
+    slots_[0][slot] = nodes_[first].next;
+    if (nodes_[first].next != kNone) {
+      nodes_[nodes_[first].next].previous = kNone;
+    }
+  }
+  return first;
+}
+
+void TimerWheel::cascade() noexcept {
+  for (int level = 1; level < kLevels; ++level) {
+    const int shift = kSlotBits * level;
+    if ((current_ & ((uint64_t{1} << shift) - 1)) != 0) {
+      break;
+    }
+
+    int32_t node = takeSlot(level, (current_ >> shift) & kSlotMask);
+    while (node != kNone) {
+      const int32_t next = nodes_[node].next;
+      insert(node);
+      node = next;
+    }
+  }
+}
+
+void TimerWheel::release(int32_t node) noexcept {
+  Node& entry = nodes_[node];
+  entry.level = -1;
+  ++entry.generation;
+  entry.next = free_;
+  free_ = node;
+  --size_;
+}